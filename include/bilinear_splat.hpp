@@ -0,0 +1,37 @@
+#ifndef BILINEAR_SPLAT_HPP
+/** @file bilinear_splat.hpp
+ * <br>Anti-aliased splatting of orbit points into a DensityHistogram, and the box downsample
+ * of a supersampled one. SSE2 where available, the same arithmetic in scalar code otherwise.
+ */
+#define BILINEAR_SPLAT_HPP
+
+#include <cstdint>
+
+#include "density_histogram.hpp"
+#include "worker_pool.hpp"
+
+
+/** What one point adds, spread over up to four bins in 1/16 sub-pixel steps. */
+constexpr uint32_t SPLAT_ONE = 256;
+
+/**
+ * Adds SPLAT_ONE per point to the bin holding it.
+ * @param xs, ys coordinates in histogram pixels, pixel centres at +0.5; points outside are dropped.
+ */
+void splatNearest(HistogramSplatter &splatter, int width, int height,
+                  const float *xs, const float *ys, int count);
+
+/**
+ * Spreads SPLAT_ONE per point bilinearly over the four bins around it, so that sub-pixel
+ * positions survive; the weights of bins outside the image are dropped.
+ */
+void splatBilinear(HistogramSplatter &splatter, int width, int height,
+                   const float *xs, const float *ys, int count);
+
+/**
+ * Sums every factor x factor block of `in` (width x height, both multiples of factor)
+ * into one bin of `out`, rows split over the pool.
+ */
+void downsampleBox(const uint32_t *in, int width, int height, int factor, uint32_t *out, WorkerPool &pool);
+
+#endif
@@ -4,20 +4,258 @@
  */
 #define CHAOSGAME_HPP
 
+#include <algorithm>
 #include <cmath>
 #include <vector>
 #include <chrono>
 #include <cstdio>
+#include <cstring>
+#include <random>
 
 #include <SDL2/SDL.h>
 
 #include "egg2d.h"
+#include "bilinear_splat.hpp"
+#include "checkpoint_index.hpp"
+#include "ddmath.hpp"
+#include "density_file.hpp"
+#include "density_histogram.hpp"
+#include "frame_budget.hpp"
+#include "image_sequence.hpp"
+#include "numa_topology.hpp"
+#include "orbit_seeds.hpp"
+#include "point_cull.hpp"
+#include "sprite_raster.hpp"
+#include "stream_buffer.hpp"
+#include "tiled_poster.hpp"
+#include "tone_map.hpp"
+#include "video_stream.hpp"
+#include "view_framing.hpp"
+#include "worker_pool.hpp"
 
 
-void InitCGame();
+enum CGameOrbits {
+    ORBITS_CPU,
+    /** Transform feedback, falls back to ORBITS_CPU without OpenGL 3.0. */
+    ORBITS_GPU
+};
+
+enum CGameRender {
+    /** Additive glow sprites, the classic look. */
+    RENDER_SPRITES,
+    /** Compute shader density histogram, falls back to RENDER_SPRITES without OpenGL 4.3. */
+    RENDER_HISTOGRAM
+};
+
+/**
+ * Startup options of ChaosGame, parsed from the command line by chaos_main.cpp.
+ */
+struct CGameOptions {
+    /** Attractors composited per frame, 1 to 4. */
+    int attractors = 1;
+    CGameOrbits orbits = ORBITS_CPU;
+    CGameRender render = RENDER_SPRITES;
+    /** Trail length in frames: the screen is cleared every frame and the last frames fade out. 0 accumulates. */
+    int trails = 0;
+    /** Orbit and draw time to hold per frame, by moving the points per frame; 0 computes them all. */
+    double targetMS = 12.0;
+    /** Points per frame of every attractor; 0 keeps the default. */
+    int particles = 0;
+    /** Pages backing the CPU point streams. */
+    StreamPages pages = PAGES_SMALL;
+    /** Pins the orbit workers per NUMA node and lets each first touch the streams it computes. */
+    bool numa = false;
+    /** Drops CPU orbit points outside the view before upload, see ToggleCullCGame(). */
+    bool cull = true;
+    /** Where the parallel orbits (GPU orbits, framing samples) start around each attractor's seed. */
+    SeedSequence seeds = SEEDS_SOBOL;
+    /** Frames the attractors from a sampled orbit, see ToggleAutoFrameCGame(). */
+    bool autoFrame = true;
+    /** Starts in deep zoom, see ToggleDeepZoomCGame(). */
+    bool deep = false;
+    /** Keyframe index of the animation: written from the start, or read with `seek`. */
+    const char *checkpoints = nullptr;
+    /** Frames between keyframes; a seek runs fewer frames than this. */
+    int checkpointInterval = 120;
+    /** Starts at this frame, from the keyframes of `checkpoints`; negative starts at 0. */
+    long seek = -1;
+    /** Writes every frame shown into this directory, as frame_N, read back without stalling. */
+    const char *capture = nullptr;
+    /** How captures and screenshots are encoded and written. */
+    ImageSequenceOptions images;
+    /** Queues every frame shown here too, see VideoStream; owned by the caller, and outlives ShutdownCGame(). */
+    VideoStream *stream = nullptr;
+    /** Compare the GPU orbits against the CPU kernel, then quit. */
+    bool verifyOrbits = false;
+};
+
+void InitCGame(const CGameOptions &options = CGameOptions());
 
 bool RenderCGame();
 
 void ShutdownCGame();
 
+/**
+ * Checks one frame of GPU orbits of every attractor statistically against the CPU kernel.
+ * @return true when mean, deviation and density all agree.
+ */
+bool VerifyGPUOrbitsCGame();
+
+/**
+ * Times the CPU orbit kernel over `points` points on every page size and prints
+ * throughput and dTLB misses. Needs no window.
+ */
+void BenchStreamsCGame(int points, int passes);
+
+/**
+ * Times every DensityHistogram strategy merging `points` orbit points from `threads` threads
+ * (0 for all) at a few resolutions. Needs no window.
+ */
+void BenchHistogramCGame(int points, unsigned threads);
+
+/**
+ * Compares nearest, bilinear, and 2x2 / 4x4 supersampled bilinear splats of `points` orbit points
+ * against a render of many more: throughput and relative error. Needs no window.
+ */
+void BenchSplatCGame(int points, unsigned threads);
+
+/**
+ * Tone maps a 3840x2160 histogram of `points` orbit points to RGBA8 and RGBA16 on every ToneMapper
+ * path, on one thread and on `threads` (0 for all), and checks each against the scalar path. Needs no window.
+ */
+void BenchToneMapCGame(int points, unsigned threads);
+
+/**
+ * Times the double and double-double orbit kernels over `points` points, and counts the points
+ * culling keeps at a few zooms. Needs no window.
+ */
+void BenchDeepCGame(int points);
+
+/**
+ * Draws 8 frames of `points` glow sprites of three attractors at 1920x1080 with the CPU
+ * SpriteRasterizer, on one thread and on `threads` (0 for all): time per frame, and whether
+ * the images match. Needs glow_image.pcm, not a window.
+ */
+void BenchSpritesCGame(int points, unsigned threads);
+
+/**
+ * A headless render of frames of the animation to numbered PPM files.
+ */
+struct CGameExport {
+    /** Existing directory the frames are written to, as frame_NNNNNN.ppm (or .png, .qoi), and their densities. */
+    const char *directory = nullptr;
+    /** Frames written, from CGameOptions::seek (or 0) on. */
+    long frames = 0;
+    int width = 3840;
+    int height = 2160;
+    /** Segments rendered at once, 0 for all cores. */
+    unsigned threads = 0;
+    /**
+     * RENDER_HISTOGRAM tone maps the density of every frame; RENDER_SPRITES draws the glow sprites of
+     * the live look with the SpriteRasterizer, each frame on its own as at --trails 1, in 8 bits only.
+     */
+    CGameRender render = RENDER_HISTOGRAM;
+    /**
+     * How the frames are encoded and written, on threads of their own: IMAGE_PNG16 tone maps to 16 bits,
+     * and with a density format the histogram of every frame is written too, see RetoneCGame().
+     */
+    ImageSequenceOptions images;
+};
+
+/**
+ * Renders `job` on the CPU: the frames are split into segments at the keyframes of
+ * CGameOptions::checkpoints, and every worker runs its own segments from their keyframe,
+ * into its own histogram. Missing keyframes are first made by running the animation in order,
+ * and kept in the index. The camera is framed once, at the first segment. Needs no window,
+ * for either render; sprites need glow_image.pcm in the working directory.
+ * @return false when a frame could not be written.
+ */
+bool ExportCGame(const CGameOptions &options, const CGameExport &job);
+
+/**
+ * An offline render of the first attractor far past any framebuffer, for print, see TiledPoster.
+ */
+struct CGamePoster {
+    /** The image written; with a density format its density is written next to it, as .pfm or .egd. */
+    const char *output = nullptr;
+    /** Orbit points streamed, over POSTER_ORBITS orbits so that the image is the same for any thread count. */
+    long long points = 1LL << 30;
+    /** Threads computing and binning the orbits, 0 for all cores. */
+    unsigned threads = 0;
+    PosterOptions options;
+    DensityFormat density = DENSITY_NONE;
+};
+
+/**
+ * Renders `poster` on the CPU in bounded memory: the first attractor at the start of the animation,
+ * framed once. Prints the time of every phase, and the peak RSS against the budget. Needs no window.
+ * @return false when the image could not be written.
+ */
+bool PosterCGame(const CGameOptions &options, const CGamePoster &poster);
+
+/**
+ * Tone maps a saved density, PFM or raw, to `output` in `format` with `settings`, and prints how
+ * long it took: grading again without rendering again. Needs no window.
+ */
+bool RetoneCGame(const char *input, const char *output, const ToneMapSettings &settings, ImageFormat format);
+
+/** Pans the view by (dx, dy) screen units; resident points are only redrawn. */
+void PanCGame(double dx, double dy);
+
+/** Zooms the view by factor about the screen centre. */
+void ZoomCGame(double factor);
+
+void ResetViewCGame();
+
+/**
+ * Toggles auto framing: the attractors are fitted to the screen from the percentile bounds of a
+ * sampled orbit, refitted as `a` drifts. Off, the hand-tuned fit of the default attractor is used.
+ */
+void ToggleAutoFrameCGame();
+
+/**
+ * Jumps the animation to `frame`: restores the keyframe before it from the checkpoint index and
+ * runs the frames in between without drawing them.
+ * @return false without an index, a keyframe at or before `frame`, or with GPU orbits or deep zoom.
+ */
+bool SeekCGame(unsigned frame);
+
+/** Toggles level-of-detail subsampling of the resident points. */
+void ToggleLODCGame();
+
+/**
+ * Toggles deep zoom: CPU orbits in double-double arithmetic, written about the view centre,
+ * for zooms far past what float (and double) resolve. Every pan or zoom then restarts the ring.
+ */
+void ToggleDeepZoomCGame();
+
+/** Toggles dropping the CPU orbit points outside the view before they are uploaded and drawn. */
+void ToggleCullCGame();
+
+/** Writes the frame being shown as frame_N.ppm, into the capture directory or the working one. */
+void ScreenshotCGame();
+
+/**
+ * Writes the density of the frame being shown, before tone mapping, as density_N.pfm (or .egd), into the
+ * capture directory or the working one. Reads back synchronously; only with RENDER_HISTOGRAM.
+ */
+void SaveDensityCGame();
+
+/**
+ * Orbit points computed on the CPU and kept by culling since startup; deep zooms cull over 99%.
+ */
+struct CGameCullStats {
+    long long stepped;
+    long long kept;
+    double culledFraction;
+};
+
+CGameCullStats CullStatsCGame();
+
+/** Toggles trails mode, keeping the trail length. */
+void ToggleTrailsCGame();
+
+/** Lengthens (positive) or shortens (negative) the trails by `frames`. */
+void ResizeTrailsCGame(int frames);
+
 #endif
\ No newline at end of file
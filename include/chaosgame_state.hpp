@@ -0,0 +1,602 @@
+#ifndef CHAOSGAME_STATE_HPP
+/** @file chaosgame_state.hpp
+ * <br>The state and helpers that the translation units of ChaosGame share. chaosgame.cpp is the
+ * render loop; the GL state of the GPU orbits, the density histogram, the trails, deep zoom,
+ * checkpoints and capture lives with each feature, as in chaosgame_histogram.cpp; the drivers
+ * that need no window, the benches, the export, the poster and the retone, are in files of their own.
+ * <br>Not part of the interface of the app, see chaosgame.hpp.
+ */
+#define CHAOSGAME_STATE_HPP
+
+#include "chaosgame.hpp"
+
+namespace /* std:: */ {
+#define clock_now std::chrono::high_resolution_clock::now
+};
+
+class AttractorSet {
+private:
+    double x, y;
+public:
+    AttractorSet(double x, double y): x(x), y(y) {}
+
+    void setX(double value) { x = value; }
+    void setY(double value) { y = value; }
+
+    double getX() const { return x; }
+    double getY() const { return y; }
+
+};
+
+class AlphaAttractor: public AttractorSet {
+private:
+    double m_a, m_b, m_c, m_d;
+    int iters;
+public:
+    AlphaAttractor(double x, double y,
+                   double a, double b, double c, double d, int iters):
+            AttractorSet(x, y), m_a(a), m_b(b), m_c(c), m_d(d), iters(iters) { }
+    double getA() const { return m_a; }
+    double getB() const { return m_b; }
+    double getC() const { return m_c; }
+    double getD() const { return m_d; }
+
+    int getIterations() const { return iters; }
+
+    void setA(double value) { m_a = value; }
+    void setB(double value) { m_b = value; }
+    void setC(double value) { m_c = value; }
+    void setD(double value) { m_d = value; }
+
+    void updateParams(double a, double b, double c, double d) {
+        this->m_a = a;
+        this->m_b = b;
+        this->m_c = c;
+        this->m_d = d;
+    }
+
+};
+
+namespace CGameGLContext {
+// OpenGL ES 2.0 uses shaders
+//   Intel i3 2.10Ghz with OpenGL 4.4 >
+    constexpr int DEFAULT_PARTICLES = 110240
+#ifdef TEST_ONE
+    * 1;
+#else
+    * 3;
+#endif
+
+    // Raw attractor-space points of the last RESIDENT_FRAMES frames stay on the GPU,
+    // so a pan or zoom is only a redraw with a new u_view, not a recompute.
+    // The RESIDENT_FRAMES budget is shared by all composited attractors.
+    constexpr int RESIDENT_FRAMES = 12;
+    constexpr int MAX_ATTRACTORS = 4;
+
+    // Level-of-detail layout: every frame is cut into LOD_SLICES randomly shuffled slices,
+    // and slice j of all resident frames is stored contiguously in region j of the ring.
+    // Any prefix of the ring is then a uniform sample of all resident points.
+    constexpr int LOD_SLICES = 16;
+    static_assert(DEFAULT_PARTICLES % LOD_SLICES == 0, "DEFAULT_PARTICLES must split into LOD slices");
+
+    // Points per frame of every attractor, set at startup (CGameOptions::particles).
+    extern int numParticles;
+    extern int slicePoints;
+
+    // Packed data storage is better than non-contiguous memory layout!
+    // (Staging for the newest frame of every attractor, slice by slice;
+    //  it is streamed into the resident ring.)
+    // The streams are sized at startup, 64-byte aligned, optionally on huge pages.
+    extern StreamBuffer attractorStream;
+    extern StreamBuffer idStream;
+    extern StreamBuffer placementStream;
+    extern GLfloat *attractor2Data;
+    extern GLint *idData;
+    // Staging index of the i-th orbit point of a frame.
+    extern GLint *placement;
+
+    extern GLuint pointBuffer;
+    extern GLuint idBuffer;
+    // Ring slots per attractor, the slot of the newest frame, and how many slots hold points yet.
+    extern int ringFrames;
+    extern int headFrame;
+    extern int residentFrames;
+    // Attractor k owns [k * layerRegion, (k + 1) * layerRegion) of the ring,
+    // LOD region j of it starts at j * sliceRegion.
+    extern int sliceRegion;
+    extern int layerRegion;
+    // Leading LOD slices computed and drawn per frame, moved by the frame budget.
+    extern int activeSlices;
+
+    // Per-attractor look and fit, see the Layers block in chaos.vs.
+    extern GLuint layerBuffer;
+    extern GLfloat layerData[MAX_ATTRACTORS * 4 * 2];
+
+    // Kept for the whole run: the orbit backends switch programs every frame.
+    extern GLuint program;
+    // Sprite size in pixels.
+    constexpr GLfloat POINT_SIZE = 13.0f;
+
+    extern GLint samplerLoc;
+    extern GLint layerPointsLoc;
+    extern GLint viewLoc;
+
+};
+
+namespace Parameters {
+
+    extern AlphaAttractor dream;
+
+    extern double t;
+    extern double tDir;
+
+    constexpr uint screenBackPressure = 10000000;
+    extern bool isScreenDirty;
+
+    extern uint dataSent;
+
+    extern unsigned int totalFrames;
+    extern unsigned int frameCounter;
+    extern unsigned long totalTimeMS;
+}
+
+/**
+ * One composited attractor: its parameters, orbit, and look.
+ */
+struct AttractorLayer {
+    AlphaAttractor attractor;
+    double x, y;
+    // `a` drifts with the animation; b, c and d stay as given.
+    double a;
+    GLfloat hueOffset;
+    GLfloat sensitivity;
+    GLfloat angle;
+};
+
+namespace Layers {
+    extern AttractorLayer layers[CGameGLContext::MAX_ATTRACTORS];
+    extern int count;
+
+    // Each attractor's orbit is computed on its own worker.
+    extern WorkerPool *pool;
+    // numastat when the run started, with --numa.
+    extern std::vector<NumaTopology::NodeCounters> numaStart;
+}
+
+namespace Seeds {
+    // Where parallel orbits start: orbit i of attractor k starts at point i of the sequence keyed by k,
+    // within RADIUS of the attractor's own seed, whichever thread computes it.
+    extern SeedSequence sequence;
+    constexpr double RADIUS = 0.5;
+    // Steps taken before a seeded orbit's points count, to settle onto the attractor.
+    constexpr int BURN_IN = 64;
+    // The benches split their points over this many orbits, not over their threads,
+    // so that their histograms are the same for any thread count.
+    constexpr int ORBITS = 64;
+}
+
+namespace Checkpoints {
+    // Keyframes of the animation state, see CheckpointIndex: t, tDir, dataSent and the framing fit,
+    // then x, y, a, the colour angle and the framed a of every attractor. Taken from the CPU orbits outside deep zoom only;
+    // a frame is only reproduced by the same points per frame and seeds, which the index records,
+    // so the budget is held at every slice while checkpointing.
+    extern CheckpointIndex *index;
+    constexpr int SHARED_STATE = 7;
+    constexpr int LAYER_STATE = 5;
+}
+
+namespace Framing {
+    // Attractor space to the screen before pan/zoom, see ViewFit. Fitted to the percentile bounds
+    // of a short sampled orbit, and again whenever `a` has drifted far enough to change them.
+    extern bool enabled;
+    extern ViewFit fit;
+    // `a` of every attractor when last framed; NaN when the fit is not one of ours, as in an
+    // export's keyframes, so that the next reframe() frames again and takes its fit.
+    extern double framedA[CGameGLContext::MAX_ATTRACTORS];
+
+    constexpr double A_STEP = 0.02;
+    constexpr int SAMPLES = 1 << 14;
+    constexpr int CHUNKS = 16;
+    // Points left out on each side of each axis, and the clip-space margin around the rest.
+    constexpr double TAIL = 0.002;
+    constexpr double MARGIN = 0.05;
+    // A new fit closer than this to the current one is not worth a redraw.
+    constexpr double TOLERANCE = 0.03;
+}
+
+namespace View {
+    // Pan/zoom applied on top of the attractor fit, Framing::fit.
+    extern double zoom;
+    extern double panX;
+    extern double panY;
+
+    constexpr double minZoom = 0.05;
+    constexpr double maxZoom = 4096.0;
+
+    // Column-major u_view, kept for the compute programs too.
+    extern GLfloat matrix[9];
+
+    extern bool isDirty;
+}
+
+namespace LOD {
+    extern bool enabled;
+    // Draw budget per frame, the GPU cost per point is measured with timer queries.
+    extern double budgetMS;
+    extern double nsPerPoint;
+    // Never draw less than one slice region (one slice of every resident frame).
+    constexpr double minFraction = 1.0 / CGameGLContext::LOD_SLICES;
+
+    extern GLuint timeQueries[2];
+    extern GLint queryPoints[2];
+    extern int queryIndex;
+
+    extern std::vector<GLint> firsts;
+    extern std::vector<GLsizei> counts;
+}
+
+namespace Budget {
+    // Moves CGameGLContext::activeSlices to hold the orbit and draw time per frame. The draw is
+    // timed on the GPU, at LOD::nsPerPoint for the points drawn this frame: the CPU only sees its
+    // submission, and a GPU-bound frame stalls in the present, which vsync keeps out of the budget.
+    extern FrameBudget *frame;
+    extern int orbitStage;
+    extern int drawStage;
+    extern int presentStage;
+    extern GLint drawnPoints;
+}
+
+namespace Trails {
+    // Frames drawn per frame, newest brightest; the screen is cleared every frame.
+    extern bool enabled;
+    extern int frames;
+
+    extern GLint framesLoc;
+    extern GLint headLoc;
+}
+
+namespace GPUOrbits {
+    extern bool enabled;
+
+    // CGameGLContext::slicePoints orbits per attractor, each advanced LOD_SLICES steps per frame:
+    // pass j writes LOD slice j of the newest frame, so no CPU write or upload is needed.
+    constexpr int STEPS = CGameGLContext::LOD_SLICES;
+    // Passes run at startup so the orbits settle onto the attractor first.
+    constexpr int WARMUP_STEPS = 32;
+
+    extern GLuint program;
+    extern GLuint vertexArray;
+    extern GLint paramsLoc;
+    extern GLint stateLoc;
+    // Ping-pong orbit states, vec2 per orbit.
+    extern GLuint stateBuffers[CGameGLContext::MAX_ATTRACTORS][2];
+    extern int current[CGameGLContext::MAX_ATTRACTORS];
+}
+
+namespace Histogram {
+    // Density rendering: points are splatted with atomic adds into an R32UI image
+    // by splat.cs, then tone mapped to the screen by density.fs; no blending overdraw.
+    extern bool enabled;
+
+    extern GLuint splatProgram;
+    extern GLuint resolveProgram;
+    extern GLuint vertexArray;
+    extern GLuint density;
+    extern GLuint peakBuffer;
+    // Zeros, to clear the density image without a CPU transfer.
+    extern GLuint zeroBuffer;
+    extern GLint imageWidth, imageHeight;
+    extern GLint originX, originY;
+
+    extern GLint firstLoc, countLoc, layerPointsLoc, viewLoc;
+}
+
+namespace Cull {
+    // CPU orbits: points outside the view are dropped after the orbit step, and the survivors
+    // of every slice packed to its front, so only they are uploaded and drawn.
+    // The ring then holds what was visible when each frame was made: after a pan or a zoom out,
+    // the redraw has holes until the ring refills, RESIDENT_FRAMES frames later.
+    extern bool enabled;
+    extern CullTransform transform;
+    // Points of every ring slot, [layer][LOD slice][ring frame]: a slot's points start its range.
+    extern std::vector<GLint> counts;
+    // Slots whose ids were uploaded packed, so that they need the static ids back once not culled.
+    extern std::vector<char> packedIds;
+    // Survivors of the newest frame per [layer][LOD slice], and its packed ids.
+    extern GLint newest[CGameGLContext::MAX_ATTRACTORS * CGameGLContext::LOD_SLICES];
+    extern StreamBuffer idStream;
+    extern GLint *ids;
+    // Points stepped and kept, over the last second and the whole run.
+    extern long long stepped, kept;
+    extern long long totalStepped, totalKept;
+}
+
+namespace Deep {
+    // Deep zoom, CPU orbits only: orbits iterate in double-double and every point is written in
+    // clip space about the view centre, so neither the float attributes nor the float u_view
+    // bound the zoom. The ring is then only valid for the view it was made with, and refills
+    // after every pan or zoom; `a` holds still.
+    extern bool enabled;
+    constexpr double maxZoom = 1.0e28;
+    // Attractor-space point at the screen centre.
+    extern DD<double> centerX, centerY;
+    extern DD<double> x[CGameGLContext::MAX_ATTRACTORS];
+    extern DD<double> y[CGameGLContext::MAX_ATTRACTORS];
+}
+
+namespace Capture {
+    // Frames read back through Egg2D's ring of pixel-pack buffers, see eggCaptureStart(), and written
+    // by encoder threads as DIR/frame_N: every frame shown with `capture`, or one per ScreenshotCGame().
+    // With a `stream`, every frame shown is queued there too.
+    extern const char *directory;
+    extern bool started;
+    extern bool everyFrame;
+    extern bool files;
+    extern long screenshot;
+    extern VideoStream *stream;
+    extern ImageSequenceOptions images;
+    extern ImageSequenceWriter *writer;
+}
+
+extern bool paused;
+
+/**
+ * One step of the attractor, x' = sin(b y) + c sin(b x) and y' = sin(a x) + d sin(a y): every CPU
+ * orbit takes this one, so that they all trace the same points.
+ */
+inline void cliffordStep(double &x, double &y, double a, double b, double c, double d) {
+    const double u = std::sin(y * b) + c * std::sin(x * b);
+    const double v = std::sin(x * a) + d * std::sin(y * a);
+    x = u;
+    y = v;
+}
+
+/**  Clifford Pickover's Attractor
+ *  ------------------------------- \n
+ *  Using REL's GlowImage <u>https://rel.phatcode.net</u>
+ */
+void orbit(double &x, double &y, double a, double b, double c, double d,
+           const GLint *placement, int iterations, GLfloat *attractor2Data);
+
+/**
+ * Computes the active slices of a layer's newest frame into its staging stream.
+ */
+void step(AttractorLayer &layer, GLfloat *attractor2Data);
+
+/**
+ * The fit the constants of Parameters were tuned for: the default attractor on a 900x750 window.
+ */
+ViewFit handTunedFit();
+
+/**
+ * Samples the orbits of `count` attractors on the pool, each chunk from its own seed past a burn-in
+ * (see Seeds), and fits the percentile bounds of all of them to a screen of `aspect`: the layers share
+ * one fit, so that they stay where they are relative to each other.
+ */
+ViewFit frameAttractors(const AttractorLayer *layers, int count, double aspect, WorkerPool &pool);
+
+/**
+ * Frames the attractors again once `a` has drifted by Framing::A_STEP since the last framing;
+ * a changed fit redraws the resident points under it. A deep zoom keeps its frame.
+ * @param force frames now, whatever the drift.
+ */
+void reframe(bool force);
+
+/**
+ * Drifts `a` and the colour angle of `count` attractors, and t with them; shared by both orbit backends
+ * and the exports.
+ * @param freezeA keeps `a` where it is.
+ */
+void animate(AttractorLayer *layers, int count, double &t, double &tDir, uint dataSent, bool freezeA);
+
+/**
+ * Drifts the live attractors.
+ */
+void animate();
+
+/**
+ * Moves the head of the resident ring to the slot of the next frame.
+ */
+void advanceRing();
+
+/**
+ * Index of ring slot `frame` of LOD slice j of attractor k in Cull::counts.
+ */
+int slotIndex(int k, int j, int frame);
+
+/**
+ * Empties the resident ring, whose points no longer match what is drawn.
+ */
+void resetRing();
+
+/**
+ * Uploads every attractor's angle, sensitivity, hue offset and fit into the Layers block.
+ */
+void updateLayerUniforms();
+
+/**
+ * Pushes the current pan/zoom to chaos.vs as a column-major 3x3 matrix;
+ * deep zoom applies it on the CPU, so chaos.vs gets the identity and the ring is refilled.
+ */
+void updateViewMatrix();
+
+/**
+ * The attractor-space point at the screen centre for the current pan.
+ */
+void centerOfPan(double &x, double &y);
+
+/**
+ * Shuffles each slice of a frame once; the same placement is reused every frame,
+ * so the id buffer stays static.
+ */
+void initPlacement(GLint *placement, GLint *idData, int points);
+
+/**
+ * Points of the newest frame of one attractor, as set by the frame budget.
+ */
+GLint activePoints();
+
+/**
+ * Appends the points of ring slot `frame` of slice j of attractor k, at most `limit`, to the draw
+ * ranges; joined to the previous range when they continue it, as full slots do.
+ * @return points added.
+ */
+GLint addSlot(int k, int j, int frame, GLint limit);
+
+/**
+ * Submits the ranges collected in LOD::firsts and LOD::counts, as sprites or as density.
+ */
+void submitDraws();
+
+/** The uniforms chaos.vs colours `layer`'s points by. */
+inline SpriteLook spriteLook(const AttractorLayer &layer) {
+    return {layer.angle, layer.sensitivity, layer.hueOffset};
+}
+
+// chaosgame_deep.cpp
+
+/**
+ * Attractor space to clip space for deepOrbit(): clip = (p - centre) * scale, and the fit scale
+ * that keeps a point's next-point offset, which chaos.vs colours by, as it was.
+ */
+struct DeepFrame {
+    DD<double> centerX, centerY;
+    double scaleX, scaleY;
+    double fitX, fitY;
+};
+
+/**
+ * orbit() in double-double: the four sines of a step are computed as one Double4.
+ */
+void deepOrbit(DD<double> &x, DD<double> &y, double a, double b, double c, double d,
+               const GLint *placement, int iterations, GLfloat *attractor2Data, const DeepFrame &frame);
+
+/**
+ * The deep zoom frame of the current view.
+ */
+DeepFrame deepFrame();
+
+/**
+ * step() of layer k in deep zoom.
+ */
+void deepStep(int k, GLfloat *attractor2Data, const DeepFrame &frame);
+
+// chaosgame_gpu_orbits.cpp
+
+/**
+ * GPU counterpart of step(): the newest frame is written into the ring by transform feedback.
+ */
+void stepGPU();
+
+/**
+ * Builds the transform feedback program and seeds slicePoints orbits per attractor.
+ * @returns false when transform feedback is unavailable; the CPU orbits are used then.
+ */
+bool initGPUOrbits();
+
+/**
+ * Deletes the program, vertex array and orbit states of the GPU orbits, when they ran.
+ */
+void releaseGPUOrbits();
+
+// chaosgame_histogram.cpp
+
+/**
+ * Zeroes the density image and its peak.
+ */
+void clearHistogram();
+
+/**
+ * Tone maps the density image over the whole viewport.
+ */
+void resolveHistogram();
+
+/**
+ * Builds the splat and resolve programs, and the density image at viewport size.
+ * @returns false without compute shaders (OpenGL 4.3); sprites are drawn then.
+ */
+bool initHistogram();
+
+/**
+ * Dispatches splat.cs over every collected range of the ring.
+ */
+void splatRanges();
+
+/**
+ * Deletes the programs, image and buffers of density rendering, when it ran.
+ */
+void releaseHistogram();
+
+// chaosgame_trails.cpp
+
+/**
+ * Draws the last Trails::frames slots of every attractor's ring, oldest to newest:
+ * full slots of a slice join into one or two ranges, depending on where the head wrapped.
+ */
+void drawTrail(GLint points);
+
+/**
+ * Makes chaos.vs fade by age over the trail, or not at all when accumulating.
+ */
+void updateTrailUniforms();
+
+// chaosgame_checkpoints.cpp
+
+/**
+ * What a keyframe holds: the live animation keeps it in Parameters, Layers and Framing,
+ * an export runs copies of its own.
+ */
+struct AnimationState {
+    double t;
+    double tDir;
+    uint dataSent;
+    ViewFit fit;
+    std::vector<AttractorLayer> layers;
+    std::vector<double> framedA;
+};
+
+/**
+ * Whether the animation state is all on the CPU and in doubles, so that it can be checkpointed.
+ */
+bool checkpointable();
+
+int checkpointStateSize();
+
+AnimationState liveState();
+
+void packState(const AnimationState &from, double *state);
+
+/**
+ * Overwrites what a keyframe holds; the rest of `to`, the attractors' b, c, d and looks, stays.
+ */
+void unpackState(const double *state, AnimationState &to);
+
+/**
+ * Counts the points a frame sends against the screen's back pressure, as RenderCGame() does.
+ */
+void countSent(uint &sent, long points);
+
+/**
+ * Keeps the state at the start of this frame when a keyframe is due.
+ */
+void recordCheckpoint();
+
+/**
+ * Logs how many keyframes were kept and closes the index, when there is one.
+ */
+void closeCheckpoints();
+
+// chaosgame_capture.cpp
+
+/**
+ * Starts reading frames back, once.
+ * @returns whether frames are read back.
+ */
+bool startCapture();
+
+/**
+ * Writes the frames still in flight and logs what was captured, when a capture started.
+ */
+void stopCapture();
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef CHECKPOINT_INDEX_HPP
+/** @file checkpoint_index.hpp
+ * <br>Keyframes of an animation's state, one every `interval` frames, kept in a small index file,
+ * so that any frame can be reached by restoring the keyframe before it and running fewer than
+ * `interval` frames, instead of every frame from the start.
+ * <br>The file is a header and then the keyframes as recorded, frame number and state doubles
+ * each, in host byte order: it is appended to as the animation runs, so a killed run keeps the
+ * keyframes it got to.
+ */
+#define CHECKPOINT_INDEX_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+
+class CheckpointIndex {
+public:
+    CheckpointIndex() = default;
+
+    /**
+     * @param app names whose state this is, up to 15 characters; load() refuses other apps' files.
+     * @param stateSize doubles per keyframe, fixed by the app (and its settings, say the attractor count).
+     * @param interval frames between keyframes.
+     * @param particles points stepped per frame, which the state after a frame depends on.
+     * @param seeds how the app seeds its orbits (its SeedSequence), 0 when it has no choice.
+     */
+    CheckpointIndex(const char *app, int stateSize, int interval, int particles, int seeds = 0);
+    ~CheckpointIndex();
+
+    CheckpointIndex(const CheckpointIndex &) = delete;
+    CheckpointIndex &operator=(const CheckpointIndex &) = delete;
+
+    int stateSize() const { return size; }
+
+    int interval() const { return every; }
+
+    /** Whether `frame` is due a keyframe that isn't there yet. */
+    bool due(uint64_t frame) const;
+
+    /** Keeps the state at the start of `frame`, a multiple of interval(), and appends it to the open file. */
+    void record(uint64_t frame, const double *state);
+
+    /**
+     * The last keyframe at or before `frame`, found by index rather than search.
+     * @return false when there is none.
+     */
+    bool nearest(uint64_t frame, uint64_t &keyFrame, std::vector<double> &state) const;
+
+    /** Creates `path` with the keyframes so far; those recorded later are appended as they come. */
+    bool open(const char *path);
+
+    /**
+     * Reads the keyframes of `path`; false when it is missing, damaged (say a keyframe past those the file
+     * holds), or of another app, state size, particle count or seeding.
+     */
+    bool load(const char *path);
+
+    /** Keyframes held. */
+    size_t count() const;
+
+private:
+    void keep(uint64_t frame, const double *state);
+
+    bool writeKeyframe(uint64_t frame, const double *state);
+
+    char app[16] = {};
+    int size = 0;
+    int every = 1;
+    int particles = 0;
+    int seeds = 0;
+    // Keyframe n is frame n * every, at states[n * size]; a run started by a seek may leave gaps.
+    std::vector<double> states;
+    std::vector<bool> present;
+    FILE *file = nullptr;
+};
+
+#endif
@@ -0,0 +1,259 @@
+#ifndef DDMATH_HPP
+/** @file ddmath.hpp
+ * <br>Double-double arithmetic: a value is the unevaluated sum hi + lo of two doubles,
+ * about 106 bits of mantissa. Written once over a lane type, so that the same code runs on
+ * one double or on four at a time (SSE2 pairs where available).
+ * <br>Products split their factors (Dekker) rather than use an FMA, so the results are
+ * the same on every CPU. Needs strict IEEE double arithmetic: no -ffast-math.
+ */
+#define DDMATH_HPP
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+/** Four doubles operated on lane-wise. */
+struct Double4 {
+#ifdef __SSE2__
+    __m128d v[2];
+
+    Double4() = default;
+    Double4(double x) { v[0] = v[1] = _mm_set1_pd(x); }
+    Double4(double a, double b, double c, double d) {
+        v[0] = _mm_setr_pd(a, b);
+        v[1] = _mm_setr_pd(c, d);
+    }
+    void store(double out[4]) const {
+        _mm_storeu_pd(out, v[0]);
+        _mm_storeu_pd(out + 2, v[1]);
+    }
+#else
+    double v[4];
+
+    Double4() = default;
+    Double4(double x) { v[0] = v[1] = v[2] = v[3] = x; }
+    Double4(double a, double b, double c, double d) {
+        v[0] = a, v[1] = b, v[2] = c, v[3] = d;
+    }
+    void store(double out[4]) const {
+        out[0] = v[0], out[1] = v[1], out[2] = v[2], out[3] = v[3];
+    }
+#endif
+};
+
+#ifdef __SSE2__
+#define DOUBLE4_OP(op, intrinsic) \
+    inline Double4 operator op(const Double4 &a, const Double4 &b) { \
+        Double4 r; \
+        r.v[0] = intrinsic(a.v[0], b.v[0]); \
+        r.v[1] = intrinsic(a.v[1], b.v[1]); \
+        return r; \
+    }
+DOUBLE4_OP(+, _mm_add_pd)
+DOUBLE4_OP(-, _mm_sub_pd)
+DOUBLE4_OP(*, _mm_mul_pd)
+#else
+#define DOUBLE4_OP(op, intrinsic) \
+    inline Double4 operator op(const Double4 &a, const Double4 &b) { \
+        Double4 r; \
+        for (int i = 0; i < 4; i++) { \
+            r.v[i] = a.v[i] op b.v[i]; \
+        } \
+        return r; \
+    }
+DOUBLE4_OP(+, _)
+DOUBLE4_OP(-, _)
+DOUBLE4_OP(*, _)
+#endif
+#undef DOUBLE4_OP
+
+/**
+ * Rounds to the nearest integer, ties to even, for |x| < 2^51: adding and taking away 1.5 * 2^52
+ * leaves no fraction bits. Plain arithmetic, so every lane type rounds alike.
+ */
+template<typename T>
+inline T roundNearest(const T &x) {
+    const T magic = T(6755399441055744.0);
+    return (x + magic) - magic;
+}
+
+template<typename T>
+struct DD {
+    T hi, lo;
+
+    DD() = default;
+    DD(const T &hi, const T &lo = T(0.0)) : hi(hi), lo(lo) {}
+};
+
+namespace ddmath {
+    /** a + b exactly, when |a| >= |b|. */
+    template<typename T>
+    inline DD<T> quickTwoSum(const T &a, const T &b) {
+        const T s = a + b;
+        return DD<T>(s, b - (s - a));
+    }
+
+    /** a + b exactly. */
+    template<typename T>
+    inline DD<T> twoSum(const T &a, const T &b) {
+        const T s = a + b;
+        const T bb = s - a;
+        return DD<T>(s, (a - (s - bb)) + (b - bb));
+    }
+
+    /** a = hi + lo with 26 bits in each half, so that the halves' products are exact. */
+    template<typename T>
+    inline void split(const T &a, T &hi, T &lo) {
+        const T t = T(134217729.0) * a;
+        hi = t - (t - a);
+        lo = a - hi;
+    }
+
+    /** a * b exactly. */
+    template<typename T>
+    inline DD<T> twoProd(const T &a, const T &b) {
+        T ah, al, bh, bl;
+        split(a, ah, al);
+        split(b, bh, bl);
+        const T p = a * b;
+        const T e = ((ah * bh - p) + ah * bl + al * bh) + al * bl;
+        return DD<T>(p, e);
+    }
+
+    /** The constants the sine needs, evaluated once. */
+    struct Constants {
+        /** 1 / n!, n < TERMS. */
+        static constexpr int TERMS = 30;
+        DD<double> inverseFactorial[TERMS];
+
+        static const Constants &get();
+    };
+}
+
+template<typename T>
+inline DD<T> operator+(const DD<T> &a, const DD<T> &b) {
+    using namespace ddmath;
+    DD<T> s = twoSum(a.hi, b.hi);
+    const DD<T> t = twoSum(a.lo, b.lo);
+    s = quickTwoSum(s.hi, s.lo + t.hi);
+    return quickTwoSum(s.hi, s.lo + t.lo);
+}
+
+template<typename T>
+inline DD<T> operator-(const DD<T> &a) {
+    return DD<T>(T(0.0) - a.hi, T(0.0) - a.lo);
+}
+
+template<typename T>
+inline DD<T> operator-(const DD<T> &a, const DD<T> &b) {
+    return a + -b;
+}
+
+template<typename T>
+inline DD<T> operator*(const DD<T> &a, const DD<T> &b) {
+    using namespace ddmath;
+    const DD<T> p = twoProd(a.hi, b.hi);
+    return quickTwoSum(p.hi, p.lo + (a.hi * b.lo + a.lo * b.hi));
+}
+
+template<typename T>
+inline DD<T> operator*(const DD<T> &a, const T &b) {
+    using namespace ddmath;
+    const DD<T> p = twoProd(a.hi, b);
+    return quickTwoSum(p.hi, p.lo + a.lo * b);
+}
+
+/** a / b, one Newton step on the double quotient. */
+template<typename T>
+inline DD<T> operator/(const DD<T> &a, const T &b) {
+    using namespace ddmath;
+    const T q = a.hi / b;
+    const DD<T> r = a - twoProd(q, b);
+    return quickTwoSum(q, r.hi / b);
+}
+
+/** Broadcasts a double-double to every lane. */
+inline DD<Double4> lanes(const DD<double> &x) {
+    return DD<Double4>(Double4(x.hi), Double4(x.lo));
+}
+
+inline DD<double> lane(const DD<Double4> &x, int i) {
+    double hi[4], lo[4];
+    x.hi.store(hi);
+    x.lo.store(lo);
+    return DD<double>(hi[i], lo[i]);
+}
+
+namespace ddmath {
+    /** cos and sin of the quarter turns q, per lane: exactly 0, 1 or -1. */
+    inline void quarterTurns(const double &q, double &c, double &s) {
+        static const double cosines[4] = {1.0, 0.0, -1.0, 0.0};
+        const int turn = (int)q & 3;
+        c = cosines[turn];
+        s = cosines[(turn + 3) & 3];
+    }
+
+    inline void quarterTurns(const Double4 &q, Double4 &c, Double4 &s) {
+        double quarters[4], cs[4], ss[4];
+        q.store(quarters);
+        for (int i = 0; i < 4; i++) {
+            quarterTurns(quarters[i], cs[i], ss[i]);
+        }
+        c = Double4(cs[0], cs[1], cs[2], cs[3]);
+        s = Double4(ss[0], ss[1], ss[2], ss[3]);
+    }
+
+    template<typename T>
+    inline DD<T> constant(const DD<double> &x);
+
+    template<>
+    inline DD<double> constant(const DD<double> &x) { return x; }
+
+    template<>
+    inline DD<Double4> constant(const DD<double> &x) { return lanes(x); }
+}
+
+/**
+ * sin(x) to about 1e-31 absolute, for the small arguments of an orbit (|x| < 2^20; the reduction
+ * by pi/2 loses a bit per doubling beyond that). Reduced to [-pi/4, pi/4], then Taylor series of
+ * sin and cos in Horner form, recombined by quadrant.
+ */
+template<typename T>
+inline DD<T> sin(const DD<T> &x) {
+    using namespace ddmath;
+    static const DD<double> HALF_PI(1.5707963267948966, 6.123233995736766e-17);
+    const Constants &constants = Constants::get();
+
+    const T quarter = roundNearest(x.hi * T(0.6366197723675814));
+    const DD<T> r = x - constant<T>(HALF_PI) * quarter;
+    const DD<T> t = -(r * r);
+
+    // Terms up to r^29 / 29!, below 1e-33 over the reduced range.
+    DD<T> sine = constant<T>(constants.inverseFactorial[Constants::TERMS - 1]);
+    DD<T> cosine = constant<T>(constants.inverseFactorial[Constants::TERMS - 2]);
+    for (int n = Constants::TERMS - 3; n >= 0; n -= 2) {
+        sine = constant<T>(constants.inverseFactorial[n]) + t * sine;
+        cosine = constant<T>(constants.inverseFactorial[n - 1]) + t * cosine;
+    }
+    sine = r * sine;
+
+    // sin(r + q pi/2) = sin r cos(q pi/2) + cos r sin(q pi/2), one of the two terms is zero.
+    T c, s;
+    quarterTurns(quarter, c, s);
+    return DD<T>(sine.hi * c + cosine.hi * s, sine.lo * c + cosine.lo * s);
+}
+
+inline const ddmath::Constants &ddmath::Constants::get() {
+    static const Constants constants = [] {
+        Constants c;
+        c.inverseFactorial[0] = DD<double>(1.0);
+        for (int n = 1; n < TERMS; n++) {
+            c.inverseFactorial[n] = c.inverseFactorial[n - 1] / (double)n;
+        }
+        return c;
+    }();
+    return constants;
+}
+
+#endif
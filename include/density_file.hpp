@@ -0,0 +1,84 @@
+#ifndef DENSITY_FILE_HPP
+/** @file density_file.hpp
+ * <br>Density histograms saved as they are, before any tone mapping, so that grading can be
+ * redone offline from the file in milliseconds instead of from billions of orbit points.
+ * <br>PFM is greyscale float32, which any HDR tool opens, exact up to 2^24 hits per pixel;
+ * the raw format is a small header and the uint32 counts, exact for any count.
+ */
+#define DENSITY_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+
+enum DensityFormat {
+    DENSITY_NONE,
+    /** Portable float map, greyscale ("Pf"), little-endian. */
+    DENSITY_PFM,
+    /** "EGGD", version, width, height and peak as little-endian uint32, then the counts, rows from the top. */
+    DENSITY_RAW
+};
+
+/** "none", "pfm" or "raw". */
+const char *densityFormatName(DensityFormat format);
+
+/** "pfm" or "egd". */
+const char *densityExtension(DensityFormat format);
+
+/** Parses a densityFormatName(). @returns false for anything else. */
+bool parseDensityFormat(const char *name, DensityFormat &format);
+
+/** A density read back, rows from the top. */
+struct DensityImage {
+    int width = 0;
+    int height = 0;
+    uint32_t peak = 0;
+    std::vector<uint32_t> counts;
+};
+
+/**
+ * Encodes `counts` as a whole `format` file into `out`.
+ * @param bottomUp the rows of `counts` are bottom first, as read from a GL texture.
+ */
+void encodeDensity(DensityFormat format, const uint32_t *counts, int width, int height, uint32_t peak,
+                   bool bottomUp, std::vector<uint8_t> &out);
+
+bool writeDensity(const char *path, DensityFormat format, const uint32_t *counts, int width, int height,
+                  uint32_t peak, bool bottomUp);
+
+/**
+ * A density written in strips of rows from the top, for densities too large to hold whole;
+ * PFM rows are put in place from the bottom, so the file must be seekable.
+ */
+class DensityStripWriter {
+public:
+    DensityStripWriter(const char *path, DensityFormat format, int width, int height);
+    ~DensityStripWriter();
+
+    DensityStripWriter(const DensityStripWriter &) = delete;
+    DensityStripWriter &operator=(const DensityStripWriter &) = delete;
+
+    bool ok() const { return file != nullptr && !failed; }
+
+    /** Writes the next `rows` rows of counts. */
+    bool write(const uint32_t *counts, int rows);
+
+    /** Records `peak` and closes the file. @returns false when any of it was not written, or rows are missing. */
+    bool finish(uint32_t peak);
+
+private:
+    FILE *file;
+    DensityFormat format;
+    int width, height;
+    size_t headerBytes = 0;
+    int rowsWritten = 0;
+    bool failed = false;
+    std::vector<uint8_t> row;
+};
+
+/** Reads a file of either format, told apart by its first bytes. @returns false when it is neither, or cut short. */
+bool readDensity(const char *path, DensityImage &image);
+
+#endif
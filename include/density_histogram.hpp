@@ -0,0 +1,138 @@
+#ifndef DENSITY_HISTOGRAM_HPP
+/** @file density_histogram.hpp
+ * <br>A width x height hit-count buffer accumulated from many threads.
+ */
+#define DENSITY_HISTOGRAM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "stream_buffer.hpp"
+#include "worker_pool.hpp"
+
+
+enum HistogramStrategy {
+    /** pickStrategy() from the thread count and resolution. */
+    HISTOGRAM_AUTO,
+    /** A private histogram per thread, summed by a parallel reduction over rows. */
+    HISTOGRAM_PRIVATE,
+    /**
+     * Threads queue pixels per tile, each tile's owner then applies its queues alone; a queue that
+     * fills while splatting is applied under its tile's lock, so they take memory by tile, not by point.
+     */
+    HISTOGRAM_TILED,
+    /** Relaxed atomic increments on the shared histogram. */
+    HISTOGRAM_ATOMIC
+};
+
+/** "auto", "private", "tiled" or "atomic". */
+const char *histogramStrategyName(HistogramStrategy strategy);
+
+bool parseHistogramStrategy(const char *name, HistogramStrategy &strategy);
+
+/**
+ * The strategy expected to be fastest: private histograms while their reduction is cheap,
+ * tiles once threads x resolution make it expensive. Atomics were never ahead in
+ * --bench-histogram; they stay for comparison, and for producers that cannot take the queues'
+ * QUEUE_ENTRIES per thread and tile.
+ */
+HistogramStrategy pickStrategy(unsigned threads, int width, int height);
+
+/**
+ * One thread's end of a DensityHistogram::accumulate(); add() is the inner loop of a render.
+ */
+class HistogramSplatter {
+public:
+    /** Adds `weight` hits to `pixel`; weighted splats (bilinear_splat.hpp) add SPLAT_ONE per point. */
+    void add(uint32_t pixel, uint32_t weight = 1) {
+        switch (strategy) {
+            case HISTOGRAM_PRIVATE:
+                bins[pixel] += weight;
+                break;
+            case HISTOGRAM_ATOMIC:
+                __atomic_fetch_add(bins + pixel, weight, __ATOMIC_RELAXED);
+                break;
+            default: {
+                std::vector<uint64_t> &queue = (*queues)[pixel >> tileShift];
+                queue.push_back((uint64_t)weight << 32 | pixel);
+                if (queue.size() == QUEUE_ENTRIES) {
+                    flush(pixel >> tileShift);
+                }
+                break;
+            }
+        }
+    }
+
+    /** Entries a HISTOGRAM_TILED queue holds before it is applied. */
+    static constexpr size_t QUEUE_ENTRIES = 4096;
+
+private:
+    friend class DensityHistogram;
+
+    /** Applies the queue of `tile` to the bins under the tile's lock, and empties it. */
+    void flush(uint32_t tile);
+
+    HistogramStrategy strategy;
+    uint32_t *bins;
+    std::vector<std::vector<uint64_t>> *queues;
+    std::mutex *tileLocks;
+    unsigned tileShift;
+};
+
+class DensityHistogram {
+public:
+    /**
+     * @param pool the threads that accumulate; each first touches the memory it works on.
+     * @param strategy HISTOGRAM_AUTO picks one with pickStrategy().
+     */
+    DensityHistogram(int width, int height, WorkerPool &pool,
+                     HistogramStrategy strategy = HISTOGRAM_AUTO, StreamPages pages = PAGES_SMALL);
+
+    DensityHistogram(const DensityHistogram &) = delete;
+    DensityHistogram &operator=(const DensityHistogram &) = delete;
+
+    /**
+     * Runs produce(worker, workers, splatter) on every worker of the pool, then merges
+     * what they added into counts(). Producers split the work by `worker`.
+     */
+    void accumulate(const std::function<void(int worker, int workers, HistogramSplatter &splatter)> &produce);
+
+    /** Zeroes the counts. */
+    void clear();
+
+    /** The merged counts, row by row. */
+    const uint32_t *counts() const { return shared.as<uint32_t>(); }
+
+    uint32_t peak() const;
+
+    int width() const { return columns; }
+    int height() const { return rows; }
+    HistogramStrategy strategy() const { return used; }
+
+private:
+    /**
+     * Runs task over ranges of pixels covering the image, each always on the same worker:
+     * tiles round robin with HISTOGRAM_TILED, one band of rows per worker otherwise.
+     */
+    void forOwned(const std::function<void(size_t first, size_t last)> &task);
+
+    const int columns;
+    const int rows;
+    const size_t pixels;
+    WorkerPool &pool;
+    const HistogramStrategy used;
+
+    StreamBuffer shared;
+    // HISTOGRAM_PRIVATE: one histogram per worker but the first, which adds to `shared` directly.
+    std::vector<StreamBuffer> privates;
+    // HISTOGRAM_TILED: queues[worker][tile] of weight << 32 | pixel, tiles are 2^tileShift pixels,
+    // and the locks a full queue is applied under.
+    std::vector<std::vector<std::vector<uint64_t>>> queues;
+    std::vector<std::mutex> tileLocks;
+    unsigned tileShift = 0;
+};
+
+#endif
@@ -67,6 +67,7 @@ struct TextResource {
 
 #define SHADER_VERT 0
 #define SHADER_FRAG 1
+#define SHADER_COMP 2
 #define SHADER_NO_ERROR 0
 #define SHADER_READ_ERROR (-1)
 #define SHADER_COMPILE_ERROR (-2)
@@ -86,6 +87,7 @@ EGG_API size_t eggFileRead(eggFile *pFile, long bytesToRead, void *buffer);
 
 struct EggShader eggLoadVertShaderFile(const char *relativePath);
 struct EggShader eggLoadFragShaderFile(const char *relativePath);
+struct EggShader eggLoadCompShaderFile(const char *relativePath);
 void eggFreeShader(EggShader obj);
 
 extern int g_targetWidth, g_targetHeight;
@@ -98,6 +100,8 @@ static int g_scaledWidth, g_scaledHeight;
 static int g_cropH, g_cropV;
 
 int CreateWindow(const char *title);
+int CreateHeadlessWindow(const char *title);
+int eggIsHeadless();
 
 
 void setBackgroundColor(float red, float green, float blue, float alpha);
@@ -107,6 +111,11 @@ GLuint eggCompileShader(GLenum type, const char *shaderSrc);
 
 GLuint eggShaderCreateProgram(GLuint vertexShaderObj, GLuint fragmentShaderObj);
 
+GLuint eggShaderCreateFeedbackProgram(GLuint vertexShaderObj, const char *const *varyings,
+                                      GLsizei count, GLenum bufferMode);
+GLuint eggShaderCreateComputeProgram(GLuint computeShaderObj);
+int eggHasComputeShaders();
+
 GLint eggGetUniforms(GLuint program);
 
 EGG_API void eggLogMessage(const char *formatStr, ...);
@@ -117,6 +126,17 @@ void eggUnload();
 
 GLuint GetGlowImage();
 
+/**
+ * A captured frame: `width` x `height` RGBA8 pixels, bottom row first, valid only during the call.
+ */
+typedef void (*EggCaptureCallback)(const unsigned char *rgba, int width, int height, long frame, void *user);
+
+int eggCaptureStart(int buffers, EggCaptureCallback callback, void *user);
+void eggCaptureFrame(long frame);
+void eggCaptureDrain();
+long eggCaptureDropped();
+void eggCaptureStop();
+
 void UpdateWindow();
 void EGG_Quit();
 
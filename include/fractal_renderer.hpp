@@ -11,9 +11,30 @@
 #include <SDL2/SDL.h>
 
 #include "egg2d.h"
+#include "stream_buffer.hpp"
 
 
-void RendererInit();
+/**
+ * Keyframes of the animation, for seeking; see checkpoint_index.hpp.
+ */
+struct CheckpointOptions {
+    /** Index file: written from the start, or read with `seek`; nullptr keeps none. */
+    const char *path = nullptr;
+    /** Frames between keyframes. */
+    int interval = 120;
+    /** Starts at this frame; negative starts at 0. */
+    long seek = -1;
+};
+
+/**
+ * @param targetMS compute and draw time to hold per frame, by moving the particle count;
+ *        0 keeps the hand-tuned count.
+ * @param pages pages backing the particle streams.
+ * @param autoFrame fits the bubbles to the screen from the bounds of a sampled frame, refitted as t drifts;
+ *        false keeps the hand-tuned 1440x900 fit.
+ */
+void RendererInit(double targetMS = 12.0, StreamPages pages = PAGES_SMALL, bool autoFrame = true,
+                  const CheckpointOptions &checkpoints = CheckpointOptions());
 
 void Render();
 
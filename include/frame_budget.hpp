@@ -0,0 +1,82 @@
+#ifndef FRAME_BUDGET_HPP
+/** @file frame_budget.hpp
+ * <br>Grows or shrinks the per-frame work to hold a target frame time.
+ */
+#define FRAME_BUDGET_HPP
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+
+class FrameBudget {
+public:
+    /**
+     * @param floor the least work ever done per frame (points, slices, ...)
+     * @param ceiling the most work, usually what was allocated
+     * @param targetMS the work time to hold per frame; 0 pins the budget to `start`
+     * @param start the budget of the first frame
+     */
+    FrameBudget(long floor, long ceiling, double targetMS, long start);
+
+    /**
+     * Registers a timed stage of the frame, in frame order.
+     * @param counted false for waits that do not scale with the work, like a vsync'd swap;
+     *        they are reported but not controlled.
+     * @returns its index.
+     */
+    int addStage(const char *name, bool counted = true);
+
+    /** Starts timing a frame; its first stage starts now. */
+    void beginFrame();
+
+    /** Ends `stage`, which may run several times a frame; the next stage starts now. */
+    void endStage(int stage);
+
+    /**
+     * Replaces the time of `stage` this frame with one measured elsewhere, say by a GPU timer query,
+     * when the CPU only sees the submission.
+     */
+    void setStageMS(int stage, double ms);
+
+    /**
+     * Ends the frame and adjusts the budget, with hysteresis: the smoothed work time
+     * has to stay outside a band around the target for a few frames first.
+     * @returns the budget for the next frame.
+     */
+    long endFrame();
+
+    /** The work to do this frame, within [floor, ceiling]. */
+    long budget() const { return current; }
+
+    /** Smoothed time of the counted stages. */
+    double workMS() const { return smoothedMS; }
+
+    /** "name 1.23ms, ..." of the smoothed stage times. */
+    std::string report() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Stage {
+        std::string name;
+        bool counted;
+        double ms;
+        double lastMS;
+    };
+
+    const long floor;
+    const long ceiling;
+    const double targetMS;
+
+    long current;
+    double smoothedMS = 0.0;
+    // Consecutive frames over or under the band, negative when under.
+    int outside = 0;
+    int warmup;
+
+    std::vector<Stage> stages;
+    Clock::time_point stageStart;
+};
+
+#endif
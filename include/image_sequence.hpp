@@ -0,0 +1,186 @@
+#ifndef IMAGE_SEQUENCE_HPP
+/** @file image_sequence.hpp
+ * <br>Numbered image files written in the background: frames are copied into a queue bounded by
+ * the memory they hold, and encoder threads of their own encode and write them, so a render
+ * thread only pays for the copy, and waits only when the disk falls behind by more than the cap.
+ * <br>Files are fsynced in batches, so a long run is on disk as it goes at the cost of one flush
+ * per batch rather than per file; throughput is logged every second, to size disks by.
+ */
+#define IMAGE_SEQUENCE_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "density_file.hpp"
+
+enum ImageFormat {
+    /** Binary PPM, RGB: no encoding at all, the largest files. */
+    IMAGE_PPM,
+    /** RGB PNG, deflated with zlib when built with it (EGG_ZLIB), else stored. */
+    IMAGE_PNG,
+    /** RGB QOI: lossless, a fraction of the PPM size, and far cheaper to encode than PNG. */
+    IMAGE_QOI,
+    /** RGB PNG with 16 bits per channel, for the smooth low end of tone-mapped densities. */
+    IMAGE_PNG16
+};
+
+/** "ppm", "png", "qoi" or "png16". */
+const char *imageFormatName(ImageFormat format);
+
+/** The file extension: the name, but "png" for png16. */
+const char *imageExtension(ImageFormat format);
+
+/** Parses an imageFormatName(). @returns false for anything else. */
+bool parseImageFormat(const char *name, ImageFormat &format);
+
+/**
+ * Encodes RGBA8 as a whole `format` file into `out`, dropping alpha.
+ * @param bottomUp the rows of `rgba` are bottom first, as glReadPixels returns them.
+ */
+void encodeImage(ImageFormat format, const uint8_t *rgba, int width, int height, bool bottomUp,
+                 std::vector<uint8_t> &out);
+
+/** Encodes RGBA16 as a whole 16-bit PNG into `out`, dropping alpha. */
+void encodeImage16(const uint16_t *rgba, int width, int height, bool bottomUp, std::vector<uint8_t> &out);
+
+/**
+ * One image written in strips of rows from the top, for images too large to hold whole:
+ * PPM, or PNG and PNG16 deflated as the rows arrive. Not QOI.
+ */
+class ImageStripWriter {
+public:
+    /** Opens `path`; ok() tells whether it could be, and whether `format` is written in strips. */
+    ImageStripWriter(const char *path, ImageFormat format, int width, int height);
+    ~ImageStripWriter();
+
+    ImageStripWriter(const ImageStripWriter &) = delete;
+    ImageStripWriter &operator=(const ImageStripWriter &) = delete;
+
+    bool ok() const { return file != nullptr && !failed; }
+
+    /** Writes the next `rows` rows, RGBA8, dropping alpha. */
+    bool write(const uint8_t *rgba, int rows);
+
+    /** As write(), RGBA16; narrowed to 8 bits but for IMAGE_PNG16. */
+    bool write16(const uint16_t *rgba, int rows);
+
+    /** Ends the image and closes the file. @returns false when any of it was not written, or rows are missing. */
+    bool finish();
+
+private:
+    void putRow();
+    void writeRaw(const uint8_t *raw, size_t length, bool last);
+    void put(const std::vector<uint8_t> &bytes);
+
+    FILE *file;
+    ImageFormat format;
+    int width, height;
+    int rowsWritten = 0;
+    bool failed = false;
+    // The row being written; for PNG also the previous one, for the Up filter, and the zlib stream.
+    std::vector<uint8_t> row, previous, filtered, deflated;
+    uint32_t adlerA = 1, adlerB = 0;
+    void *stream = nullptr;
+};
+
+struct ImageSequenceOptions {
+    ImageFormat format = IMAGE_PPM;
+    /** Format of the densities pushed with pushDensity(); they are not written with DENSITY_NONE. */
+    DensityFormat density = DENSITY_NONE;
+    /** Encoder threads, 0 for every hardware thread. */
+    unsigned threads = 0;
+    /** Bytes of frames held, queued or being encoded; push() waits past it. */
+    size_t memoryCap = (size_t)512 << 20;
+    /** Files between fsyncs, reopened by name and synced as one batch; 0 leaves writeback to the system. */
+    int syncEvery = 32;
+    /** Logs the throughput every second. */
+    bool progress = true;
+};
+
+class ImageSequenceWriter {
+public:
+    struct Stats {
+        long frames = 0;
+        /** Files that could not be written, closed or synced. */
+        long failed = 0;
+        uint64_t bytes = 0;
+        double seconds = 0.0;
+        /** Time push() spent waiting for memory under the cap. */
+        double waitSeconds = 0.0;
+        size_t peakMemory = 0;
+    };
+
+    /** Writes `directory`/frame_NNNNNN.ext; the directory must exist. */
+    ImageSequenceWriter(const char *directory, const ImageSequenceOptions &options);
+    ~ImageSequenceWriter();
+
+    ImageSequenceWriter(const ImageSequenceWriter &) = delete;
+    ImageSequenceWriter &operator=(const ImageSequenceWriter &) = delete;
+
+    /**
+     * Queues a copy of a frame, RGBA8, written as number `frame`. Waits while the frames held
+     * would pass the memory cap; a frame larger than the cap waits for the queue to empty.
+     */
+    void push(const uint8_t *rgba, int width, int height, bool bottomUp, long frame);
+
+    /** As push(), for RGBA16, always written as a 16-bit PNG. */
+    void push16(const uint16_t *rgba, int width, int height, bool bottomUp, long frame);
+
+    /** As push(), for the counts of a density, written as frame_NNNNNN.pfm or .egd in the density format. */
+    void pushDensity(const uint32_t *counts, int width, int height, uint32_t peak, bool bottomUp, long frame);
+
+    /** Writes the queued frames and syncs the last batch and the directory. */
+    void finish();
+
+    Stats stats() const;
+
+private:
+    struct Job {
+        enum Kind { RGBA8, RGBA16, DENSITY } kind;
+        std::vector<uint8_t> data;
+        int width, height;
+        bool bottomUp;
+        long frame;
+        uint32_t peak;
+    };
+
+    void enqueue(Job::Kind kind, const uint8_t *data, size_t bytes, int width, int height, bool bottomUp,
+                 long frame, uint32_t peak);
+    void encoderLoop();
+    bool writeFile(const Job &job, std::vector<uint8_t> &encoded);
+    /** fsyncs and forgets the files of `batch`. @returns those that could not be synced. */
+    long syncBatch(std::vector<std::string> &batch);
+    void report(std::chrono::steady_clock::time_point now);
+
+    std::string directory;
+    ImageSequenceOptions options;
+    std::chrono::steady_clock::time_point started;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable freed;
+    std::deque<Job> queued;
+    // Frame buffers of written jobs, reused by push().
+    std::vector<std::vector<uint8_t>> spare;
+    // Paths of the written files not yet fsynced.
+    std::vector<std::string> unsynced;
+    size_t held = 0;
+    bool finishing = false;
+    Stats totals;
+    // The last progress line, and the totals then.
+    std::chrono::steady_clock::time_point reported;
+    long reportedFrames = 0;
+    uint64_t reportedBytes = 0;
+
+    std::vector<std::thread> encoders;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef NUMA_TOPOLOGY_HPP
+/** @file numa_topology.hpp
+ * <br>NUMA nodes from sysfs, thread pinning and page placement statistics, without libnuma.
+ * A single node is reported off Linux or without /sys/devices/system/node.
+ */
+#define NUMA_TOPOLOGY_HPP
+
+#include <cstddef>
+#include <vector>
+
+
+class NumaTopology {
+public:
+    /** The topology of this machine, read once. */
+    static const NumaTopology &get();
+
+    int nodes() const { return static_cast<int>(nodeCpus.size()); }
+
+    /** The CPUs of `node`; empty when unknown. */
+    const std::vector<int> &cpus(int node) const { return nodeCpus[node]; }
+
+    /** Restricts the calling thread to the CPUs of `node`. @returns false when not possible. */
+    bool pinCurrentThread(int node) const;
+
+    /**
+     * Pages of [data, data + bytes) per node, with move_pages(2) in query mode;
+     * the last entry counts pages not faulted in yet or of unknown node.
+     */
+    std::vector<long> pagesPerNode(const void *data, size_t bytes) const;
+
+    struct NodeCounters {
+        // Allocations served from this node for a task running on it, or on another node.
+        long long local;
+        long long other;
+    };
+
+    /** The local_node and other_node counters of every node's numastat, system wide. */
+    std::vector<NodeCounters> counters() const;
+
+private:
+    NumaTopology();
+
+    std::vector<std::vector<int>> nodeCpus;
+    // sysfs node number of each entry of nodeCpus, nodes may be sparse.
+    std::vector<int> nodeIds;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef ORBIT_SEEDS_HPP
+/** @file orbit_seeds.hpp
+ * <br>Start points for many parallel orbits. A counter-based generator (Philox4x32-10) gives
+ * random numbers as a pure function of (key, counter), and low-discrepancy sequences (Sobol,
+ * R2) spread the starts evenly; either way orbit i starts at the same point whichever thread,
+ * lane or pass computes it, with no shared generator state.
+ */
+#define ORBIT_SEEDS_HPP
+
+#include <cstdint>
+
+
+/**
+ * Philox4x32-10 of Salmon et al., "Parallel random numbers: as easy as 1, 2, 3": ten rounds of
+ * multiply-xor over a 128-bit counter under a 64-bit key. Stateless, so any block can be had at any time.
+ */
+class Philox4x32 {
+public:
+    explicit Philox4x32(uint64_t key) : key{(uint32_t)key, (uint32_t)(key >> 32)} {}
+
+    /** The four words of block `counter`. */
+    void block(uint64_t counter, uint32_t out[4]) const;
+
+    /** A word in [0, 1) with 32 bits of resolution. */
+    static double unit(uint32_t word) { return word * (1.0 / 4294967296.0); }
+
+private:
+    uint32_t key[2];
+};
+
+enum SeedSequence {
+    /** Independent uniform points from Philox4x32. */
+    SEEDS_RANDOM,
+    /** The first two Sobol dimensions, 32 bits deep. */
+    SEEDS_SOBOL,
+    /** Roberts' R2 sequence, the additive recurrence on the plastic number. */
+    SEEDS_R2
+};
+
+/** "random", "sobol" or "r2". */
+const char *seedSequenceName(SeedSequence sequence);
+
+/** Parses a seedSequenceName(); false leaves `sequence` as it was. */
+bool parseSeedSequence(const char *name, SeedSequence &sequence);
+
+/**
+ * Orbit start points in a square about a centre. The low-discrepancy sequences are shifted
+ * modulo 1 by a Philox draw of the key (Cranley-Patterson rotation), so that every key, say
+ * every attractor, gets its own well spread set.
+ */
+class OrbitSeeds {
+public:
+    OrbitSeeds(SeedSequence sequence, uint64_t key, double centerX, double centerY, double radius);
+
+    /** Start point of orbit `index`, within `radius` of the centre on both axes. */
+    void seed(uint64_t index, double &x, double &y) const;
+
+    /** As seed(), in [0, 1)^2. */
+    void unitSeed(uint64_t index, double &u, double &v) const;
+
+private:
+    SeedSequence sequence;
+    Philox4x32 philox;
+    double shiftU, shiftV;
+    double centerX, centerY;
+    double radius;
+};
+
+#endif
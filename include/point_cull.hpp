@@ -0,0 +1,29 @@
+#ifndef POINT_CULL_HPP
+/** @file point_cull.hpp
+ * <br>Drops orbit points outside the view and packs the survivors, so that only they are
+ * uploaded and drawn. SSE2 where available, the same tests in scalar code otherwise.
+ */
+#define POINT_CULL_HPP
+
+#include <cstdint>
+
+
+/**
+ * Attractor space to clip space per axis, clip = point * scale + offset, and the clip-space
+ * half extent that counts as visible (above 1 to keep sprites straddling the edges).
+ */
+struct CullTransform {
+    float scaleX, scaleY;
+    float offsetX, offsetY;
+    float bound;
+};
+
+/**
+ * Packs the points of `points` (x, y, next x, next y each) whose x, y is visible to its front,
+ * in order, and the ids of the survivors to `keptIds`. Works in place.
+ * @param ids the id of every point, read in step with `points`.
+ * @return survivors.
+ */
+int compactVisible(float *points, const int32_t *ids, int32_t *keptIds, int count, const CullTransform &transform);
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef SPRITE_RASTER_HPP
+/** @file sprite_raster.hpp
+ * <br>The additive glow-sprite look on the CPU, for machines with no usable OpenGL and as a
+ * reference for image regressions: point sprites textured with the glow image, coloured by
+ * the math of chaos.fs or basic.fs, and blended with glBlendFunc(GL_SRC_ALPHA, GL_ONE) into RGBA8.
+ * <br>The framebuffer is split into tiles; sprites are binned by the tiles they touch, then each
+ * tile is shaded and blended by one worker alone, with saturating SSE2 adds.
+ */
+#define SPRITE_RASTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "view_framing.hpp"
+#include "worker_pool.hpp"
+
+
+/** The fragment shader a sprite's texels are coloured by. */
+enum SpriteShader {
+    /** chaos.fs: the glow mixed toward the vertex colour and tone mapped, alpha from the glow's blue. */
+    SPRITE_CHAOS,
+    /** basic.fs: the vertex colour through the glow, tone mapped above a threshold. */
+    SPRITE_BASIC
+};
+
+/** A point after the vertex stage. */
+struct Sprite {
+    /** Window position in pixels, rows from the top, pixel centres at +0.5. */
+    float x, y;
+    /** v_color. */
+    float r, g, b;
+    /** v_sensitivity of chaos.fs, u_sensitivity of basic.fs. */
+    float sensitivity;
+};
+
+/** The uniforms of one attractor that chaos.vs colours its points by. */
+struct SpriteLook {
+    /** u_angle. */
+    float angle;
+    /** u_sensitivity. */
+    float sensitivity;
+    /** u_hueOffset. */
+    float hueOffset;
+};
+
+/**
+ * chaos.vs on the CPU: the sprites of `count` points of one attractor (x, y, next x, next y;
+ * point i with id i) in a width x height viewport, with no pan or zoom and no trails.
+ */
+void spriteVertices(const float *points, int count, const SpriteLook &look, const ViewFit &fit,
+                    int width, int height, Sprite *sprites);
+
+/**
+ * The glow texture as a `size` x `size` point sprite samples it: GL_LINEAR and GL_REPEAT at
+ * gl_PointCoord, for PHASES x PHASES sub-pixel positions of the sprite's centre.
+ */
+class GlowKernel {
+public:
+    static constexpr int PHASES = 4;
+
+    /**
+     * @param rgba the texture as uploaded, width x height RGBA8, first row at t = 0.
+     * @param size the point size in pixels, glPointSize().
+     */
+    GlowKernel(const uint8_t *rgba, int width, int height, int size);
+
+    int size() const { return points; }
+
+    /** Texels of a phase as planes of R, G, B and A, size() x size() each, rows from the top. */
+    const float *texels(int phaseX, int phaseY) const {
+        return planes.data() + ((size_t)phaseY * PHASES + phaseX) * 4 * points * points;
+    }
+
+    /**
+     * The columns [first, end) of a row of a phase with any blue; chaos.fs takes its alpha from
+     * the blue, so it adds nothing outside them.
+     */
+    void blueSpan(int phaseX, int phaseY, int row, int &first, int &end) const {
+        const uint8_t *span = spans.data() + (((size_t)phaseY * PHASES + phaseX) * points + row) * 2;
+        first = span[0];
+        end = span[1];
+    }
+
+private:
+    int points;
+    std::vector<float> planes;
+    std::vector<uint8_t> spans;
+};
+
+class SpriteRasterizer {
+public:
+    /** Tile side in pixels. */
+    static constexpr int TILE = 64;
+
+    SpriteRasterizer(int width, int height, WorkerPool &pool);
+
+    SpriteRasterizer(const SpriteRasterizer &) = delete;
+    SpriteRasterizer &operator=(const SpriteRasterizer &) = delete;
+
+    /** Fills the framebuffer with a glClearColor(). */
+    void clear(float red, float green, float blue, float alpha);
+
+    /**
+     * Draws `count` sprites, as glDrawArrays(GL_POINTS) would with additive blending.
+     * Sprites clipped by the edges keep their visible part; those not finite, or centred
+     * over 2^24 pixels out, are dropped. Each blend is rounded to 8 bits
+     * and saturates, as on an RGBA8 framebuffer, so the image is the same for any draw order
+     * and thread count.
+     */
+    void draw(const Sprite *sprites, size_t count, const GlowKernel &kernel, SpriteShader shader);
+
+    /** RGBA8, rows from the top. */
+    const uint8_t *pixels() const { return framebuffer.data(); }
+
+    int width() const { return columns; }
+    int height() const { return rows; }
+
+private:
+    void bin(const Sprite *sprites, size_t count, int size);
+    void shadeTile(int tile, const Sprite *sprites, const GlowKernel &kernel, SpriteShader shader);
+
+    int columns, rows;
+    int tilesX, tilesY;
+    WorkerPool &pool;
+    std::vector<uint8_t> framebuffer;
+    // Sprite indices per worker and tile; a tile reads every worker's list in worker order.
+    std::vector<std::vector<std::vector<uint32_t>>> bins;
+};
+
+#endif
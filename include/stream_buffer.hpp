@@ -0,0 +1,89 @@
+#ifndef STREAM_BUFFER_HPP
+/** @file stream_buffer.hpp
+ * <br>Runtime-sized, 64-byte aligned point streams, optionally on huge pages.
+ */
+#define STREAM_BUFFER_HPP
+
+#include <cstddef>
+
+
+enum StreamPages {
+    /** Base pages. */
+    PAGES_SMALL,
+    /** Transparent huge pages, asked for with madvise; the kernel may still split them. */
+    PAGES_TRANSPARENT,
+    /** Explicit huge pages from the hugetlb pool (vm.nr_hugepages), transparent ones without. */
+    PAGES_EXPLICIT
+};
+
+/** "small", "thp" or "explicit". */
+const char *streamPagesName(StreamPages pages);
+
+/** Parses a streamPagesName(). @returns false for anything else. */
+bool parseStreamPages(const char *name, StreamPages &pages);
+
+class StreamBuffer {
+public:
+    static constexpr size_t ALIGNMENT = 64;
+
+    StreamBuffer() = default;
+
+    /**
+     * Allocates and zeroes `bytes`, falling back to smaller pages when the asked ones are missing.
+     * data() is null when even that fails.
+     * @param touch false leaves the zeroing to the caller, so that each page is first touched,
+     *        and placed on a NUMA node, by the thread that will use it.
+     */
+    StreamBuffer(size_t bytes, StreamPages pages, bool touch = true);
+    ~StreamBuffer();
+
+    StreamBuffer(StreamBuffer &&other) noexcept;
+    StreamBuffer &operator=(StreamBuffer &&other) noexcept;
+    StreamBuffer(const StreamBuffer &) = delete;
+    StreamBuffer &operator=(const StreamBuffer &) = delete;
+
+    void *data() const { return memory; }
+
+    template<typename T>
+    T *as() const { return static_cast<T *>(memory); }
+
+    size_t size() const { return bytes; }
+
+    /** The pages actually obtained. */
+    StreamPages pages() const { return obtained; }
+
+private:
+    void release();
+
+    void *memory = nullptr;
+    size_t bytes = 0;
+    // Length of the hugetlb mapping, 0 when memory came from posix_memalign.
+    size_t mapped = 0;
+    StreamPages obtained = PAGES_SMALL;
+};
+
+/**
+ * Counts the data TLB misses (loads and stores) of the calling thread, with perf_event_open.
+ * Unavailable off Linux, or when perf_event_paranoid forbids it.
+ */
+class TLBMissCounter {
+public:
+    TLBMissCounter();
+    ~TLBMissCounter();
+
+    TLBMissCounter(const TLBMissCounter &) = delete;
+    TLBMissCounter &operator=(const TLBMissCounter &) = delete;
+
+    bool available() const { return loadMisses >= 0; }
+
+    void start();
+
+    /** @returns the misses since start(), or -1 when unavailable. */
+    long long stop();
+
+private:
+    int loadMisses = -1;
+    int storeMisses = -1;
+};
+
+#endif
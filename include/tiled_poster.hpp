@@ -0,0 +1,134 @@
+#ifndef TILED_POSTER_HPP
+/** @file tiled_poster.hpp
+ * <br>Density renders larger than any framebuffer, or than memory: orbit points are streamed once
+ * and binned by tile into spill files, the tiles are then accumulated a group at a time within a
+ * memory budget, and the image is tone mapped and written in strips, a tile at a time.
+ * <br>Tiles span the full width, so that every finished tile is a strip of the output, and a
+ * point is spilled as its 32-bit offset within its tile.
+ */
+#define TILED_POSTER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "density_file.hpp"
+#include "image_sequence.hpp"
+#include "tone_map.hpp"
+#include "worker_pool.hpp"
+
+
+struct PosterOptions {
+    int width = 16384;
+    int height = 16384;
+    /** Rows per tile, fewer when a tile and its strip would take over half the budget. */
+    int tileRows = 256;
+    /** Bytes of spill buffers, tile counts and strips held at once. */
+    size_t memoryBudget = (size_t)1 << 30;
+    /** Where the spill files are made, unlinked as soon as they are open; the working directory when null. */
+    const char *spillDirectory = nullptr;
+    /** IMAGE_PPM, IMAGE_PNG or IMAGE_PNG16; QOI is not written in strips. */
+    ImageFormat format = IMAGE_PNG16;
+    ToneMapSettings toneMap;
+};
+
+class TiledPoster;
+
+/**
+ * One thread's end of a TiledPoster::bin(): points go to per-tile buffers, spilled to the
+ * tile's file whenever one fills.
+ */
+class PosterBinner {
+public:
+    /** Bins `count` points, in output pixels with centres at +0.5; points outside are dropped. */
+    void add(const float *xs, const float *ys, int count);
+
+private:
+    friend class TiledPoster;
+
+    void spill(int tile);
+
+    TiledPoster *poster;
+    // [tile][spillPoints] offsets within the tile, and how many of each are filled.
+    std::vector<uint32_t> buffers;
+    std::vector<uint32_t> filled;
+    uint64_t points = 0;
+    uint64_t spilled = 0;
+};
+
+class TiledPoster {
+public:
+    struct Stats {
+        /** Points binned, inside the image. */
+        uint64_t points = 0;
+        uint64_t spillBytes = 0;
+        int tiles = 0;
+        int tileRows = 0;
+        /** Groups the tiles were accumulated in; tiles of all groups but the last are spilled as counts. */
+        int groups = 0;
+        uint32_t peak = 0;
+        double binSeconds = 0.0;
+        double accumulateSeconds = 0.0;
+        double writeSeconds = 0.0;
+        /** Bytes held by the poster at most, to compare against the budget. */
+        size_t peakHeld = 0;
+        /** Peak resident set of the process, 0 where unknown. */
+        size_t peakRSS = 0;
+    };
+
+    /** Opens a spill file per tile; ok() tells whether they could all be. */
+    TiledPoster(const PosterOptions &options, WorkerPool &pool);
+    ~TiledPoster();
+
+    TiledPoster(const TiledPoster &) = delete;
+    TiledPoster &operator=(const TiledPoster &) = delete;
+
+    bool ok() const { return !failed; }
+
+    /**
+     * Runs produce(worker, workers, binner) on every worker of the pool and spills what they binned.
+     * Producers split the work by `worker`; more points may be binned by calling it again, until write().
+     * @returns false when the spill files could not be written, or after write().
+     */
+    bool bin(const std::function<void(int worker, int workers, PosterBinner &binner)> &produce);
+
+    /**
+     * Accumulates the tiles, then tone maps them against the peak of the whole image into `path`, strip by
+     * strip; with `densityPath`, the counts are written there too, in `density`. Nothing can be binned or
+     * written after, as the spill files are closed as their tiles are accumulated.
+     * @returns false when the image, the density or a spill file could not be written or read, or on a second call.
+     */
+    bool write(const char *path, const char *densityPath = nullptr, DensityFormat density = DENSITY_NONE);
+
+    Stats stats() const;
+
+private:
+    friend class PosterBinner;
+
+    /** Sums the spilled points of `tile` into `counts`. @returns the tile's peak. */
+    uint32_t accumulate(int tile, uint32_t *counts);
+    size_t tilePixels(int tile) const;
+    /** Notes `bytes` held at once by a phase, for Stats::peakHeld. */
+    void account(size_t bytes);
+
+    const PosterOptions options;
+    WorkerPool &pool;
+    int tiles;
+    int tileRows;
+    size_t spillPoints;
+    std::vector<FILE *> spills;
+    // Names of spill files that could not be unlinked while open, removed by the destructor.
+    std::vector<std::string> spillNames;
+    std::vector<std::mutex> spillLocks;
+    std::atomic<bool> failed {false};
+    // Set by write(), which consumes the spill files.
+    bool written = false;
+    Stats totals;
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef TONE_MAP_HPP
+/** @file tone_map.hpp
+ * <br>Turns a density histogram into RGBA8 or RGBA16 pixels on the CPU: log density, gamma,
+ * vibrancy and a gradient palette, all baked into one lookup table indexed by the log density.
+ */
+#define TONE_MAP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "worker_pool.hpp"
+
+
+enum ToneMapPath {
+    TONEMAP_SCALAR,
+    /** Four pixels' table indices at once, scalar lookups. */
+    TONEMAP_SSE2,
+    /** Eight pixels' indices and gathers from the table; picked at run time on CPUs that have it. */
+    TONEMAP_AVX2
+};
+
+/** "scalar", "sse2" or "avx2". */
+const char *toneMapPathName(ToneMapPath path);
+
+/** The widest path this build and CPU can run. */
+ToneMapPath bestToneMapPath();
+
+/** One colour of the gradient, at position in [0, 1] of the log density. */
+struct PaletteStop {
+    float position;
+    float r, g, b;
+};
+
+/**
+ * The defaults reproduce density.fs, so that CPU and GPU histograms look alike.
+ */
+struct ToneMapSettings {
+    /** Applied to the log density; 1 leaves it linear. */
+    float gamma = 1.0f;
+    /** 1 gammas the density alone and keeps the palette saturated, 0 gammas each channel. */
+    float vibrancy = 1.0f;
+    /** Scale ahead of the Reinhard curve. */
+    float brightness = 2.5f;
+    float background[3] = {0.0f, 0.2f, 0.2f};
+    /** Stops in increasing position; empty for the hue ramp of density.fs. */
+    std::vector<PaletteStop> palette;
+};
+
+class ToneMapper {
+public:
+    /** Table entries over the log density [0, 1]. */
+    static constexpr int LUT_SIZE = 4096;
+
+    explicit ToneMapper(const ToneMapSettings &settings = ToneMapSettings());
+
+    /**
+     * Maps `pixels` counts against `peak` to 4 bytes each, R G B A. Every path gives the same pixels.
+     * @param pool splits the pixels over its workers; nullptr runs on the calling thread.
+     */
+    void toRGBA8(const uint32_t *counts, size_t pixels, uint32_t peak, uint8_t *rgba,
+                 WorkerPool *pool = nullptr, ToneMapPath path = bestToneMapPath()) const;
+
+    /** As toRGBA8, 4 uint16_t per pixel. */
+    void toRGBA16(const uint32_t *counts, size_t pixels, uint32_t peak, uint16_t *rgba,
+                  WorkerPool *pool = nullptr, ToneMapPath path = bestToneMapPath()) const;
+
+private:
+    /** Packed little-endian RGBA, LUT_SIZE entries each. */
+    std::vector<uint32_t> lut8;
+    std::vector<uint64_t> lut16;
+};
+
+#endif
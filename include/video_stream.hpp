@@ -0,0 +1,120 @@
+#ifndef VIDEO_STREAM_HPP
+/** @file video_stream.hpp
+ * <br>Rendered frames as a raw video stream, for an encoder reading a pipe: YUV4MPEG2 (4:2:0,
+ * BT.601 limited range) or bare RGBA8 frames, to stdout or any path, a FIFO say.
+ * <br>Frames are copied into a few pooled slots and converted and written by a thread of their
+ * own; when the reader falls behind and every slot is taken, a frame is dropped or waited for,
+ * as the backpressure policy says, so a slow reader costs a known price and never a stalled GPU.
+ */
+#define VIDEO_STREAM_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+enum VideoFormat {
+    /** YUV4MPEG2 with C420jpeg chroma, as ffmpeg and x264 read it from a pipe. */
+    VIDEO_Y4M,
+    /** Bare RGBA8 frames, top row first, no header; the reader is told the size. */
+    VIDEO_RGBA
+};
+
+/** "y4m" or "rgba". */
+const char *videoFormatName(VideoFormat format);
+
+/** Parses a videoFormatName(). @returns false for anything else. */
+bool parseVideoFormat(const char *name, VideoFormat &format);
+
+/** What push() does when the reader is behind and no slot is free. */
+enum Backpressure {
+    /** The frame is dropped and counted; rendering goes on at its own rate. */
+    BACKPRESSURE_DROP,
+    /** push() waits for a slot; rendering runs at the reader's rate, and no frame is lost. */
+    BACKPRESSURE_BLOCK
+};
+
+/** "drop" or "block". */
+const char *backpressureName(Backpressure policy);
+
+/** Parses a backpressureName(). @returns false for anything else. */
+bool parseBackpressure(const char *name, Backpressure &policy);
+
+/**
+ * RGBA8 to the planes of I420, BT.601 limited range, chroma the mean of each 2x2 block; odd sizes
+ * repeat the last column and row. Integer math, the same with and without SSE2.
+ * @param bottomUp the rows of `rgba` are bottom first, as glReadPixels returns them.
+ * @param y width x height.
+ * @param u, v (width + 1) / 2 x (height + 1) / 2 each.
+ */
+void rgbaToI420(const uint8_t *rgba, int width, int height, bool bottomUp, uint8_t *y, uint8_t *u, uint8_t *v);
+
+class VideoStream {
+public:
+    /**
+     * @param path where to write, "-" for stdout: stdout then moves to stderr, so that the
+     *        program's logs stay out of the stream. Other paths are opened by the writer thread,
+     *        as opening a FIFO waits for its reader.
+     * @param fps the frame rate in the Y4M header.
+     * @param slots frames that can wait for the writer.
+     */
+    VideoStream(const char *path, VideoFormat format, Backpressure policy, int fps, int slots = 3);
+    ~VideoStream();
+
+    VideoStream(const VideoStream &) = delete;
+    VideoStream &operator=(const VideoStream &) = delete;
+
+    /**
+     * Queues a frame, RGBA8 bottom row first. The stream takes the size of its first frame;
+     * frames of another size are dropped.
+     * @returns false when the frame was dropped.
+     */
+    bool push(const uint8_t *rgba, int width, int height);
+
+    /** Writes the queued frames, then closes the output. */
+    void close();
+
+    long written() const;
+    long dropped() const;
+
+    /** Whether the output could not be opened or written, the reader gone say; frames are dropped since. */
+    bool failed() const;
+
+private:
+    struct Frame {
+        std::vector<uint8_t> rgba;
+        int width = 0, height = 0;
+    };
+
+    void writerLoop();
+    bool writeFrame(const Frame &frame);
+
+    const char *path;
+    VideoFormat format;
+    Backpressure policy;
+    int fps;
+    FILE *output = nullptr;
+    int width = 0, height = 0;
+
+    std::vector<Frame> frames;
+    // Indices into frames: free ones, and full ones in the order pushed.
+    std::vector<int> idle;
+    std::deque<int> queued;
+    // Planes of the frame being converted, kept between frames.
+    std::vector<uint8_t> planes;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable freed;
+    bool closing = false;
+    bool broken = false;
+    long framesWritten = 0;
+    long framesDropped = 0;
+    std::thread writer;
+};
+
+#endif
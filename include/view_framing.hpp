@@ -0,0 +1,38 @@
+#ifndef VIEW_FRAMING_HPP
+/** @file view_framing.hpp
+ * <br>Frames a sampled point cloud on the screen: robust percentile bounds of the samples,
+ * and the attractor-to-clip-space fit that centres and fills them.
+ */
+#define VIEW_FRAMING_HPP
+
+#include <vector>
+
+
+/** Axis-aligned bounds of a point cloud. */
+struct FrameBounds {
+    double minX, minY;
+    double maxX, maxY;
+};
+
+/** Attractor space to clip space per axis: clip = point * scale + offset. */
+struct ViewFit {
+    double scaleX, scaleY;
+    double offsetX, offsetY;
+};
+
+/**
+ * Bounds that leave out the `tail` fraction of the samples on either side of each axis, so that
+ * the rare far excursions of an orbit don't shrink the picture. Reorders the samples.
+ */
+FrameBounds percentileBounds(std::vector<double> &xs, std::vector<double> &ys, double tail);
+
+/**
+ * The fit that centres `bounds` and fills the screen to within `margin` (in clip units) along the
+ * tighter axis, keeping the points' proportions on a viewport of `aspect` (width / height).
+ */
+ViewFit fitBounds(const FrameBounds &bounds, double aspect, double margin);
+
+/** Whether `next` moves the centre or the scale of `current` by more than `tolerance` of the screen. */
+bool fitDiffers(const ViewFit &current, const ViewFit &next, double tolerance);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef WORKER_POOL_HPP
+/** @file worker_pool.hpp
+ * <br>A small pool of persistent worker threads for the per-frame compute.
+ */
+#define WORKER_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class WorkerPool {
+public:
+    /**
+     * @param threads the number of workers; 0 uses every hardware thread.
+     * @param pinned pins worker w to the CPUs of NUMA node nodeOf(w); the calling thread is left alone.
+     */
+    explicit WorkerPool(unsigned threads = 0, bool pinned = false);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    /** Worker count, the calling thread included. */
+    unsigned size() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+    /**
+     * Runs task(i) for every i in [0, count) and blocks until all are done.
+     * The calling thread takes tasks too; GL calls are not allowed in task.
+     */
+    void parallelFor(int count, const std::function<void(int)> &task);
+
+    /**
+     * As parallelFor, but task(i) always runs on worker i % size(), the calling thread being worker 0;
+     * memory first touched by task(i) then stays local to the node that keeps using it.
+     */
+    void parallelForStatic(int count, const std::function<void(int)> &task);
+
+    /** The NUMA node worker `worker` runs on when pinned, round robin over the nodes. */
+    int nodeOf(unsigned worker) const;
+
+private:
+    void workerLoop(unsigned index, bool pinned);
+    void drain(unsigned index);
+    void run(int count, const std::function<void(int)> &task, bool statically);
+
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    const std::function<void(int)> *task = nullptr;
+    int taskCount = 0;
+    std::atomic<int> nextTask {0};
+    bool staticSchedule = false;
+    unsigned finishedWorkers = 0;
+    unsigned long generation = 0;
+    bool quitting = false;
+};
+
+#endif
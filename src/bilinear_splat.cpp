@@ -0,0 +1,153 @@
+#include "bilinear_splat.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+    // Sub-pixel steps per pixel; SUBPIXEL^2 == SPLAT_ONE.
+    constexpr int SUBPIXEL = 16;
+    static_assert(SUBPIXEL * SUBPIXEL == (int)SPLAT_ONE, "bilinear weights must sum to SPLAT_ONE");
+
+    /**
+     * Scatters the four weights of one point; only the edges need the bounds checks.
+     */
+    inline void scatter(HistogramSplatter &splatter, int width, int height,
+                        int x0, int y0, int fx, int fy) {
+        if (x0 >= 0 && y0 >= 0 && x0 < width - 1 && y0 < height - 1) {
+            const uint32_t p = (uint32_t)y0 * width + x0;
+            splatter.add(p, (SUBPIXEL - fx) * (SUBPIXEL - fy));
+            splatter.add(p + 1, fx * (SUBPIXEL - fy));
+            splatter.add(p + width, (SUBPIXEL - fx) * fy);
+            splatter.add(p + width + 1, fx * fy);
+            return;
+        }
+        for (int dy = 0; dy < 2; dy++) {
+            for (int dx = 0; dx < 2; dx++) {
+                const int x = x0 + dx, y = y0 + dy;
+                const int weight = (dx ? fx : SUBPIXEL - fx) * (dy ? fy : SUBPIXEL - fy);
+                if (x >= 0 && y >= 0 && x < width && y < height && weight > 0) {
+                    splatter.add((uint32_t)y * width + x, weight);
+                }
+            }
+        }
+    }
+
+    inline void splatScalar(HistogramSplatter &splatter, int width, int height, float x, float y) {
+        // Bins are centred on +0.5, so the four neighbours start half a pixel back.
+        const float px = x - 0.5f, py = y - 0.5f;
+        if (!(px > -1.0f && py > -1.0f && px < width && py < height)) {
+            return;
+        }
+        const int x0 = (int)std::floor(px), y0 = (int)std::floor(py);
+        // nearbyint rounds half to even, like _mm_cvtps_epi32 in the SSE2 path.
+        const int fx = (int)std::nearbyint((px - x0) * SUBPIXEL);
+        const int fy = (int)std::nearbyint((py - y0) * SUBPIXEL);
+        scatter(splatter, width, height, x0, y0, fx, fy);
+    }
+}
+
+void splatNearest(HistogramSplatter &splatter, int width, int height,
+                  const float *xs, const float *ys, int count) {
+    for (int i = 0; i < count; i++) {
+        if (xs[i] >= 0.0f && ys[i] >= 0.0f && xs[i] < width && ys[i] < height) {
+            splatter.add((uint32_t)ys[i] * width + (uint32_t)xs[i], SPLAT_ONE);
+        }
+    }
+}
+
+void splatBilinear(HistogramSplatter &splatter, int width, int height,
+                   const float *xs, const float *ys, int count) {
+    int i = 0;
+#ifdef __SSE2__
+    // Weights of four points at once; the scatter itself stays scalar (SSE2 has no scatter).
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 steps = _mm_set1_ps((float)SUBPIXEL);
+    const __m128 low = _mm_set1_ps(-1.0f);
+    const __m128 high = _mm_set1_ps((float)width);
+    const __m128 highY = _mm_set1_ps((float)height);
+    const __m128 one = _mm_set1_ps(1.0f);
+    alignas(16) int x0[4], y0[4], fx[4], fy[4];
+    for (; i + 4 <= count; i += 4) {
+        const __m128 px = _mm_sub_ps(_mm_loadu_ps(xs + i), half);
+        const __m128 py = _mm_sub_ps(_mm_loadu_ps(ys + i), half);
+        const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(px, low), _mm_cmpgt_ps(py, low)),
+                                         _mm_and_ps(_mm_cmplt_ps(px, high), _mm_cmplt_ps(py, highY)));
+        const int mask = _mm_movemask_ps(inside);
+        if (mask == 0) {
+            continue;
+        }
+        // floor() without SSE4.1: truncate, then step down where that rounded up (negatives).
+        __m128i ix = _mm_cvttps_epi32(px);
+        __m128i iy = _mm_cvttps_epi32(py);
+        __m128 tx = _mm_cvtepi32_ps(ix);
+        __m128 ty = _mm_cvtepi32_ps(iy);
+        const __m128 overX = _mm_cmpgt_ps(tx, px);
+        const __m128 overY = _mm_cmpgt_ps(ty, py);
+        tx = _mm_sub_ps(tx, _mm_and_ps(overX, one));
+        ty = _mm_sub_ps(ty, _mm_and_ps(overY, one));
+        ix = _mm_cvttps_epi32(tx);
+        iy = _mm_cvttps_epi32(ty);
+        // Fractions in 1/16 steps, rounded to nearest (the default MXCSR mode).
+        const __m128i sx = _mm_cvtps_epi32(_mm_mul_ps(_mm_sub_ps(px, tx), steps));
+        const __m128i sy = _mm_cvtps_epi32(_mm_mul_ps(_mm_sub_ps(py, ty), steps));
+        _mm_store_si128(reinterpret_cast<__m128i *>(x0), ix);
+        _mm_store_si128(reinterpret_cast<__m128i *>(y0), iy);
+        _mm_store_si128(reinterpret_cast<__m128i *>(fx), sx);
+        _mm_store_si128(reinterpret_cast<__m128i *>(fy), sy);
+        for (int k = 0; k < 4; k++) {
+            if (mask & (1 << k)) {
+                scatter(splatter, width, height, x0[k], y0[k], fx[k], fy[k]);
+            }
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        splatScalar(splatter, width, height, xs[i], ys[i]);
+    }
+}
+
+/**
+ * One output row of downsampleBox(): vertical sums of `factor` input rows, then the horizontal groups.
+ */
+static void downsampleRow(const uint32_t *in, int width, int factor, uint32_t *sums, uint32_t *row) {
+    std::fill(sums, sums + width, 0u);
+    for (int dy = 0; dy < factor; dy++) {
+        const uint32_t *source = in + (size_t)dy * width;
+        int x = 0;
+#ifdef __SSE2__
+        for (; x + 4 <= width; x += 4) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(sums + x));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + x));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(sums + x), _mm_add_epi32(a, b));
+        }
+#endif
+        for (; x < width; x++) {
+            sums[x] += source[x];
+        }
+    }
+    for (int x = 0; x < width / factor; x++) {
+        uint32_t total = 0;
+        for (int dx = 0; dx < factor; dx++) {
+            total += sums[x * factor + dx];
+        }
+        row[x] = total;
+    }
+}
+
+void downsampleBox(const uint32_t *in, int width, int height, int factor, uint32_t *out, WorkerPool &pool) {
+    const int outWidth = width / factor;
+    const int outHeight = height / factor;
+    const int bands = (int)pool.size();
+    pool.parallelFor(bands, [=](int band) {
+        std::vector<uint32_t> sums(width);
+        for (int y = outHeight * band / bands; y < outHeight * (band + 1) / bands; y++) {
+            downsampleRow(in + (size_t)y * factor * width, width, factor, sums.data(),
+                          out + (size_t)y * outWidth);
+        }
+    });
+}
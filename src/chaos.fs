@@ -2,8 +2,8 @@
 
 precision mediump float;
 varying vec4 v_color;
+varying float v_sensitivity;
 layout(location = 0) out vec4 fragColor;
-uniform float u_sensitivity;
 uniform sampler2D s_texture;
 
 void main()
@@ -21,5 +21,5 @@ void main()
     toneMappedColor = toneMappedColor * luminance / dot(toneMappedColor, vec3(0.2126, 1.7152, 0.0722));
 
     c = vec4(c.rgb * toneMappedColor, c.a);
-        fragColor = vec4(c.rgb*texColor.rgb*1.9, u_sensitivity*texColor.b);
+        fragColor = vec4(c.rgb*texColor.rgb*1.9, v_sensitivity*texColor.b);
 }
\ No newline at end of file
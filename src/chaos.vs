@@ -2,8 +2,23 @@
 attribute vec4 a_data;
 
 attribute int a_id;
-uniform float u_angle;
+// One entry per composited attractor, picked by vertex range (u_layerPoints per attractor).
+layout(std140) uniform Layers {
+    // angle, sensitivity, hue offset, unused
+    vec4 u_look[4];
+    // Attractor-space to screen fit: scale.xy, offset.zw
+    vec4 u_fit[4];
+};
+uniform int u_layerPoints;
+// The pan/zoom on top of the fit.
+uniform mat3 u_view;
+// Trails: ring slot of the newest frame, and frames until a point fades out (0 never fades).
+uniform int u_head;
+uniform int u_trailFrames;
+uniform int u_slicePoints;
+uniform int u_ringFrames;
 varying vec4 v_color;
+varying float v_sensitivity;
 
 vec3 hsv(float h) {
     int i = int(h*6.);
@@ -28,11 +43,24 @@ vec3 hsv(float h) {
 
 void main()
 {
-    float dist = distance(a_data.zw, a_data.xy);
-    float colorAngle = cos(cos(a_id) - u_angle);
+    int layer = min(gl_VertexID / u_layerPoints, 3);
+    vec4 look = u_look[layer];
+    vec4 fit = u_fit[layer];
+
+    vec2 pos = a_data.xy * fit.xy + fit.zw;
+    vec2 next = a_data.zw * fit.xy + fit.zw;
+    float dist = distance(next, pos);
+    float colorAngle = cos(cos(a_id) - look.x);
     float distinv = 1./(dist);
     float r =  (1.0 - dist) * normalize(dist) * dist * distinv;
-    vec3 chsv = hsv(r);
-    v_color = vec4(mix(chsv, hsv(colorAngle), 1.0 - normalize(r*dist)*colorAngle), 1.0);
-    gl_Position = vec4(a_data.xy, 1.0, 1.0);
+    vec3 chsv = hsv(r + look.z);
+    float fade = 1.0;
+    if (u_trailFrames > 0) {
+        int slot = (gl_VertexID % u_layerPoints) / u_slicePoints % u_ringFrames;
+        int age = (u_head - slot + u_ringFrames) % u_ringFrames;
+        fade = 1.0 - float(age) / float(u_trailFrames);
+    }
+    v_color = vec4(mix(chsv, hsv(colorAngle + look.z), 1.0 - normalize(r*dist)*colorAngle) * fade, 1.0);
+    v_sensitivity = look.y * fade;
+    gl_Position = vec4((u_view * vec3(pos, 1.0)).xy, 1.0, 1.0);
 }
\ No newline at end of file
@@ -1,4 +1,6 @@
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <SDL2/SDL.h>
 
 #ifdef GLES2
@@ -38,11 +40,244 @@ double g_targetAspect = g_targetWidth / static_cast<double>(g_targetHeight);
 
 bool paused = false;
 
+/**
+ * Command line: [--attractors N] [--gpu-orbits] [--verify-orbits] [--histogram] [--trails K] [--target-ms MS]
+ *               [--particles N] [--pages small|thp|explicit] [--numa] [--no-cull] [--fixed-frame] [--deep]
+ *               [--seeds random|sobol|r2] [--checkpoints FILE] [--checkpoint-every N] [--seek FRAME]
+ *               [--export DIR] [--export-frames N] [--export-size WxH] [--export-threads N] [--export-sprites]
+ *               [--image-format ppm|png|qoi|png16] [--encoder-threads N] [--encoder-memory MB] [--sync-every N]
+ *               [--density-format none|pfm|raw] [--retone DENSITY OUT] [--gamma G] [--brightness B] [--vibrancy V]
+ *               [--poster OUT] [--poster-size WxH] [--poster-points N] [--poster-tile-rows N]
+ *               [--poster-memory MB] [--poster-threads N] [--spill-dir DIR]
+ *               [--headless] [--frames N] [--capture DIR]
+ *               [--stream PATH|-] [--stream-format y4m|rgba] [--stream-policy drop|block] [--stream-fps N]
+ *               [--bench-streams N] [--bench-histogram N] [--bench-splat N] [--bench-tonemap N]
+ *               [--bench-deep N] [--bench-sprites N] [--bench-threads N]
+ */
+struct BenchOptions {
+    int streamPoints = 0;
+    int histogramPoints = 0;
+    int splatPoints = 0;
+    int toneMapPoints = 0;
+    int deepPoints = 0;
+    int spritePoints = 0;
+    unsigned threads = 0;
+};
+
+struct RunOptions {
+    /** Tone maps this density to `retoneOutput` with `retone`, then quits; --poster tone maps with it too. */
+    const char *retoneInput = nullptr;
+    const char *retoneOutput = nullptr;
+    ToneMapSettings retone;
+    /** Renders offscreen, with no window or vsync. */
+    bool headless = false;
+    /** Quits after this many frames; 0 runs until Escape. */
+    long frames = 0;
+    /** Streams every frame shown to this path, "-" for stdout, see VideoStream. */
+    const char *stream = nullptr;
+    VideoFormat streamFormat = VIDEO_Y4M;
+    Backpressure backpressure = BACKPRESSURE_DROP;
+    int streamFPS = 60;
+};
+
+static CGameOptions parseOptions(int argc, char *argv[], BenchOptions &bench, CGameExport &job, CGamePoster &poster,
+                                RunOptions &run) {
+    CGameOptions options;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--attractors") == 0 && i + 1 < argc) {
+            options.attractors = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--gpu-orbits") == 0) {
+            options.orbits = ORBITS_GPU;
+        } else if (strcmp(argv[i], "--trails") == 0 && i + 1 < argc) {
+            options.trails = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--target-ms") == 0 && i + 1 < argc) {
+            options.targetMS = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--particles") == 0 && i + 1 < argc) {
+            options.particles = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pages") == 0 && i + 1 < argc) {
+            if (!parseStreamPages(argv[++i], options.pages)) {
+                SDL_Log("Unknown page size '%s'", argv[i]);
+            }
+        } else if (strcmp(argv[i], "--seeds") == 0 && i + 1 < argc) {
+            if (!parseSeedSequence(argv[++i], options.seeds)) {
+                SDL_Log("Unknown seed sequence '%s'", argv[i]);
+            }
+        } else if (strcmp(argv[i], "--checkpoints") == 0 && i + 1 < argc) {
+            options.checkpoints = argv[++i];
+        } else if (strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc) {
+            options.checkpointInterval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seek") == 0 && i + 1 < argc) {
+            options.seek = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--export") == 0 && i + 1 < argc) {
+            job.directory = argv[++i];
+        } else if (strcmp(argv[i], "--export-frames") == 0 && i + 1 < argc) {
+            job.frames = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--export-size") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &job.width, &job.height) != 2) {
+                SDL_Log("Unknown export size '%s'", argv[i]);
+            }
+        } else if (strcmp(argv[i], "--export-threads") == 0 && i + 1 < argc) {
+            job.threads = (unsigned)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--export-sprites") == 0) {
+            job.render = RENDER_SPRITES;
+        } else if (strcmp(argv[i], "--poster") == 0 && i + 1 < argc) {
+            poster.output = argv[++i];
+        } else if (strcmp(argv[i], "--poster-size") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &poster.options.width, &poster.options.height) != 2) {
+                SDL_Log("Unknown poster size '%s'", argv[i]);
+            }
+        } else if (strcmp(argv[i], "--poster-points") == 0 && i + 1 < argc) {
+            poster.points = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--poster-tile-rows") == 0 && i + 1 < argc) {
+            poster.options.tileRows = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--poster-memory") == 0 && i + 1 < argc) {
+            poster.options.memoryBudget = (size_t)std::max(atol(argv[++i]), 1L) << 20;
+        } else if (strcmp(argv[i], "--poster-threads") == 0 && i + 1 < argc) {
+            poster.threads = (unsigned)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--spill-dir") == 0 && i + 1 < argc) {
+            poster.options.spillDirectory = argv[++i];
+        } else if (strcmp(argv[i], "--bench-streams") == 0 && i + 1 < argc) {
+            bench.streamPoints = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench-histogram") == 0 && i + 1 < argc) {
+            bench.histogramPoints = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench-splat") == 0 && i + 1 < argc) {
+            bench.splatPoints = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench-tonemap") == 0 && i + 1 < argc) {
+            bench.toneMapPoints = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench-deep") == 0 && i + 1 < argc) {
+            bench.deepPoints = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench-sprites") == 0 && i + 1 < argc) {
+            bench.spritePoints = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench-threads") == 0 && i + 1 < argc) {
+            bench.threads = (unsigned)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--image-format") == 0 && i + 1 < argc) {
+            if (!parseImageFormat(argv[++i], options.images.format)) {
+                SDL_Log("Unknown image format '%s'", argv[i]);
+            }
+            // Posters are png16 unless told otherwise.
+            poster.options.format = options.images.format;
+        } else if (strcmp(argv[i], "--encoder-threads") == 0 && i + 1 < argc) {
+            options.images.threads = (unsigned)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--encoder-memory") == 0 && i + 1 < argc) {
+            options.images.memoryCap = (size_t)std::max(atol(argv[++i]), 1L) << 20;
+        } else if (strcmp(argv[i], "--sync-every") == 0 && i + 1 < argc) {
+            options.images.syncEvery = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--density-format") == 0 && i + 1 < argc) {
+            if (!parseDensityFormat(argv[++i], options.images.density)) {
+                SDL_Log("Unknown density format '%s'", argv[i]);
+            }
+        } else if (strcmp(argv[i], "--retone") == 0 && i + 2 < argc) {
+            run.retoneInput = argv[++i];
+            run.retoneOutput = argv[++i];
+        } else if (strcmp(argv[i], "--gamma") == 0 && i + 1 < argc) {
+            run.retone.gamma = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--brightness") == 0 && i + 1 < argc) {
+            run.retone.brightness = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--vibrancy") == 0 && i + 1 < argc) {
+            run.retone.vibrancy = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            options.capture = argv[++i];
+        } else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+            run.stream = argv[++i];
+        } else if (strcmp(argv[i], "--stream-format") == 0 && i + 1 < argc) {
+            if (!parseVideoFormat(argv[++i], run.streamFormat)) {
+                SDL_Log("Unknown stream format '%s'", argv[i]);
+            }
+        } else if (strcmp(argv[i], "--stream-policy") == 0 && i + 1 < argc) {
+            if (!parseBackpressure(argv[++i], run.backpressure)) {
+                SDL_Log("Unknown stream policy '%s'", argv[i]);
+            }
+        } else if (strcmp(argv[i], "--stream-fps") == 0 && i + 1 < argc) {
+            run.streamFPS = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            run.headless = true;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            run.frames = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--numa") == 0) {
+            options.numa = true;
+        } else if (strcmp(argv[i], "--no-cull") == 0) {
+            options.cull = false;
+        } else if (strcmp(argv[i], "--fixed-frame") == 0) {
+            options.autoFrame = false;
+        } else if (strcmp(argv[i], "--deep") == 0) {
+            options.deep = true;
+        } else if (strcmp(argv[i], "--histogram") == 0) {
+            options.render = RENDER_HISTOGRAM;
+        } else if (strcmp(argv[i], "--verify-orbits") == 0) {
+            options.orbits = ORBITS_GPU;
+            options.verifyOrbits = true;
+        } else {
+            SDL_Log("Unknown option '%s'", argv[i]);
+        }
+    }
+    return options;
+}
+
+/** Closes the stream of --stream, after its last frames are read back. */
+static void closeStream(VideoStream *stream) {
+    if (stream) {
+        stream->close();
+        SDL_Log("Streamed %ld frames, %ld dropped%s", stream->written(), stream->dropped(),
+                stream->failed() ? ", the stream failed" : "");
+        delete stream;
+    }
+}
+
 int main(int argc, char *argv[]) {
-    bool quit = CreateWindow("ChaosGame 0.5.3") != 0;
+    BenchOptions bench;
+    CGameExport job;
+    CGamePoster poster;
+    RunOptions run;
+    CGameOptions options = parseOptions(argc, argv, bench, job, poster, run);
+    job.images = options.images;
+    if (job.directory) {
+        return ExportCGame(options, job) ? 0 : 1;
+    }
+    if (poster.output) {
+        poster.options.toneMap = run.retone;
+        poster.density = options.images.density;
+        return PosterCGame(options, poster) ? 0 : 1;
+    }
+    if (run.retoneInput) {
+        return RetoneCGame(run.retoneInput, run.retoneOutput, run.retone, options.images.format) ? 0 : 1;
+    }
+    if (bench.streamPoints > 0 || bench.histogramPoints > 0 || bench.splatPoints > 0
+        || bench.toneMapPoints > 0 || bench.deepPoints > 0 || bench.spritePoints > 0) {
+        if (bench.streamPoints > 0) {
+            BenchStreamsCGame(bench.streamPoints, 5);
+        }
+        if (bench.histogramPoints > 0) {
+            BenchHistogramCGame(bench.histogramPoints, bench.threads);
+        }
+        if (bench.splatPoints > 0) {
+            BenchSplatCGame(bench.splatPoints, bench.threads);
+        }
+        if (bench.toneMapPoints > 0) {
+            BenchToneMapCGame(bench.toneMapPoints, bench.threads);
+        }
+        if (bench.deepPoints > 0) {
+            BenchDeepCGame(bench.deepPoints);
+        }
+        if (bench.spritePoints > 0) {
+            BenchSpritesCGame(bench.spritePoints, bench.threads);
+        }
+        return 0;
+    }
+    // Before the window, as streaming to stdout moves the logs to stderr.
+    if (run.stream) {
+        options.stream = new VideoStream(run.stream, run.streamFormat, run.backpressure, run.streamFPS);
+    }
+    bool quit = (run.headless ? CreateHeadlessWindow("ChaosGame 0.5.3") : CreateWindow("ChaosGame 0.5.3")) != 0;
 
     if (!quit) {
-        InitCGame();
+        InitCGame(options);
+    }
+    if (!quit && options.verifyOrbits) {
+        const bool passed = VerifyGPUOrbitsCGame();
+        ShutdownCGame();
+        closeStream(options.stream);
+        EGG_Quit();
+        return passed ? 0 : 1;
     }
 
     while (!quit) {
@@ -54,15 +289,45 @@ int main(int argc, char *argv[]) {
                 quit = true;
             } else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_p) {
                 paused = !paused;
+            } else if (event.type == SDL_KEYDOWN) {
+                // Pan with the arrows, zoom with +/-, reset with 0, trails with t and [ ], culling with c,
+                // deep zoom with d, auto framing with f, screenshot with F12, density with F11.
+                switch (event.key.keysym.sym) {
+                    case SDLK_LEFT:  PanCGame(-0.1, 0.0); break;
+                    case SDLK_RIGHT: PanCGame(0.1, 0.0); break;
+                    case SDLK_UP:    PanCGame(0.0, 0.1); break;
+                    case SDLK_DOWN:  PanCGame(0.0, -0.1); break;
+                    case SDLK_EQUALS:
+                    case SDLK_KP_PLUS: ZoomCGame(1.25); break;
+                    case SDLK_MINUS:
+                    case SDLK_KP_MINUS: ZoomCGame(0.8); break;
+                    case SDLK_0: ResetViewCGame(); break;
+                    case SDLK_l: ToggleLODCGame(); break;
+                    case SDLK_c: ToggleCullCGame(); break;
+                    case SDLK_d: ToggleDeepZoomCGame(); break;
+                    case SDLK_f: ToggleAutoFrameCGame(); break;
+                    case SDLK_t: ToggleTrailsCGame(); break;
+                    case SDLK_LEFTBRACKET: ResizeTrailsCGame(-1); break;
+                    case SDLK_RIGHTBRACKET: ResizeTrailsCGame(1); break;
+                    case SDLK_F11: SaveDensityCGame(); break;
+                    case SDLK_F12: ScreenshotCGame(); break;
+                    default: break;
+                }
+            } else if (event.type == SDL_MOUSEWHEEL) {
+                ZoomCGame(event.wheel.y > 0 ? 1.25 : 0.8);
             }
         }
 
         // Render Paul Dunn`s fractal
         if (!RenderCGame())
             break;
+        if (run.frames > 0 && --run.frames == 0) {
+            quit = true;
+        }
     }
 
     ShutdownCGame();
+    closeStream(options.stream);
 
     EGG_Quit();
     return 0;
@@ -1,71 +1,39 @@
 
-#include "chaosgame.hpp"
+#include "chaosgame_state.hpp"
 
 using namespace std;
 using namespace std::chrono;
 
 //#define TEST_THREE
 
-class AttractorSet {
-private:
-    double x, y;
-public:
-    AttractorSet(double x, double y): x(x), y(y) {}
-
-    void setX(double value) { x = value; }
-    void setY(double value) { y = value; }
-
-    double getX() const { return x; }
-    double getY() const { return y; }
-
-};
-
-class AlphaAttractor: public AttractorSet {
-private:
-    double m_a, m_b, m_c, m_d;
-    int iters;
-public:
-    AlphaAttractor(double x, double y,
-                   double a, double b, double c, double d, int iters):
-            AttractorSet(x, y), m_a(a), m_b(b), m_c(c), m_d(d), iters(iters) { }
-    double getA() const { return m_a; }
-    double getB() const { return m_b; }
-    double getC() const { return m_c; }
-    double getD() const { return m_d; }
-
-    int getIterations() const { return iters; }
-
-    void setA(double value) { m_a = value; }
-    void setB(double value) { m_b = value; }
-    void setC(double value) { m_c = value; }
-    void setD(double value) { m_d = value; }
-
-    void updateParams(double a, double b, double c, double d) {
-        this->m_a = a;
-        this->m_b = b;
-        this->m_c = c;
-        this->m_d = d;
-    }
-
-};
-
 namespace CGameGLContext {
-// OpenGL ES 2.0 uses shaders
-//   Intel i3 2.10Ghz with OpenGL 4.4 >
-    constexpr int NUM_PARTICLES = 110240
-#ifdef TEST_ONE
-    * 1;
-#else
-    * 3;
-#endif
-
-    // Packed data storage is better than non-contiguous memory layout!
-    static GLfloat attractor2Data[NUM_PARTICLES * (2 + 2)];
-    static GLint idData[NUM_PARTICLES];
+    int numParticles = DEFAULT_PARTICLES;
+    int slicePoints = DEFAULT_PARTICLES / LOD_SLICES;
+
+    StreamBuffer attractorStream;
+    StreamBuffer idStream;
+    StreamBuffer placementStream;
+    GLfloat *attractor2Data;
+    GLint *idData;
+    GLint *placement;
+
+    GLuint pointBuffer;
+    GLuint idBuffer;
+    int ringFrames = RESIDENT_FRAMES;
+    int headFrame = -1;
+    int residentFrames = 0;
+    int sliceRegion = DEFAULT_PARTICLES / LOD_SLICES * RESIDENT_FRAMES;
+    int layerRegion = DEFAULT_PARTICLES * RESIDENT_FRAMES;
+    int activeSlices = LOD_SLICES;
+
+    GLuint layerBuffer;
+    GLfloat layerData[MAX_ATTRACTORS * 4 * 2];
+
+    GLuint program;
 
     GLint samplerLoc;
-    GLint sensitivityLoc;
-    GLint angleLoc;
+    GLint layerPointsLoc;
+    GLint viewLoc;
 
 };
 
@@ -74,10 +42,8 @@ namespace Parameters {
     AlphaAttractor dream {0.1, 0.1,
                           -0.976918, 2.870979,
                           0.718145, 0.642928,
-                          CGameGLContext::NUM_PARTICLES};
+                          CGameGLContext::DEFAULT_PARTICLES};
 
-    double x = dream.getX();
-    double y = dream.getY();
     const double PHI = (1 + sqrt(5)) / 2;
 
     const double width = 0.7;
@@ -95,10 +61,10 @@ namespace Parameters {
     const double daw = width * 2 / caw;
     const double dah = height / cah;
     double t = 3.0;
+    double tDir = 1.0 / 600.0;
 
     const double aUpperBounds = 5.1;
     const double aLowerBounds = 24.5;
-    constexpr uint screenBackPressure = 10000000;
     bool isScreenDirty = false;
 
     uint dataSent = 0;
@@ -109,54 +75,213 @@ namespace Parameters {
 }
 using namespace Parameters;
 
-extern bool paused;
+namespace Layers {
+    constexpr int N = CGameGLContext::DEFAULT_PARTICLES;
+
+    AttractorLayer layers[CGameGLContext::MAX_ATTRACTORS] = {
+            {dream, dream.getX(), dream.getY(), dream.getA(), 0.0f, 10.0f / 255.0f, 0.0f},
+            // Variations of dream along a and c, the two promising params.
+            {{0.1, 0.1, -1.276918, 2.870979, 0.918145, 0.642928, N}, 0.1, 0.1, -1.276918,
+             0.25f, 8.0f / 255.0f, 0.0f},
+            {{0.1, 0.1, -0.676918, 2.870979, 0.518145, 0.642928, N}, 0.1, 0.1, -0.676918,
+             0.5f, 8.0f / 255.0f, 0.0f},
+            {{0.1, 0.1, -1.576918, 2.870979, 0.318145, 0.642928, N}, 0.1, 0.1, -1.576918,
+             0.75f, 8.0f / 255.0f, 0.0f},
+    };
+    int count = 1;
+
+    WorkerPool *pool = nullptr;
+    std::vector<NumaTopology::NodeCounters> numaStart;
+}
 
-namespace /* std:: */ {
-#define clock_now std::chrono::high_resolution_clock::now
-};
+namespace Seeds {
+    SeedSequence sequence = SEEDS_SOBOL;
+}
 
-/**  Clifford Pickover's Attractor
- *  ------------------------------- \n
- *  Using REL's GlowImage <u>https://rel.phatcode.net</u>
- */
-static void step() {
+namespace Framing {
+    bool enabled = true;
+    ViewFit fit;
+    double framedA[CGameGLContext::MAX_ATTRACTORS];
+}
+
+namespace View {
+    double zoom = 1.0;
+    double panX = 0.0;
+    double panY = 0.0;
+
+    GLfloat matrix[9];
+
+    bool isDirty = false;
+}
+
+namespace LOD {
+    bool enabled = true;
+    double budgetMS = 12.0;
+    double nsPerPoint = 0.0;
+
+    GLuint timeQueries[2];
+    GLint queryPoints[2];
+    int queryIndex = 0;
+
+    std::vector<GLint> firsts;
+    std::vector<GLsizei> counts;
+}
+
+namespace Budget {
+    FrameBudget *frame;
+    int orbitStage;
+    int drawStage;
+    int presentStage;
+    GLint drawnPoints = 0;
+}
+
+namespace Cull {
+    bool enabled = true;
+    CullTransform transform;
+    std::vector<GLint> counts;
+    std::vector<char> packedIds;
+    GLint newest[CGameGLContext::MAX_ATTRACTORS * CGameGLContext::LOD_SLICES];
+    StreamBuffer idStream;
+    GLint *ids;
+    long long stepped = 0, kept = 0;
+    long long totalStepped = 0, totalKept = 0;
+}
+
+void orbit(double &x, double &y, double a, double b, double c, double d,
+           const GLint *placement, int iterations, GLfloat *attractor2Data) {
 
-    CGameGLContext::attractor2Data[0] = (float)x;
-    CGameGLContext::attractor2Data[1] = (float)y;
-    CGameGLContext::idData[0] = 0;
-    static double a = dream.getA();
-    static double b = dream.getB();
-    static double c = dream.getC();
-    static double d = dream.getD();
+    attractor2Data[placement[0] * 4 + 0] = (float)x;
+    attractor2Data[placement[0] * 4 + 1] = (float)y;
     // Author's Note:
     // based on my observation, only param a and c that looks promising to explore;
     // Now i know what the Clifford's Fractal dimensions! ;>
     // It has to be in microscopic (picoscropic, rather) level;
-    for (int i = 1; i < dream.getIterations(); i++) {
-        const double u = std::sin(y * b) + c*std::sin(x * b);
-        const double v = std::sin(x * a) + d*std::sin(y * a);
+    for (int i = 1; i < iterations; i++) {
+        cliffordStep(x, y, a, b, c, d);
 
-        x = u;
-        y = v;
+        // Raw attractor-space point, the fit and view are applied in chaos.vs.
+        const auto vX = static_cast<GLfloat>(x);
+        const auto vY = static_cast<GLfloat>(y);
 
-        const auto vX = static_cast<GLfloat>((x - minX + 0.5) * daw);
-        const auto vY = static_cast<GLfloat>((y - minY + 0.5) * dah + 0.5);
-
-        const int vI = i * 4;
+        const int vI = placement[i] * 4;
+        const int pI = placement[i - 1] * 4;
 //        const int vI = (i + 1) * 4;
-        CGameGLContext::attractor2Data[vI - 2] = vX;
-        CGameGLContext::attractor2Data[vI - 1] = vY;
+        attractor2Data[pI + 2] = vX;
+        attractor2Data[pI + 3] = vY;
 
-        if (i < dream.getIterations() - 1) {
-            CGameGLContext::attractor2Data[vI + 0] = vX;
-            CGameGLContext::attractor2Data[vI + 1] = vY;
+        if (i < iterations - 1) {
+            attractor2Data[vI + 0] = vX;
+            attractor2Data[vI + 1] = vY;
         }
 
-        CGameGLContext::idData[i] = i;
+    }
+}
 
+void step(AttractorLayer &layer, GLfloat *attractor2Data) {
+    double x = layer.x;
+    double y = layer.y;
+    orbit(x, y, layer.a, layer.attractor.getB(), layer.attractor.getC(), layer.attractor.getD(),
+          CGameGLContext::placement, CGameGLContext::activeSlices * CGameGLContext::slicePoints,
+          attractor2Data);
+    layer.x = x;
+    layer.y = y;
+}
+
+/**
+ * Packs the visible points of every active slice of layer k's newest frame, see Cull.
+ */
+static void cull(int k) {
+    using namespace CGameGLContext;
+
+    for (int j = 0; j < activeSlices; j++) {
+        const size_t first = (size_t)k * numParticles + (size_t)j * slicePoints;
+        Cull::newest[k * LOD_SLICES + j] = Cull::enabled
+                ? compactVisible(attractor2Data + first * 4, idData + j * slicePoints, Cull::ids + first,
+                                 slicePoints, Cull::transform)
+                : slicePoints;
+    }
+}
+
+/**
+ * Takes the culling bounds from the current fit and view; a sprite straddling an edge is kept.
+ */
+static void updateCullTransform() {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    const GLint pixels = std::max(std::min(viewport[2], viewport[3]), 1);
+    // Deep zoom points are in clip space already.
+    const ViewFit &fit = Framing::fit;
+    Cull::transform.scaleX = Deep::enabled ? 1.0f : (float)(fit.scaleX * View::zoom);
+    Cull::transform.scaleY = Deep::enabled ? 1.0f : (float)(fit.scaleY * View::zoom);
+    Cull::transform.offsetX = Deep::enabled ? 0.0f : (float)((fit.offsetX + View::panX) * View::zoom);
+    Cull::transform.offsetY = Deep::enabled ? 0.0f : (float)((fit.offsetY + View::panY) * View::zoom);
+    Cull::transform.bound = 1.0f + CGameGLContext::POINT_SIZE / (float)pixels;
+}
+
+ViewFit handTunedFit() {
+    ViewFit fit;
+    fit.scaleX = daw;
+    fit.scaleY = dah;
+    fit.offsetX = (0.5 - minX) * daw;
+    fit.offsetY = (0.5 - minY) * dah + 0.5;
+    return fit;
+}
+
+ViewFit frameAttractors(const AttractorLayer *layers, int count, double aspect, WorkerPool &pool) {
+    using namespace Framing;
+
+    const int perChunk = SAMPLES / CHUNKS;
+    std::vector<double> xs((size_t)SAMPLES), ys((size_t)SAMPLES);
+    pool.parallelFor(CHUNKS, [&](int chunk) {
+        const int k = chunk % count;
+        const AttractorLayer &layer = layers[k];
+        const double a = layer.a, b = layer.attractor.getB();
+        const double c = layer.attractor.getC(), d = layer.attractor.getD();
+        double x, y;
+        OrbitSeeds(Seeds::sequence, (uint64_t)k, layer.x, layer.y, Seeds::RADIUS).seed(chunk / count, x, y);
+        for (int i = -Seeds::BURN_IN; i < perChunk; i++) {
+            cliffordStep(x, y, a, b, c, d);
+            if (i >= 0) {
+                xs[(size_t)chunk * perChunk + i] = x;
+                ys[(size_t)chunk * perChunk + i] = y;
+            }
+        }
+    });
+    return fitBounds(percentileBounds(xs, ys, TAIL), aspect, MARGIN);
+}
+
+void reframe(bool force) {
+    using namespace Framing;
+
+    if (!enabled || Deep::enabled) {
+        return;
+    }
+    // An unframed state takes the new fit, however close to it the one it came with.
+    for (int k = 0; k < Layers::count; k++) {
+        force = force || std::isnan(framedA[k]);
+    }
+    bool drifted = force;
+    for (int k = 0; k < Layers::count && !drifted; k++) {
+        drifted = std::fabs(Layers::layers[k].a - framedA[k]) > A_STEP;
+    }
+    if (!drifted) {
+        return;
+    }
+    for (int k = 0; k < Layers::count; k++) {
+        framedA[k] = Layers::layers[k].a;
+    }
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    const double aspect = (double)std::max(viewport[2], 1) / std::max(viewport[3], 1);
+    const ViewFit next = frameAttractors(Layers::layers, Layers::count, aspect, *Layers::pool);
+    if (force || fitDiffers(fit, next, TOLERANCE)) {
+        fit = next;
+        View::isDirty = true;
     }
-    static double tDir = 1.0 / 600.0;
-    const double aDelta = abs(a - aUpperBounds);
+}
+
+void animate(AttractorLayer *layers, int count, double &t, double &tDir, uint dataSent, bool freezeA) {
+    const double aDelta = abs(layers[0].a - aUpperBounds);
     constexpr double EPSILON = 0.01;
 
     if (dataSent > screenBackPressure * 0.005
@@ -166,18 +291,407 @@ static void step() {
     *3
 #endif
     ) {
-        a = a + tDir * 24.0 * 3.125 * sin(sin(t) * M_PI / 32.0);
-        glUniform1f(CGameGLContext::angleLoc, (float)std::sin(t *PHI *PHI *PHI));
-        dream.setX(x);
-        dream.setY(y);
+        for (int k = 0; k < count; k++) {
+            AttractorLayer &layer = layers[k];
+            if (!freezeA) {
+                layer.a = layer.a + tDir * 24.0 * 3.125 * sin(sin(t) * M_PI / 32.0);
+            }
+            layer.angle = (float)std::sin(t *PHI *PHI *PHI);
+            layer.attractor.setX(layer.x);
+            layer.attractor.setY(layer.y);
+        }
     }
     if (aDelta < EPSILON || abs(aDelta - aLowerBounds) > aLowerBounds) {
         tDir = -(tDir - 1.0);
     }
     t += tDir;
+}
+
+void animate() {
+    // A deep zoom would lose its place if the attractor moved under it.
+    animate(Layers::layers, Layers::count, t, tDir, dataSent, Deep::enabled);
     isScreenDirty = false;
 }
 
+/**
+ * Steps every attractor on the worker pool, then advances the shared animation.
+ */
+static void step() {
+    // Statically scheduled: a layer is always computed by the worker that first touched its stream.
+    updateCullTransform();
+    const DeepFrame frame = deepFrame();
+    Layers::pool->parallelForStatic(Layers::count, [&frame](int k) {
+        GLfloat *staging = CGameGLContext::attractor2Data + k * CGameGLContext::numParticles * 4;
+        if (Deep::enabled) {
+            deepStep(k, staging, frame);
+        } else {
+            step(Layers::layers[k], staging);
+        }
+        cull(k);
+    });
+    animate();
+}
+
+void advanceRing() {
+    using namespace CGameGLContext;
+
+    headFrame = (headFrame + 1) % ringFrames;
+    if (residentFrames < ringFrames) {
+        residentFrames++;
+    }
+}
+
+int slotIndex(int k, int j, int frame) {
+    return (k * CGameGLContext::LOD_SLICES + j) * CGameGLContext::ringFrames + frame;
+}
+
+/**
+ * Uploads `count` ids of one ring slot.
+ */
+static void uploadSlotIds(int k, int j, int frame, const GLint *ids, GLint count) {
+    using namespace CGameGLContext;
+
+    const GLint first = k * layerRegion + j * sliceRegion + frame * slicePoints;
+    glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)first * sizeof(GLint), count * sizeof(GLint), ids);
+}
+
+/**
+ * Streams the survivors of the newest frame into the next slot of the resident ring,
+ * with their ids when culled.
+ */
+static void uploadFrame() {
+    using namespace CGameGLContext;
+
+    advanceRing();
+    long long kept = 0;
+    for (int k = 0; k < Layers::count; k++) {
+        for (int j = 0; j < activeSlices; j++) {
+            const int slot = slotIndex(k, j, headFrame);
+            const GLint count = Cull::newest[k * LOD_SLICES + j];
+            const size_t staged = (size_t)k * numParticles + (size_t)j * slicePoints;
+            Cull::counts[slot] = count;
+            kept += count;
+            if (count > 0) {
+                const GLint first = k * layerRegion + j * sliceRegion + headFrame * slicePoints;
+                glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)first * 4 * sizeof(GLfloat),
+                                (GLsizeiptr)count * 4 * sizeof(GLfloat), attractor2Data + staged * 4);
+            }
+            if (Cull::enabled || Cull::packedIds[slot]) {
+                glBindBuffer(GL_ARRAY_BUFFER, idBuffer);
+                uploadSlotIds(k, j, headFrame, Cull::enabled ? Cull::ids + staged : idData + j * slicePoints,
+                              Cull::enabled ? count : slicePoints);
+                glBindBuffer(GL_ARRAY_BUFFER, pointBuffer);
+                Cull::packedIds[slot] = Cull::enabled;
+            }
+        }
+    }
+    Cull::stepped += (long long)activeSlices * slicePoints * Layers::count;
+    Cull::kept += kept;
+}
+
+void updateLayerUniforms() {
+    using namespace CGameGLContext;
+
+    for (int k = 0; k < Layers::count; k++) {
+        const AttractorLayer &layer = Layers::layers[k];
+        GLfloat *look = layerData + k * 4;
+        look[0] = layer.angle;
+        look[1] = layer.sensitivity;
+        look[2] = layer.hueOffset;
+        look[3] = 0.0f;
+
+        // Deep zoom points need no fit, they are in clip space.
+        GLfloat *fit = layerData + (MAX_ATTRACTORS + k) * 4;
+        fit[0] = Deep::enabled ? 1.0f : (GLfloat)Framing::fit.scaleX;
+        fit[1] = Deep::enabled ? 1.0f : (GLfloat)Framing::fit.scaleY;
+        fit[2] = Deep::enabled ? 0.0f : (GLfloat)Framing::fit.offsetX;
+        fit[3] = Deep::enabled ? 0.0f : (GLfloat)Framing::fit.offsetY;
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, layerBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(layerData), layerData);
+}
+
+void initPlacement(GLint *placement, GLint *idData, int points) {
+    const int slicePoints = points / CGameGLContext::LOD_SLICES;
+    std::mt19937 rng(0x5eed);
+    std::vector<GLint> shuffle(slicePoints);
+    for (int k = 0; k < slicePoints; k++) {
+        shuffle[k] = k;
+    }
+    std::shuffle(shuffle.begin(), shuffle.end(), rng);
+
+    for (int i = 0; i < points; i++) {
+        const int j = i / slicePoints;
+        placement[i] = j * slicePoints + shuffle[i % slicePoints];
+        idData[placement[i]] = i;
+    }
+}
+
+/**
+ * Sizes the staging streams for `particles` points per frame (rounded to whole LOD slices).
+ * @returns false when they cannot be allocated.
+ */
+static bool initStreams(int particles, StreamPages pages, bool touch) {
+    using namespace CGameGLContext;
+
+    if (particles > 0) {
+        numParticles = std::max(particles / LOD_SLICES, 1) * LOD_SLICES;
+    }
+    slicePoints = numParticles / LOD_SLICES;
+    attractorStream = StreamBuffer((size_t)MAX_ATTRACTORS * numParticles * (2 + 2) * sizeof(GLfloat),
+                                   pages, touch);
+    idStream = StreamBuffer((size_t)numParticles * sizeof(GLint), pages);
+    Cull::idStream = StreamBuffer((size_t)MAX_ATTRACTORS * numParticles * sizeof(GLint), pages, touch);
+    placementStream = StreamBuffer((size_t)numParticles * sizeof(GLint), pages);
+    attractor2Data = attractorStream.as<GLfloat>();
+    idData = idStream.as<GLint>();
+    placement = placementStream.as<GLint>();
+    Cull::ids = Cull::idStream.as<GLint>();
+    if (!attractor2Data || !idData || !placement || !Cull::ids) {
+        fprintf(stderr, "Unable to allocate the streams of %d particles.\n", numParticles);
+        return false;
+    }
+    eggLogMessage("%d particles per frame, streams on %s pages\n",
+                  numParticles, streamPagesName(attractorStream.pages()));
+    return true;
+}
+
+/**
+ * First touch: every layer's staging is zeroed by the (pinned) worker that computes it in step(),
+ * so its pages land on that worker's node. With huge pages, a page straddling two layers
+ * goes to whichever touches it first.
+ */
+static void touchStreams() {
+    using namespace CGameGLContext;
+
+    Layers::pool->parallelForStatic(Layers::count, [](int k) {
+        memset(attractor2Data + (size_t)k * numParticles * 4, 0, (size_t)numParticles * 4 * sizeof(GLfloat));
+        memset(Cull::ids + (size_t)k * numParticles, 0, (size_t)numParticles * sizeof(GLint));
+    });
+}
+
+/**
+ * Logs where the pages of every layer's staging are: on the node of its worker, another, or unknown.
+ */
+static void reportPlacement() {
+    using namespace CGameGLContext;
+
+    const NumaTopology &numa = NumaTopology::get();
+    for (int k = 0; k < Layers::count; k++) {
+        const int node = Layers::pool->nodeOf((unsigned)k % Layers::pool->size());
+        const std::vector<long> pages = numa.pagesPerNode(attractor2Data + (size_t)k * numParticles * 4,
+                                                          (size_t)numParticles * 4 * sizeof(GLfloat));
+        long remote = 0;
+        for (int n = 0; n < numa.nodes(); n++) {
+            remote += n == node ? 0 : pages[n];
+        }
+        eggLogMessage("Layer %d on node %d: %ld local, %ld remote, %ld unknown pages\n",
+                      k, node, pages[node], remote, pages[numa.nodes()]);
+    }
+}
+
+GLint activePoints() {
+    return CGameGLContext::activeSlices * CGameGLContext::slicePoints;
+}
+
+/**
+ * Points to draw this frame, out of total: fewer when zoomed out (the points overlap),
+ * and never more than the measured GPU cost allows within LOD::budgetMS.
+ */
+static GLint lodPoints(GLint total) {
+    if (!LOD::enabled) {
+        return total;
+    }
+    double fraction = std::min(View::zoom * View::zoom, 1.0);
+    if (LOD::nsPerPoint > 0.0) {
+        fraction = std::min(fraction, LOD::budgetMS * 1.0e6 / LOD::nsPerPoint / total);
+    }
+    fraction = std::max(fraction, LOD::minFraction);
+    return static_cast<GLint>(total * fraction);
+}
+
+/**
+ * Collects the finished timer query, if any, and starts timing the next draw.
+ */
+static void beginTimedDraw() {
+    const GLuint prev = LOD::timeQueries[LOD::queryIndex ^ 1];
+    GLint available = 0;
+    if (LOD::queryPoints[LOD::queryIndex ^ 1] > 0) {
+        glGetQueryObjectiv(prev, GL_QUERY_RESULT_AVAILABLE, &available);
+    }
+    if (available) {
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(prev, GL_QUERY_RESULT, &ns);
+        const double cost = (double)ns / LOD::queryPoints[LOD::queryIndex ^ 1];
+        LOD::nsPerPoint = LOD::nsPerPoint > 0.0 ? LOD::nsPerPoint * 0.9 + cost * 0.1 : cost;
+        LOD::queryPoints[LOD::queryIndex ^ 1] = 0;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, LOD::timeQueries[LOD::queryIndex]);
+}
+
+static void endTimedDraw() {
+    glEndQuery(GL_TIME_ELAPSED);
+    // Culling may leave fewer points than asked for; the cost is per point drawn.
+    GLint drawn = 0;
+    for (GLsizei count : LOD::counts) {
+        drawn += count;
+    }
+    LOD::queryPoints[LOD::queryIndex] = drawn;
+    LOD::queryIndex ^= 1;
+    Budget::drawnPoints += drawn;
+}
+
+void submitDraws() {
+    if (Histogram::enabled) {
+        splatRanges();
+    } else {
+        glMultiDrawArrays(GL_POINTS, LOD::firsts.data(), LOD::counts.data(),
+                          (GLsizei)LOD::firsts.size());
+    }
+}
+
+GLint addSlot(int k, int j, int frame, GLint limit) {
+    using namespace CGameGLContext;
+
+    const GLint count = std::min(Cull::counts[slotIndex(k, j, frame)], limit);
+    if (count <= 0) {
+        return 0;
+    }
+    const GLint first = k * layerRegion + j * sliceRegion + frame * slicePoints;
+    if (!LOD::firsts.empty() && LOD::firsts.back() + LOD::counts.back() == first) {
+        LOD::counts.back() += count;
+    } else {
+        LOD::firsts.push_back(first);
+        LOD::counts.push_back(count);
+    }
+    return count;
+}
+
+/**
+ * Draws the first `points` resident points of every attractor, region by region,
+ * all attractors in one multi-draw.
+ */
+static void drawResident(GLint points) {
+    using namespace CGameGLContext;
+
+    LOD::firsts.clear();
+    LOD::counts.clear();
+    for (int k = 0; k < Layers::count; k++) {
+        GLint left = points;
+        for (int j = 0; j < activeSlices && left > 0; j++) {
+            for (int f = 0; f < residentFrames && left > 0; f++) {
+                left -= addSlot(k, j, f, left);
+            }
+        }
+    }
+    submitDraws();
+}
+
+/**
+ * Draws the leading slices of every attractor's newest frame.
+ */
+static void drawNewest(GLint points) {
+    using namespace CGameGLContext;
+
+    const int slices = std::max(1, (points + slicePoints - 1) / slicePoints);
+    LOD::firsts.clear();
+    LOD::counts.clear();
+    for (int k = 0; k < Layers::count; k++) {
+        for (int j = 0; j < slices; j++) {
+            addSlot(k, j, headFrame, slicePoints);
+        }
+    }
+    submitDraws();
+}
+
+void ToggleCullCGame() {
+    Cull::enabled = !Cull::enabled;
+    eggLogMessage("Culling %s%s\n", Cull::enabled ? "on" : "off",
+                  GPUOrbits::enabled ? " (CPU orbits only)" : "");
+}
+
+CGameCullStats CullStatsCGame() {
+    CGameCullStats stats;
+    stats.stepped = Cull::totalStepped + Cull::stepped;
+    stats.kept = Cull::totalKept + Cull::kept;
+    stats.culledFraction = stats.stepped > 0 ? 1.0 - (double)stats.kept / stats.stepped : 0.0;
+    return stats;
+}
+
+void ToggleLODCGame() {
+    LOD::enabled = !LOD::enabled;
+    eggLogMessage("LOD %s (%.2f ns per point)\n", LOD::enabled ? "on" : "off", LOD::nsPerPoint);
+    View::isDirty = true;
+}
+
+void resetRing() {
+    CGameGLContext::headFrame = -1;
+    CGameGLContext::residentFrames = 0;
+    std::fill(Cull::counts.begin(), Cull::counts.end(), 0);
+}
+
+void updateViewMatrix() {
+    const auto s = static_cast<GLfloat>(Deep::enabled ? 1.0 : View::zoom);
+    const GLfloat view[9] = {
+            s, 0.0f, 0.0f,
+            0.0f, s, 0.0f,
+            static_cast<GLfloat>(Deep::enabled ? 0.0 : View::zoom * View::panX),
+            static_cast<GLfloat>(Deep::enabled ? 0.0 : View::zoom * View::panY), 1.0f
+    };
+    std::copy(view, view + 9, View::matrix);
+    glUniformMatrix3fv(CGameGLContext::viewLoc, 1, GL_FALSE, view);
+    if (Deep::enabled) {
+        resetRing();
+    }
+    View::isDirty = true;
+}
+
+void PanCGame(double dx, double dy) {
+    // dx, dy are in screen units, so a pan feels the same at any zoom.
+    if (Deep::enabled) {
+        Deep::centerX = Deep::centerX + DD<double>(dx / (View::zoom * Framing::fit.scaleX));
+        Deep::centerY = Deep::centerY + DD<double>(dy / (View::zoom * Framing::fit.scaleY));
+    } else {
+        View::panX -= dx / View::zoom;
+        View::panY -= dy / View::zoom;
+    }
+    updateViewMatrix();
+}
+
+void ZoomCGame(double factor) {
+    View::zoom = std::min(std::max(View::zoom * factor, View::minZoom),
+                          Deep::enabled ? Deep::maxZoom : View::maxZoom);
+    updateViewMatrix();
+}
+
+void centerOfPan(double &x, double &y) {
+    x = -(Framing::fit.offsetX + View::panX) / Framing::fit.scaleX;
+    y = -(Framing::fit.offsetY + View::panY) / Framing::fit.scaleY;
+}
+
+void ResetViewCGame() {
+    View::zoom = 1.0;
+    View::panX = 0.0;
+    View::panY = 0.0;
+    double x, y;
+    centerOfPan(x, y);
+    Deep::centerX = DD<double>(x);
+    Deep::centerY = DD<double>(y);
+    updateViewMatrix();
+}
+
+void ToggleAutoFrameCGame() {
+    Framing::enabled = !Framing::enabled;
+    if (Framing::enabled) {
+        reframe(true);
+    } else {
+        Framing::fit = handTunedFit();
+    }
+    eggLogMessage("Auto framing %s\n", Framing::enabled ? "on" : "off");
+    updateLayerUniforms();
+    updateViewMatrix();
+}
+
 static void enableTexturing() {
 
     glEnable(GL_BLEND);
@@ -187,7 +701,39 @@ static void enableTexturing() {
     glBindTexture(GL_TEXTURE_2D, GetGlowImage());
 }
 
-void InitCGame() {
+void InitCGame(const CGameOptions &options) {
+
+    Layers::count = std::min(std::max(options.attractors, 1), CGameGLContext::MAX_ATTRACTORS);
+    if (!initStreams(options.particles, options.pages, !options.numa)) {
+        SDL_Quit();
+    }
+    Layers::pool = new WorkerPool((unsigned)Layers::count, options.numa);
+    if (options.numa) {
+        touchStreams();
+        eggLogMessage("NUMA: %d nodes, workers pinned round robin\n", NumaTopology::get().nodes());
+        reportPlacement();
+        Layers::numaStart = NumaTopology::get().counters();
+    }
+    CGameGLContext::ringFrames = std::max(2, CGameGLContext::RESIDENT_FRAMES / Layers::count);
+    CGameGLContext::sliceRegion = CGameGLContext::slicePoints * CGameGLContext::ringFrames;
+    CGameGLContext::layerRegion = CGameGLContext::numParticles * CGameGLContext::ringFrames;
+    const size_t slots = (size_t)Layers::count * CGameGLContext::LOD_SLICES * CGameGLContext::ringFrames;
+    Cull::counts.assign(slots, CGameGLContext::slicePoints);
+    Cull::packedIds.assign(slots, 0);
+    Cull::enabled = options.cull;
+    Seeds::sequence = options.seeds;
+    Framing::enabled = options.autoFrame;
+    Framing::fit = handTunedFit();
+    reframe(true);
+    if (options.capture) {
+        Capture::directory = options.capture;
+        Capture::files = true;
+    }
+    Capture::images = options.images;
+    Capture::stream = options.stream;
+    if (options.capture || options.stream) {
+        Capture::everyFrame = startCapture();
+    }
 
     // Creates new OpenGL shader, (330 core)
 
@@ -229,31 +775,101 @@ void InitCGame() {
     eggLogMessage("Uniforms: %d\n", eggGetUniforms(program));
 #endif
 
-    // use program once then delete.
-    // This is a bad practice, as OpenGL contexts might be
-    // lost during the entire program.
-    // I had tested partially the program to
-    // continuously render OpenGL buffers without losing
-    // context. Your program might be different.
-    glDeleteProgram(program);
+    // The program used to be deleted right after its first use; it is kept now,
+    // since the GPU orbit backend switches programs every frame.
+    // It is deleted on ShutdownCGame.
+    CGameGLContext::program = program;
 
     /// Configure the created shader
     CGameGLContext::samplerLoc = glGetUniformLocation(program, "s_texture");
-    CGameGLContext::sensitivityLoc = glGetUniformLocation(program, "u_sensitivity");
-    CGameGLContext::angleLoc = glGetUniformLocation(program,"u_angle");
+    CGameGLContext::layerPointsLoc = glGetUniformLocation(program, "u_layerPoints");
+    CGameGLContext::viewLoc = glGetUniformLocation(program, "u_view");
+    Trails::framesLoc = glGetUniformLocation(program, "u_trailFrames");
+    Trails::headLoc = glGetUniformLocation(program, "u_head");
+    glUniform1i(glGetUniformLocation(program, "u_slicePoints"), CGameGLContext::slicePoints);
+    glUniform1i(glGetUniformLocation(program, "u_ringFrames"), CGameGLContext::ringFrames);
 
     // Print memory usage of attractor data.
-    printf("Using %luMBs +\n", (sizeof(CGameGLContext::attractor2Data) / (1000*1000)
-    + sizeof(CGameGLContext::idData) / (1000*1000)));
+    const GLsizeiptr ringPoints = (GLsizeiptr)CGameGLContext::layerRegion * Layers::count;
+    const GLsizeiptr pointBytes = ringPoints * 4 * sizeof(GLfloat);
+    printf("Using %luMBs + %luMBs resident on GPU (%d attractors)\n",
+           (unsigned long)(CGameGLContext::attractorStream.size() / (1000*1000)),
+           (unsigned long)((pointBytes + ringPoints * sizeof(GLint)) / (1000*1000)),
+           Layers::count);
+
+    // The id of a point is its index within its frame; it never changes, so upload once.
+    initPlacement(CGameGLContext::placement, CGameGLContext::idData, CGameGLContext::numParticles);
+    glGenBuffers(1, &CGameGLContext::idBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, CGameGLContext::idBuffer);
+    glBufferData(GL_ARRAY_BUFFER, ringPoints * sizeof(GLint), nullptr, GL_STATIC_DRAW);
+    for (int k = 0; k < Layers::count; k++) {
+        for (int j = 0; j < CGameGLContext::LOD_SLICES; j++) {
+            for (int f = 0; f < CGameGLContext::ringFrames; f++) {
+                const GLint first = k * CGameGLContext::layerRegion + j * CGameGLContext::sliceRegion
+                                    + f * CGameGLContext::slicePoints;
+                glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)first * sizeof(GLint),
+                                CGameGLContext::slicePoints * sizeof(GLint),
+                                CGameGLContext::idData + j * CGameGLContext::slicePoints);
+            }
+        }
+    }
+    GLint id = glGetAttribLocation(program, "a_id");
+    glEnableVertexAttribArray(id);
+    glVertexAttribPointer(id, 1, GL_INT, GL_TRUE, 0, nullptr);
 
     // Attractor position and previous position attribute on shader
+    glGenBuffers(1, &CGameGLContext::pointBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, CGameGLContext::pointBuffer);
+    glBufferData(GL_ARRAY_BUFFER, pointBytes, nullptr, GL_DYNAMIC_DRAW);
     GLint attractor = glGetAttribLocation(program, "a_data");
     glEnableVertexAttribArray(attractor);
-    glVertexAttribPointer(attractor, 4, GL_FLOAT, GL_FALSE, 0,
-                          CGameGLContext::attractor2Data);
-    GLint id = glGetAttribLocation(program, "a_id");
-    glEnableVertexAttribArray(id);
-    glVertexAttribPointer(id, 1, GL_INT, GL_TRUE, 0, CGameGLContext::idData);
+    glVertexAttribPointer(attractor, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    // Per-attractor parameters live in a uniform buffer; the vertex range picks the attractor.
+    glGenBuffers(1, &CGameGLContext::layerBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, CGameGLContext::layerBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(CGameGLContext::layerData), nullptr, GL_DYNAMIC_DRAW);
+    glUniformBlockBinding(program, glGetUniformBlockIndex(program, "Layers"), 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, CGameGLContext::layerBuffer);
+    glUniform1i(CGameGLContext::layerPointsLoc, CGameGLContext::layerRegion);
+    updateLayerUniforms();
+
+    updateViewMatrix();
+    View::isDirty = false;
+
+    glGenQueries(2, LOD::timeQueries);
+
+    if (options.orbits == ORBITS_GPU) {
+        GPUOrbits::enabled = initGPUOrbits();
+    }
+    eggLogMessage("Orbits on the %s\n", GPUOrbits::enabled ? "GPU (transform feedback)" : "CPU");
+    if (options.render == RENDER_HISTOGRAM) {
+        Histogram::enabled = initHistogram();
+    }
+    eggLogMessage("Rendering %s\n", Histogram::enabled ? "density (compute)" : "sprites");
+    if (options.trails > 0) {
+        Trails::enabled = true;
+        Trails::frames = std::min(options.trails, CGameGLContext::ringFrames);
+        eggLogMessage("Trails of %d frames\n", Trails::frames);
+    }
+    updateTrailUniforms();
+    if (options.deep) {
+        ToggleDeepZoomCGame();
+    }
+    if (options.checkpoints) {
+        Checkpoints::index = new CheckpointIndex("ChaosGame", checkpointStateSize(), options.checkpointInterval,
+                                                 CGameGLContext::numParticles, Seeds::sequence);
+        if (!checkpointable()) {
+            eggLogMessage("Checkpoints need the CPU orbits outside deep zoom\n");
+        }
+    }
+
+    Budget::frame = new FrameBudget(1, CGameGLContext::LOD_SLICES, options.targetMS,
+                                    CGameGLContext::LOD_SLICES);
+    Budget::orbitStage = Budget::frame->addStage("orbits");
+    Budget::drawStage = Budget::frame->addStage("draw");
+    // The swap waits for vsync, whatever the point count.
+    Budget::presentStage = Budget::frame->addStage("present", false);
 
     /// Anecdote: this is a specific OpenGL specification,
     /// i'll try to abstract this on the next release of ..::[Egg2D]::..
@@ -261,13 +877,24 @@ void InitCGame() {
     enableTexturing();
 
     glUniform1i(CGameGLContext::samplerLoc, 0);
-    glUniform1f(CGameGLContext::sensitivityLoc, 10.0f / 255.0f);
 
-    glPointSize(13);
+    glPointSize(CGameGLContext::POINT_SIZE);
 
     setBackgroundColor(0.0f, 0.2f, 0.2f, 0.0f);
     ClearScreen();
-    step();
+    if (!GPUOrbits::enabled) {
+        step();
+    }
+    if (Checkpoints::index) {
+        // A seek only reads the index; a run from the start writes it.
+        if (options.seek >= 0) {
+            if (!Checkpoints::index->load(options.checkpoints) || !SeekCGame((unsigned)options.seek)) {
+                eggLogMessage("Unable to seek to frame %ld with %s\n", options.seek, options.checkpoints);
+            }
+        } else if (!Checkpoints::index->open(options.checkpoints)) {
+            eggLogMessage("Unable to create %s\n", options.checkpoints);
+        }
+    }
 }
 
 
@@ -286,6 +913,16 @@ static void updateTiming(const time_point<system_clock, milliseconds> lastFrameT
 
     if (elapsedMS >= 1000) {
         eggLogMessage("%d FPS, %dms lagged\n", frames, latency);
+        eggLogMessage("%d of %d slices (%s)\n", CGameGLContext::activeSlices,
+                      CGameGLContext::LOD_SLICES, Budget::frame->report().c_str());
+        if (Cull::enabled && Cull::stepped > 0) {
+            eggLogMessage("Culled %.1f%% of %lld points\n",
+                          100.0 * (Cull::stepped - Cull::kept) / Cull::stepped, Cull::stepped);
+        }
+        Cull::totalStepped += Cull::stepped;
+        Cull::totalKept += Cull::kept;
+        Cull::stepped = 0;
+        Cull::kept = 0;
         frames = 0;
         elapsedMS = 0;
         latency = 0;
@@ -293,6 +930,59 @@ static void updateTiming(const time_point<system_clock, milliseconds> lastFrameT
     frames++;
     totalFrames++;
 }
+/**
+ * Advances the orbits by one frame, streaming or computing it into the ring's head slot.
+ */
+static void stepFrame() {
+    recordCheckpoint();
+    reframe(false);
+    if (GPUOrbits::enabled) {
+        stepGPU();
+    } else {
+        step(); // this uses 20% of CPU (margin of -2% !!)
+        uploadFrame();
+    }
+    updateLayerUniforms();
+}
+
+/**
+ * Trails frame: only the newest frame is produced, the older ones are redrawn from the ring.
+ */
+static void renderTrails() {
+    UpdateWindow();
+    Budget::frame->endStage(Budget::presentStage);
+    ClearScreen();
+    if (Histogram::enabled) {
+        clearHistogram();
+    }
+    View::isDirty = false;
+    stepFrame();
+    Budget::frame->endStage(Budget::orbitStage);
+    const int frames = std::min(Trails::frames, CGameGLContext::residentFrames);
+    const GLint points = lodPoints(frames * activePoints() * Layers::count);
+    beginTimedDraw();
+    drawTrail(points / Layers::count);
+    endTimedDraw();
+    if (Histogram::enabled) {
+        resolveHistogram();
+    }
+    Budget::frame->endStage(Budget::drawStage);
+}
+
+/**
+ * Closes the frame's timing and applies the budget to the next frame.
+ */
+static void endBudgetFrame() {
+    if (LOD::nsPerPoint > 0.0) {
+        Budget::frame->setStageMS(Budget::drawStage, LOD::nsPerPoint * Budget::drawnPoints * 1.0e-6);
+    }
+    Budget::drawnPoints = 0;
+    const long slices = Budget::frame->endFrame();
+    // Keyframes are of frames with every slice stepped; the timing is still reported.
+    const bool pinned = Checkpoints::index && checkpointable();
+    CGameGLContext::activeSlices = pinned ? CGameGLContext::LOD_SLICES : static_cast<int>(slices);
+}
+
 /**
  * Render loop.
  */
@@ -310,15 +1000,55 @@ bool RenderCGame() {
 
     if (paused) return true;
 
+    if (Capture::everyFrame) {
+        // Read back at this frame's UpdateWindow, which shows the points drawn by the last one.
+        eggCaptureFrame((long)frameCounter);
+    }
+    Budget::frame->beginFrame();
+    if (Trails::enabled) {
+        renderTrails();
+        endBudgetFrame();
+        frameCounter += 1;
+        updateTiming(std::chrono::time_point_cast<milliseconds, system_clock>(lastDrawTime));
+        lastDrawTime = clock_now();
+        return true;
+    }
     if (dataSent > screenBackPressure) {
         ClearScreen();
+        if (Histogram::enabled) {
+            clearHistogram();
+        }
         dataSent -= screenBackPressure;
         isScreenDirty = true;
     }
+    if (View::isDirty) {
+        // Pan/zoom: redraw the resident points under the new view, no orbit is recomputed.
+        ClearScreen();
+        if (Histogram::enabled) {
+            clearHistogram();
+        }
+        const GLint points = lodPoints(CGameGLContext::residentFrames * activePoints()
+                                       * Layers::count);
+        beginTimedDraw();
+        drawResident(points / Layers::count);
+        endTimedDraw();
+        View::isDirty = false;
+    }
+    Budget::frame->endStage(Budget::drawStage);
     UpdateWindow();
-    step(); // this uses 20% of CPU (margin of -2% !!)
-    glDrawArrays(GL_POINTS, 0, CGameGLContext::NUM_PARTICLES);
-    dataSent += dream.getIterations();
+    Budget::frame->endStage(Budget::presentStage);
+    stepFrame();
+    Budget::frame->endStage(Budget::orbitStage);
+    const GLint points = lodPoints(activePoints() * Layers::count);
+    beginTimedDraw();
+    drawNewest(points / Layers::count);
+    endTimedDraw();
+    if (Histogram::enabled) {
+        resolveHistogram();
+    }
+    Budget::frame->endStage(Budget::drawStage);
+    dataSent += activePoints() * Layers::count;
+    endBudgetFrame();
     frameCounter += 1;
 
     updateTiming(std::chrono::time_point_cast<milliseconds, system_clock>( lastDrawTime));
@@ -333,6 +1063,35 @@ bool RenderCGame() {
 }
 
 void ShutdownCGame() {
+    stopCapture();
+    if (!Layers::numaStart.empty()) {
+        const std::vector<NumaTopology::NodeCounters> now = NumaTopology::get().counters();
+        for (size_t n = 0; n < now.size(); n++) {
+            eggLogMessage("Node %d: %lld local, %lld remote page allocations during the run\n", (int)n,
+                          now[n].local - Layers::numaStart[n].local, now[n].other - Layers::numaStart[n].other);
+        }
+    }
+    glDeleteBuffers(1, &CGameGLContext::pointBuffer);
+    glDeleteBuffers(1, &CGameGLContext::idBuffer);
+    glDeleteBuffers(1, &CGameGLContext::layerBuffer);
+    releaseGPUOrbits();
+    releaseHistogram();
+    glUseProgram(0);
+    glDeleteProgram(CGameGLContext::program);
+    closeCheckpoints();
+    delete Layers::pool;
+    delete Budget::frame;
+    CGameGLContext::attractorStream = StreamBuffer();
+    CGameGLContext::idStream = StreamBuffer();
+    CGameGLContext::placementStream = StreamBuffer();
+    Cull::idStream = StreamBuffer();
+    Layers::pool = nullptr;
+    glDeleteQueries(2, LOD::timeQueries);
+
+    const CGameCullStats cull = CullStatsCGame();
+    if (cull.stepped > 0) {
+        eggLogMessage("Culled %.1f%% of %lld CPU orbit points\n", 100.0 * cull.culledFraction, cull.stepped);
+    }
     eggLogMessage("Rendered %d frames over %.2fs, average of %.2f FPS..\n",
                   totalFrames, (double)totalTimeMS / 1000.0,
                   totalFrames / ((double)totalTimeMS*0.001));
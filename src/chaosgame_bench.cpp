@@ -0,0 +1,361 @@
+#include "chaosgame_state.hpp"
+
+using namespace std::chrono;
+using namespace Parameters;
+
+/**
+ * Start of bench orbit `index` of dream, past the burn-in; the same whichever worker asks.
+ */
+static void benchOrbitStart(int index, double &x, double &y) {
+    const OrbitSeeds seeds(Seeds::sequence, 0, dream.getX(), dream.getY(), Seeds::RADIUS);
+    seeds.seed(index, x, y);
+    for (int i = 0; i < Seeds::BURN_IN; i++) {
+        cliffordStep(x, y, dream.getA(), dream.getB(), dream.getC(), dream.getD());
+    }
+}
+
+void BenchHistogramCGame(int points, unsigned threads) {
+    WorkerPool pool(threads, true);
+    const int workers = (int)pool.size();
+
+    // Pixel streams of every orbit, made up front so only the merge is timed; worker w adds orbits w, w + workers...
+    const int sizes[][2] = {{960, 540}, {1920, 1080}, {3840, 2160}};
+    std::vector<std::vector<uint32_t>> streams(Seeds::ORBITS);
+    printf("Histogram merge of %d points from %d threads\n", points, workers);
+    for (const auto &size : sizes) {
+        const int width = size[0], height = size[1];
+        pool.parallelFor(Seeds::ORBITS, [&](int w) {
+            const int count = (int)((long long)points * (w + 1) / Seeds::ORBITS - (long long)points * w / Seeds::ORBITS);
+            double x, y;
+            benchOrbitStart(w, x, y);
+            streams[w].resize(count);
+            for (int i = 0; i < count; i++) {
+                cliffordStep(x, y, dream.getA(), dream.getB(), dream.getC(), dream.getD());
+                // The attractor stays within +-2 on both axes.
+                const int px = std::min(std::max((int)((x + 2.0) * 0.25 * width), 0), width - 1);
+                const int py = std::min(std::max((int)((y + 2.0) * 0.25 * height), 0), height - 1);
+                streams[w][i] = (uint32_t)py * width + px;
+            }
+        });
+
+        printf("%dx%d, auto picks %s\n", width, height,
+               histogramStrategyName(pickStrategy(pool.size(), width, height)));
+        for (HistogramStrategy strategy : {HISTOGRAM_PRIVATE, HISTOGRAM_TILED, HISTOGRAM_ATOMIC}) {
+            DensityHistogram histogram(width, height, pool, strategy);
+            const auto produce = [&streams](int w, int workers, HistogramSplatter &splatter) {
+                for (int orbit = w; orbit < Seeds::ORBITS; orbit += workers) {
+                    for (uint32_t pixel : streams[orbit]) {
+                        splatter.add(pixel);
+                    }
+                }
+            };
+            // One pass to warm the queues and caches, then the timed ones.
+            histogram.accumulate(produce);
+            histogram.clear();
+            constexpr int passes = 5;
+            const auto started = clock_now();
+            for (int pass = 0; pass < passes; pass++) {
+                histogram.accumulate(produce);
+            }
+            const double seconds = duration_cast<microseconds>(clock_now() - started).count() * 1.0e-6;
+
+            unsigned long long total = 0;
+            for (size_t p = 0; p < (size_t)width * height; p++) {
+                total += histogram.counts()[p];
+            }
+            printf("  %-8s %8.2f Mpoints/s, peak %u%s\n", histogramStrategyName(strategy),
+                   (double)points * passes / seconds * 1.0e-6, histogram.peak(),
+                   total == (unsigned long long)points * passes ? "" : ", COUNTS LOST");
+        }
+    }
+}
+
+/**
+ * `total` orbit points of the current attractor as x, y pairs in [0, 1), one stream per orbit of Seeds::ORBITS;
+ * computed over the pool, the same for any thread count.
+ */
+static std::vector<std::vector<float>> orbitCoordinates(long long total, WorkerPool &pool) {
+    std::vector<std::vector<float>> coordinates(Seeds::ORBITS);
+    pool.parallelFor(Seeds::ORBITS, [&](int w) {
+        const long long count = total * (w + 1) / Seeds::ORBITS - total * w / Seeds::ORBITS;
+        double x, y;
+        benchOrbitStart(w, x, y);
+        coordinates[w].resize((size_t)count * 2);
+        for (long long i = 0; i < count; i++) {
+            cliffordStep(x, y, dream.getA(), dream.getB(), dream.getC(), dream.getD());
+            // The attractor stays within +-2 on both axes.
+            coordinates[w][i * 2] = (float)((x + 2.0) * 0.25);
+            coordinates[w][i * 2 + 1] = (float)((y + 2.0) * 0.25);
+        }
+    });
+    return coordinates;
+}
+
+/**
+ * Splats the orbit points of `coordinates` (x, y pairs in [0, 1)) at `factor` x supersampling,
+ * and box downsamples to width x height.
+ */
+static void splatDensity(const std::vector<std::vector<float>> &coordinates, bool bilinear, int factor,
+                         int width, int height, WorkerPool &pool, std::vector<uint32_t> &density) {
+    DensityHistogram histogram(width * factor, height * factor, pool);
+    histogram.accumulate([&](int w, int workers, HistogramSplatter &splatter) {
+        constexpr int BATCH = 1024;
+        float xs[BATCH], ys[BATCH];
+        for (size_t orbit = w; orbit < coordinates.size(); orbit += workers) {
+            const std::vector<float> &points = coordinates[orbit];
+            for (size_t first = 0; first < points.size() / 2; first += BATCH) {
+                const int count = (int)std::min<size_t>(BATCH, points.size() / 2 - first);
+                for (int i = 0; i < count; i++) {
+                    xs[i] = points[(first + i) * 2] * (float)(width * factor);
+                    ys[i] = points[(first + i) * 2 + 1] * (float)(height * factor);
+                }
+                if (bilinear) {
+                    splatBilinear(splatter, width * factor, height * factor, xs, ys, count);
+                } else {
+                    splatNearest(splatter, width * factor, height * factor, xs, ys, count);
+                }
+            }
+        }
+    });
+    density.resize((size_t)width * height);
+    downsampleBox(histogram.counts(), width * factor, height * factor, factor, density.data(), pool);
+}
+
+void BenchSplatCGame(int points, unsigned threads) {
+    WorkerPool pool(threads, true);
+    constexpr int width = 480, height = 270;
+    // Each mode's reference takes this many times the points, so the error is its sampling noise.
+    constexpr int REFERENCE = 32;
+
+    const std::vector<std::vector<float>> many = orbitCoordinates((long long)points * REFERENCE, pool);
+    const std::vector<std::vector<float>> coordinates = orbitCoordinates(points, pool);
+    printf("%d points into %dx%d, error against %dx the points\n", points, width, height, REFERENCE);
+    const struct { const char *name; bool bilinear; int factor; } modes[] = {
+            {"nearest", false, 1}, {"bilinear", true, 1}, {"bilinear 2x2", true, 2}, {"bilinear 4x4", true, 4}
+    };
+    for (const auto &mode : modes) {
+        std::vector<uint32_t> reference;
+        splatDensity(many, mode.bilinear, mode.factor, width, height, pool, reference);
+        double referenceTotal = 0.0;
+        for (uint32_t n : reference) {
+            referenceTotal += n;
+        }
+
+        std::vector<uint32_t> density;
+        const auto started = clock_now();
+        splatDensity(coordinates, mode.bilinear, mode.factor, width, height, pool, density);
+        const double seconds = duration_cast<microseconds>(clock_now() - started).count() * 1.0e-6;
+
+        // RMS of the normalised densities, relative to the reference's.
+        double total = 0.0;
+        for (uint32_t n : density) {
+            total += n;
+        }
+        double error = 0.0, norm = 0.0;
+        for (size_t p = 0; p < density.size(); p++) {
+            const double r = reference[p] / referenceTotal;
+            const double d = density[p] / total - r;
+            error += d * d;
+            norm += r * r;
+        }
+        printf("  %-13s %8.2f Mpoints/s, relative error %.4f\n", mode.name,
+               points / seconds * 1.0e-6, std::sqrt(error / norm));
+    }
+}
+
+void BenchToneMapCGame(int points, unsigned threads) {
+    WorkerPool pool(threads, true);
+    constexpr int width = 3840, height = 2160;
+    constexpr int PASSES = 5;
+    constexpr size_t pixels = (size_t)width * height;
+
+    std::vector<uint32_t> density;
+    splatDensity(orbitCoordinates(points, pool), true, 1, width, height, pool, density);
+    const uint32_t peak = *std::max_element(density.begin(), density.end());
+    printf("%dx%d from %d points, peak %u, %u threads\n", width, height, points, peak, pool.size());
+
+    const ToneMapper mapper;
+    std::vector<uint8_t> reference8(pixels * 4), rgba8(pixels * 4);
+    std::vector<uint16_t> reference16(pixels * 4), rgba16(pixels * 4);
+    mapper.toRGBA8(density.data(), pixels, peak, reference8.data(), nullptr, TONEMAP_SCALAR);
+    mapper.toRGBA16(density.data(), pixels, peak, reference16.data(), nullptr, TONEMAP_SCALAR);
+
+    // Best of a few passes, so page faults of the first one don't count.
+    const auto time = [&](const std::function<void()> &pass) {
+        double best = 1.0e30;
+        for (int i = 0; i < PASSES; i++) {
+            const auto started = clock_now();
+            pass();
+            best = std::min(best, duration_cast<microseconds>(clock_now() - started).count() * 0.001);
+        }
+        return best;
+    };
+    for (ToneMapPath path = TONEMAP_SCALAR; path <= bestToneMapPath(); path = (ToneMapPath)(path + 1)) {
+        for (WorkerPool *workers : {(WorkerPool *)nullptr, &pool}) {
+            const double ms8 = time([&]() {
+                mapper.toRGBA8(density.data(), pixels, peak, rgba8.data(), workers, path);
+            });
+            const double ms16 = time([&]() {
+                mapper.toRGBA16(density.data(), pixels, peak, rgba16.data(), workers, path);
+            });
+            const bool same = rgba8 == reference8 && rgba16 == reference16;
+            printf("  %-6s %-8s RGBA8 %7.2f ms (%6.2f ms/Mpixel)  RGBA16 %7.2f ms%s\n",
+                   toneMapPathName(path), workers ? "threaded" : "1 thread", ms8, ms8 * 1.0e6 / pixels, ms16,
+                   same ? "" : "  DIFFERS from scalar");
+        }
+    }
+}
+
+void BenchDeepCGame(int points) {
+    std::vector<GLint> order(points);
+    for (int i = 0; i < points; i++) {
+        order[i] = i;
+    }
+    std::vector<GLfloat> data((size_t)points * 4);
+    std::vector<GLint> ids(order), kept(points);
+    const double a = dream.getA(), b = dream.getB(), c = dream.getC(), d = dream.getD();
+    printf("Orbit kernels over %d points\n", points);
+
+    double x = dream.getX(), y = dream.getY();
+    auto started = clock_now();
+    orbit(x, y, a, b, c, d, order.data(), points, data.data());
+    const double doubleNS = duration_cast<nanoseconds>(clock_now() - started).count() / (double)points;
+    printf("  double        %8.2f ns per point\n", doubleNS);
+
+    // Centred on a point of the attractor, so that some points stay in view. No window is framed here.
+    const ViewFit fit = handTunedFit();
+    DeepFrame frame;
+    frame.centerX = DD<double>(x);
+    frame.centerY = DD<double>(y);
+    frame.fitX = fit.scaleX;
+    frame.fitY = fit.scaleY;
+    const CullTransform identity = {1.0f, 1.0f, 0.0f, 0.0f, 1.0f};
+    for (double zoom : {1.0, 1.0e2, 1.0e4}) {
+        DD<double> deepX(dream.getX()), deepY(dream.getY());
+        frame.scaleX = fit.scaleX * zoom;
+        frame.scaleY = fit.scaleY * zoom;
+        started = clock_now();
+        deepOrbit(deepX, deepY, a, b, c, d, order.data(), points, data.data(), frame);
+        const double deepNS = duration_cast<nanoseconds>(clock_now() - started).count() / (double)points;
+        const int visible = compactVisible(data.data(), ids.data(), kept.data(), points, identity);
+        printf("  double-double %8.2f ns per point (%.1fx), x%-6g %d in view\n",
+               deepNS, deepNS / doubleNS, zoom, visible);
+    }
+}
+
+void BenchStreamsCGame(int points, int passes) {
+    points = std::max(points / CGameGLContext::LOD_SLICES, 1) * CGameGLContext::LOD_SLICES;
+    printf("Orbit kernel over %d points, %d passes per page size\n", points, passes);
+
+    TLBMissCounter tlb;
+    if (!tlb.available()) {
+        printf("(dTLB counters unavailable, see /proc/sys/kernel/perf_event_paranoid)\n");
+    }
+    for (StreamPages pages : {PAGES_SMALL, PAGES_TRANSPARENT, PAGES_EXPLICIT}) {
+        const auto allocated = clock_now();
+        StreamBuffer stream((size_t)points * 4 * sizeof(GLfloat), pages);
+        StreamBuffer placement((size_t)points * sizeof(GLint), pages);
+        StreamBuffer ids((size_t)points * sizeof(GLint), pages);
+        if (!stream.data() || !placement.data() || !ids.data()) {
+            printf("%-8s unable to allocate\n", streamPagesName(pages));
+            continue;
+        }
+        initPlacement(placement.as<GLint>(), ids.as<GLint>(), points);
+        const double touchMS = duration_cast<microseconds>(clock_now() - allocated).count() * 0.001;
+
+        double x = dream.getX(), y = dream.getY();
+        // One pass to settle onto the attractor before timing.
+        orbit(x, y, dream.getA(), dream.getB(), dream.getC(), dream.getD(),
+              placement.as<GLint>(), points, stream.as<GLfloat>());
+        tlb.start();
+        const auto started = clock_now();
+        for (int pass = 0; pass < passes; pass++) {
+            orbit(x, y, dream.getA(), dream.getB(), dream.getC(), dream.getD(),
+                  placement.as<GLint>(), points, stream.as<GLfloat>());
+        }
+        const double seconds = duration_cast<microseconds>(clock_now() - started).count() * 1.0e-6;
+        const long long misses = tlb.stop();
+
+        printf("%-8s on %-8s first touch %7.1fms, %7.2f Mpoints/s",
+               streamPagesName(pages), streamPagesName(stream.pages()), touchMS,
+               (double)points * passes / seconds * 1.0e-6);
+        if (misses >= 0) {
+            printf(", %.4f dTLB misses per point", (double)misses / ((double)points * passes));
+        }
+        printf("\n");
+    }
+}
+
+void BenchSpritesCGame(int points, unsigned threads) {
+    using namespace CGameGLContext;
+    constexpr int width = 1920, height = 1080;
+    constexpr int FRAMES = 8, LAYERS = 3;
+    // Chunks of the vertex stage handed to the pool.
+    constexpr int CHUNK = 8192;
+
+    int glowWidth, glowHeight;
+    const char *glow = eggLoadPCM(NULL, "./glow_image.pcm", &glowWidth, &glowHeight);
+    if (!glow) {
+        fprintf(stderr, "The sprite bench needs glow_image.pcm in the working directory.\n");
+        return;
+    }
+    const GlowKernel kernel((const uint8_t *)glow, glowWidth, glowHeight, (int)POINT_SIZE);
+
+    // FRAMES frames of three attractors, as at --attractors 3, drawn without clearing in between.
+    const int perLayer = std::max(points / LAYERS, 1);
+    std::vector<GLint> order((size_t)perLayer);
+    for (int i = 0; i < perLayer; i++) {
+        order[i] = i;
+    }
+    std::vector<GLfloat> data((size_t)FRAMES * LAYERS * perLayer * 4);
+    AttractorLayer layers[LAYERS] = {Layers::layers[0], Layers::layers[1], Layers::layers[2]};
+    for (int f = 0; f < FRAMES; f++) {
+        for (int k = 0; k < LAYERS; k++) {
+            AttractorLayer &layer = layers[k];
+            orbit(layer.x, layer.y, layer.a, layer.attractor.getB(), layer.attractor.getC(), layer.attractor.getD(),
+                  order.data(), perLayer, data.data() + ((size_t)f * LAYERS + k) * perLayer * 4);
+        }
+    }
+    const ViewFit fit = handTunedFit();
+    printf("%d sprites of %dpx per frame into %dx%d, %d frames\n", perLayer * LAYERS, kernel.size(),
+           width, height, FRAMES);
+
+    std::vector<uint8_t> reference;
+    for (unsigned count : {1u, threads}) {
+        WorkerPool pool(count, true);
+        if (!reference.empty() && pool.size() == 1) {
+            break;
+        }
+        SpriteRasterizer raster(width, height, pool);
+        raster.clear(0.0f, 0.2f, 0.2f, 0.0f);
+        std::vector<Sprite> sprites((size_t)LAYERS * perLayer);
+        const int chunks = (perLayer + CHUNK - 1) / CHUNK;
+        double vertexMS = 0.0, rasterMS = 0.0;
+        for (int f = 0; f < FRAMES; f++) {
+            auto started = clock_now();
+            pool.parallelFor(LAYERS * chunks, [&](int task) {
+                const int k = task / chunks, first = task % chunks * CHUNK;
+                const int n = std::min(CHUNK, perLayer - first);
+                const size_t offset = (size_t)k * perLayer + first;
+                spriteVertices(data.data() + ((size_t)f * LAYERS * perLayer + offset) * 4, n, spriteLook(layers[k]),
+                               fit, width, height, sprites.data() + offset);
+            });
+            vertexMS += duration_cast<microseconds>(clock_now() - started).count() * 0.001;
+            started = clock_now();
+            raster.draw(sprites.data(), sprites.size(), kernel, SPRITE_CHAOS);
+            rasterMS += duration_cast<microseconds>(clock_now() - started).count() * 0.001;
+        }
+        const size_t bytes = (size_t)width * height * 4;
+        size_t differing = 0;
+        if (reference.empty()) {
+            reference.assign(raster.pixels(), raster.pixels() + bytes);
+        } else {
+            for (size_t i = 0; i < bytes; i++) {
+                differing += reference[i] != raster.pixels()[i];
+            }
+        }
+        printf("%2u threads: vertex %6.2fms, raster %7.2fms per frame, %6.1fM sprites/s%s\n", pool.size(),
+               vertexMS / FRAMES, rasterMS / FRAMES, sprites.size() * FRAMES / ((vertexMS + rasterMS) * 1000.0),
+               differing > 0 ? ", DIFFERS from 1 thread" : "");
+    }
+}
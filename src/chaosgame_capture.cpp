@@ -0,0 +1,68 @@
+#include "chaosgame_state.hpp"
+
+using namespace Parameters;
+
+namespace Capture {
+    const char *directory = ".";
+    bool started = false;
+    bool everyFrame = false;
+    bool files = false;
+    long screenshot = -1;
+    VideoStream *stream = nullptr;
+    ImageSequenceOptions images;
+    ImageSequenceWriter *writer = nullptr;
+}
+
+/**
+ * Hands a frame of the capture ring to the stream and the encoder threads; called from
+ * UpdateWindow, or eggCaptureStop at the end.
+ */
+static void writeCapture(const unsigned char *rgba, int width, int height, long frame, void *) {
+    if (Capture::stream) {
+        Capture::stream->push(rgba, width, height);
+    }
+    if (!Capture::files && frame != Capture::screenshot) {
+        return;
+    }
+    if (!Capture::writer) {
+        Capture::writer = new ImageSequenceWriter(Capture::directory, Capture::images);
+    }
+    Capture::writer->push(rgba, width, height, true, frame);
+}
+
+bool startCapture() {
+    if (!Capture::started) {
+        const int async = eggCaptureStart(3, writeCapture, nullptr);
+        Capture::started = async >= 0;
+        if (async == 0) {
+            eggLogMessage("No pixel-pack buffers or fences: frames are captured synchronously\n");
+        }
+    }
+    return Capture::started;
+}
+
+void ScreenshotCGame() {
+    if (startCapture()) {
+        Capture::screenshot = (long)frameCounter;
+        eggCaptureFrame(Capture::screenshot);
+    }
+}
+
+void stopCapture() {
+    if (!Capture::started) {
+        return;
+    }
+    // Writes the frames still in flight.
+    eggCaptureStop();
+    if (Capture::writer) {
+        Capture::writer->finish();
+        const ImageSequenceWriter::Stats written = Capture::writer->stats();
+        eggLogMessage("Captured %ld frames into %s, %.1f MB/s, %.0f MB held at most, %ld dropped by the readback%s\n",
+                      written.frames, Capture::directory, written.bytes * 1.0e-6 / written.seconds,
+                      written.peakMemory * 1.0e-6, eggCaptureDropped(), written.failed > 0 ? ", SOME NOT WRITTEN" : "");
+        delete Capture::writer;
+        Capture::writer = nullptr;
+    }
+    Capture::started = false;
+    Capture::stream = nullptr;
+}
@@ -0,0 +1,143 @@
+#include "chaosgame_state.hpp"
+
+using namespace Parameters;
+
+namespace Checkpoints {
+    CheckpointIndex *index = nullptr;
+}
+
+bool checkpointable() {
+    return !GPUOrbits::enabled && !Deep::enabled;
+}
+
+int checkpointStateSize() {
+    return Checkpoints::SHARED_STATE + Checkpoints::LAYER_STATE * Layers::count;
+}
+
+AnimationState liveState() {
+    AnimationState state;
+    state.t = t;
+    state.tDir = tDir;
+    state.dataSent = dataSent;
+    state.fit = Framing::fit;
+    state.layers.assign(Layers::layers, Layers::layers + Layers::count);
+    state.framedA.assign(Framing::framedA, Framing::framedA + Layers::count);
+    return state;
+}
+
+void packState(const AnimationState &from, double *state) {
+    state[0] = from.t;
+    state[1] = from.tDir;
+    state[2] = from.dataSent;
+    state[3] = from.fit.scaleX;
+    state[4] = from.fit.scaleY;
+    state[5] = from.fit.offsetX;
+    state[6] = from.fit.offsetY;
+    for (int k = 0; k < Layers::count; k++) {
+        const AttractorLayer &layer = from.layers[k];
+        double *s = state + Checkpoints::SHARED_STATE + k * Checkpoints::LAYER_STATE;
+        s[0] = layer.x;
+        s[1] = layer.y;
+        s[2] = layer.a;
+        s[3] = layer.angle;
+        s[4] = from.framedA[k];
+    }
+}
+
+void unpackState(const double *state, AnimationState &to) {
+    to.t = state[0];
+    to.tDir = state[1];
+    to.dataSent = (uint)state[2];
+    to.fit.scaleX = state[3];
+    to.fit.scaleY = state[4];
+    to.fit.offsetX = state[5];
+    to.fit.offsetY = state[6];
+    for (int k = 0; k < Layers::count; k++) {
+        AttractorLayer &layer = to.layers[k];
+        const double *s = state + Checkpoints::SHARED_STATE + k * Checkpoints::LAYER_STATE;
+        layer.x = s[0];
+        layer.y = s[1];
+        layer.a = s[2];
+        layer.angle = (GLfloat)s[3];
+        to.framedA[k] = s[4];
+        layer.attractor.setX(layer.x);
+        layer.attractor.setY(layer.y);
+    }
+}
+
+static void saveState(double *state) {
+    packState(liveState(), state);
+}
+
+static void restoreState(const double *state) {
+    AnimationState live = liveState();
+    unpackState(state, live);
+    t = live.t;
+    tDir = live.tDir;
+    dataSent = live.dataSent;
+    Framing::fit = live.fit;
+    std::copy(live.layers.begin(), live.layers.end(), Layers::layers);
+    std::copy(live.framedA.begin(), live.framedA.end(), Framing::framedA);
+}
+
+void countSent(uint &sent, long points) {
+    sent += (uint)points;
+    if (sent > screenBackPressure) {
+        sent -= screenBackPressure;
+    }
+}
+
+void recordCheckpoint() {
+    if (Checkpoints::index && checkpointable() && Checkpoints::index->due(frameCounter)) {
+        std::vector<double> state((size_t)checkpointStateSize());
+        saveState(state.data());
+        Checkpoints::index->record(frameCounter, state.data());
+    }
+}
+
+/**
+ * What a frame of RenderCGame() does to the animation state, from one frame's checkpoint to the
+ * next's, with nothing culled, uploaded or drawn.
+ */
+static void advanceFrame() {
+    reframe(false);
+    Layers::pool->parallelForStatic(Layers::count, [](int k) {
+        step(Layers::layers[k], CGameGLContext::attractor2Data + k * CGameGLContext::numParticles * 4);
+    });
+    animate();
+    if (!Trails::enabled) {
+        countSent(dataSent, (long)activePoints() * Layers::count);
+    }
+    frameCounter++;
+}
+
+bool SeekCGame(unsigned frame) {
+    uint64_t keyFrame;
+    std::vector<double> state;
+    if (!Checkpoints::index || !checkpointable() || !Checkpoints::index->nearest(frame, keyFrame, state)) {
+        return false;
+    }
+    restoreState(state.data());
+    frameCounter = (unsigned)keyFrame;
+    while (frameCounter < frame) {
+        advanceFrame();
+    }
+    // Nothing resident or on screen belongs to the new frame.
+    resetRing();
+    ClearScreen();
+    if (Histogram::enabled) {
+        clearHistogram();
+    }
+    updateLayerUniforms();
+    eggLogMessage("Seeked to frame %u from the keyframe of frame %llu\n", frame, (unsigned long long)keyFrame);
+    return true;
+}
+
+void closeCheckpoints() {
+    if (Checkpoints::index) {
+        eggLogMessage("%zu keyframes, one every %d frames\n", Checkpoints::index->count(),
+                      Checkpoints::index->interval());
+        delete Checkpoints::index;
+        Checkpoints::index = nullptr;
+    }
+}
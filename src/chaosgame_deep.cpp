@@ -0,0 +1,91 @@
+#include "chaosgame_state.hpp"
+
+namespace Deep {
+    bool enabled = false;
+    DD<double> centerX, centerY;
+    DD<double> x[CGameGLContext::MAX_ATTRACTORS];
+    DD<double> y[CGameGLContext::MAX_ATTRACTORS];
+}
+
+void deepOrbit(DD<double> &x, DD<double> &y, double a, double b, double c, double d,
+               const GLint *placement, int iterations, GLfloat *attractor2Data, const DeepFrame &frame) {
+    const Double4 params(b, b, a, a);
+    GLfloat clipX = (GLfloat)((x - frame.centerX) * frame.scaleX).hi;
+    GLfloat clipY = (GLfloat)((y - frame.centerY) * frame.scaleY).hi;
+    attractor2Data[placement[0] * 4 + 0] = clipX;
+    attractor2Data[placement[0] * 4 + 1] = clipY;
+    for (int i = 1; i < iterations; i++) {
+        const DD<Double4> args = DD<Double4>(Double4(y.hi, x.hi, x.hi, y.hi),
+                                             Double4(y.lo, x.lo, x.lo, y.lo)) * params;
+        const DD<Double4> sines = sin(args);
+        double hi[4], lo[4];
+        sines.hi.store(hi);
+        sines.lo.store(lo);
+        const DD<double> u = DD<double>(hi[0], lo[0]) + DD<double>(hi[1], lo[1]) * c;
+        const DD<double> v = DD<double>(hi[2], lo[2]) + DD<double>(hi[3], lo[3]) * d;
+        const double stepX = (u.hi - x.hi) + (u.lo - x.lo);
+        const double stepY = (v.hi - y.hi) + (v.lo - y.lo);
+        x = u;
+        y = v;
+
+        const int vI = placement[i] * 4;
+        const int pI = placement[i - 1] * 4;
+        attractor2Data[pI + 2] = clipX + (GLfloat)(stepX * frame.fitX);
+        attractor2Data[pI + 3] = clipY + (GLfloat)(stepY * frame.fitY);
+        clipX = (GLfloat)((x - frame.centerX) * frame.scaleX).hi;
+        clipY = (GLfloat)((y - frame.centerY) * frame.scaleY).hi;
+        if (i < iterations - 1) {
+            attractor2Data[vI + 0] = clipX;
+            attractor2Data[vI + 1] = clipY;
+        }
+    }
+}
+
+DeepFrame deepFrame() {
+    DeepFrame frame;
+    frame.centerX = Deep::centerX;
+    frame.centerY = Deep::centerY;
+    frame.scaleX = Framing::fit.scaleX * View::zoom;
+    frame.scaleY = Framing::fit.scaleY * View::zoom;
+    frame.fitX = Framing::fit.scaleX;
+    frame.fitY = Framing::fit.scaleY;
+    return frame;
+}
+
+void deepStep(int k, GLfloat *attractor2Data, const DeepFrame &frame) {
+    const AttractorLayer &layer = Layers::layers[k];
+    deepOrbit(Deep::x[k], Deep::y[k], layer.a, layer.attractor.getB(), layer.attractor.getC(),
+              layer.attractor.getD(), CGameGLContext::placement,
+              CGameGLContext::activeSlices * CGameGLContext::slicePoints, attractor2Data, frame);
+}
+
+void ToggleDeepZoomCGame() {
+    if (GPUOrbits::enabled) {
+        eggLogMessage("Deep zoom needs the CPU orbits\n");
+        return;
+    }
+    Deep::enabled = !Deep::enabled;
+    if (Deep::enabled) {
+        double x, y;
+        centerOfPan(x, y);
+        Deep::centerX = DD<double>(x);
+        Deep::centerY = DD<double>(y);
+        for (int k = 0; k < Layers::count; k++) {
+            Deep::x[k] = DD<double>(Layers::layers[k].x);
+            Deep::y[k] = DD<double>(Layers::layers[k].y);
+        }
+    } else {
+        // Back to the float view: the centre keeps what a double holds, the zoom what a float does.
+        View::panX = -Deep::centerX.hi * Framing::fit.scaleX - Framing::fit.offsetX;
+        View::panY = -Deep::centerY.hi * Framing::fit.scaleY - Framing::fit.offsetY;
+        View::zoom = std::min(View::zoom, View::maxZoom);
+        for (int k = 0; k < Layers::count; k++) {
+            Layers::layers[k].x = Deep::x[k].hi;
+            Layers::layers[k].y = Deep::y[k].hi;
+        }
+    }
+    eggLogMessage("Deep zoom %s (x%.3g)\n", Deep::enabled ? "on" : "off", View::zoom);
+    resetRing();
+    updateLayerUniforms();
+    updateViewMatrix();
+}
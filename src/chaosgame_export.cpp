@@ -0,0 +1,228 @@
+#include "chaosgame_state.hpp"
+
+using namespace std::chrono;
+
+/**
+ * advanceFrame() of an export's own state, on the calling thread: the orbits of every attractor
+ * into `points` (x, y, next x, next y of `perFrame` points per attractor), then the drift.
+ */
+static void advanceExport(AnimationState &state, int perFrame, const GLint *order, GLfloat *points) {
+    for (int k = 0; k < Layers::count; k++) {
+        AttractorLayer &layer = state.layers[k];
+        orbit(layer.x, layer.y, layer.a, layer.attractor.getB(), layer.attractor.getC(), layer.attractor.getD(),
+              order, perFrame, points + (size_t)k * perFrame * 4);
+    }
+    animate(state.layers.data(), Layers::count, state.t, state.tDir, state.dataSent, false);
+    countSent(state.dataSent, (long)perFrame * Layers::count);
+}
+
+/**
+ * The state at the start of frame 0: InitCGame() steps the orbits once before the first frame.
+ * An export frames its own camera, so its keyframes leave the attractors unframed for a live seek.
+ */
+static AnimationState firstExportState(int perFrame, const GLint *order, GLfloat *points) {
+    AnimationState state = liveState();
+    state.fit = handTunedFit();
+    for (int k = 0; k < Layers::count; k++) {
+        AttractorLayer &layer = state.layers[k];
+        state.framedA[k] = NAN;
+        orbit(layer.x, layer.y, layer.a, layer.attractor.getB(), layer.attractor.getC(), layer.attractor.getD(),
+              order, perFrame, points + (size_t)k * perFrame * 4);
+    }
+    animate(state.layers.data(), Layers::count, state.t, state.tDir, state.dataSent, false);
+    return state;
+}
+
+/**
+ * Makes sure the index has the keyframe of every segment start from firstKey to lastKey,
+ * running the animation in order from the last keyframe before each missing one.
+ * @return the frames run.
+ */
+static long fillKeyframes(CheckpointIndex &index, long firstKey, long lastKey, int perFrame,
+                          const GLint *order, GLfloat *points) {
+    long run = 0;
+    std::vector<double> packed((size_t)checkpointStateSize());
+    for (long key = firstKey; key <= lastKey; key += index.interval()) {
+        if (!index.due((uint64_t)key)) {
+            continue;
+        }
+        uint64_t from = 0;
+        AnimationState state = firstExportState(perFrame, order, points);
+        if (index.nearest((uint64_t)key, from, packed)) {
+            unpackState(packed.data(), state);
+        }
+        for (long frame = (long)from; ; frame++) {
+            if (index.due((uint64_t)frame)) {
+                packState(state, packed.data());
+                index.record((uint64_t)frame, packed.data());
+            }
+            if (frame == key) {
+                break;
+            }
+            advanceExport(state, perFrame, order, points);
+            run++;
+        }
+    }
+    return run;
+}
+
+bool ExportCGame(const CGameOptions &options, const CGameExport &job) {
+    using namespace CGameGLContext;
+
+    Layers::count = std::min(std::max(options.attractors, 1), MAX_ATTRACTORS);
+    Seeds::sequence = options.seeds;
+    // The live frame with every slice, as while checkpointing.
+    const int perFrame = options.particles > 0 ? std::max(options.particles / LOD_SLICES, 1) * LOD_SLICES
+                                               : DEFAULT_PARTICLES;
+    const long first = std::max(options.seek, 0L);
+    const long last = first + std::max(job.frames, 0L);
+    if (!job.directory || last == first || job.width <= 0 || job.height <= 0) {
+        fprintf(stderr, "Nothing to export.\n");
+        return false;
+    }
+    const bool sprites = job.render == RENDER_SPRITES;
+    if (sprites && (job.images.format == IMAGE_PNG16 || job.images.density != DENSITY_NONE)) {
+        fprintf(stderr, "Sprites are exported in 8 bits, with no density.\n");
+        return false;
+    }
+    int glowWidth = 0, glowHeight = 0;
+    const char *glow = sprites ? eggLoadPCM(NULL, "./glow_image.pcm", &glowWidth, &glowHeight) : nullptr;
+    if (sprites && !glow) {
+        fprintf(stderr, "Exporting sprites needs glow_image.pcm in the working directory.\n");
+        return false;
+    }
+
+    CheckpointIndex index("ChaosGame", checkpointStateSize(), options.checkpointInterval, perFrame,
+                          Seeds::sequence);
+    if (options.checkpoints) {
+        FILE *existing = fopen(options.checkpoints, "rb");
+        if (existing) {
+            fclose(existing);
+            if (!index.load(options.checkpoints)) {
+                fprintf(stderr, "%s is not an index of %d attractors of %d points seeded by %s.\n",
+                        options.checkpoints, Layers::count, perFrame, seedSequenceName(Seeds::sequence));
+                return false;
+            }
+        }
+        // New keyframes are kept for the next export or seek.
+        if (!index.open(options.checkpoints)) {
+            fprintf(stderr, "Unable to write %s.\n", options.checkpoints);
+        }
+    }
+    const int interval = index.interval();
+    const long firstKey = first / interval * interval;
+    const long lastKey = (last - 1) / interval * interval;
+
+    std::vector<GLint> order((size_t)perFrame);
+    for (int i = 0; i < perFrame; i++) {
+        order[i] = i;
+    }
+    std::vector<GLfloat> points((size_t)Layers::count * perFrame * 4);
+    auto started = clock_now();
+    const long filled = fillKeyframes(index, firstKey, lastKey, perFrame, order.data(), points.data());
+    const double fillSeconds = duration_cast<milliseconds>(clock_now() - started).count() * 0.001;
+    if (filled > 0) {
+        printf("Ran %ld frames in order for the missing keyframes, %.2fs\n", filled, fillSeconds);
+    }
+
+    // One camera for the whole export, framed at its first keyframe, so that the shot holds still.
+    WorkerPool pool(job.threads);
+    uint64_t key;
+    std::vector<double> packed((size_t)checkpointStateSize());
+    AnimationState framed = liveState();
+    index.nearest((uint64_t)firstKey, key, packed);
+    unpackState(packed.data(), framed);
+    const ViewFit fit = options.autoFrame
+                        ? frameAttractors(framed.layers.data(), Layers::count, (double)job.width / job.height, pool)
+                        : handTunedFit();
+
+    // Segments start at keyframes, so each runs on its own worker from its own copy of the state.
+    const int segments = (int)((lastKey - firstKey) / interval + 1);
+    printf("Exporting frames %ld to %ld at %dx%d, %d segments over %u threads\n",
+           first, last - 1, job.width, job.height, segments, pool.size());
+    ImageSequenceWriter writer(job.directory, job.images);
+    started = clock_now();
+    pool.parallelFor(segments, [&](int segment) {
+        const long start = firstKey + (long)segment * interval;
+        const long end = std::min(last, start + interval);
+        uint64_t keyFrame;
+        std::vector<double> state((size_t)checkpointStateSize());
+        index.nearest((uint64_t)start, keyFrame, state);
+        AnimationState animation = liveState();
+        unpackState(state.data(), animation);
+
+        // Private to the segment: its histogram merges nothing, its buffers are reused frame to frame.
+        WorkerPool alone(1);
+        if (sprites) {
+            const GlowKernel kernel((const uint8_t *)glow, glowWidth, glowHeight, (int)POINT_SIZE);
+            SpriteRasterizer raster(job.width, job.height, alone);
+            std::vector<GLfloat> frame((size_t)Layers::count * perFrame * 4);
+            std::vector<Sprite> drawn((size_t)Layers::count * perFrame);
+            for (long f = start; f < end; f++) {
+                // Coloured after the drift, as step() leaves the uniforms of the frame it draws.
+                advanceExport(animation, perFrame, order.data(), frame.data());
+                if (f < first) {
+                    continue;
+                }
+                raster.clear(0.0f, 0.2f, 0.2f, 0.0f);
+                for (int k = 0; k < Layers::count; k++) {
+                    const size_t offset = (size_t)k * perFrame;
+                    spriteVertices(frame.data() + offset * 4, perFrame, spriteLook(animation.layers[k]), fit,
+                                   job.width, job.height, drawn.data() + offset);
+                }
+                raster.draw(drawn.data(), drawn.size(), kernel, SPRITE_CHAOS);
+                writer.push(raster.pixels(), job.width, job.height, false, f);
+            }
+            return;
+        }
+        DensityHistogram histogram(job.width, job.height, alone, HISTOGRAM_PRIVATE);
+        const ToneMapper mapper;
+        std::vector<GLfloat> frame((size_t)Layers::count * perFrame * 4);
+        const bool deep = job.images.format == IMAGE_PNG16;
+        std::vector<uint8_t> rgba(deep ? 0 : (size_t)job.width * job.height * 4);
+        std::vector<uint16_t> rgba16(deep ? (size_t)job.width * job.height * 4 : 0);
+        const float halfWidth = job.width * 0.5f, halfHeight = job.height * 0.5f;
+        for (long f = start; f < end; f++) {
+            advanceExport(animation, perFrame, order.data(), frame.data());
+            if (f < first) {
+                continue;
+            }
+            histogram.clear();
+            histogram.accumulate([&](int, int, HistogramSplatter &splatter) {
+                constexpr int BATCH = 1024;
+                float xs[BATCH], ys[BATCH];
+                const size_t total = (size_t)Layers::count * perFrame;
+                for (size_t p = 0; p < total; p += BATCH) {
+                    const int count = (int)std::min<size_t>(BATCH, total - p);
+                    for (int i = 0; i < count; i++) {
+                        const GLfloat *point = frame.data() + (p + i) * 4;
+                        // Clip space to pixels, rows from the top.
+                        xs[i] = (float)((point[0] * fit.scaleX + fit.offsetX + 1.0) * halfWidth);
+                        ys[i] = (float)((1.0 - (point[1] * fit.scaleY + fit.offsetY)) * halfHeight);
+                    }
+                    splatBilinear(splatter, job.width, job.height, xs, ys, count);
+                }
+            });
+            const size_t pixels = (size_t)job.width * job.height;
+            // Encoded and written by the writer's threads; this one goes on to the next frame.
+            if (deep) {
+                mapper.toRGBA16(histogram.counts(), pixels, histogram.peak(), rgba16.data());
+                writer.push16(rgba16.data(), job.width, job.height, false, f);
+            } else {
+                mapper.toRGBA8(histogram.counts(), pixels, histogram.peak(), rgba.data());
+                writer.push(rgba.data(), job.width, job.height, false, f);
+            }
+            if (job.images.density != DENSITY_NONE) {
+                writer.pushDensity(histogram.counts(), job.width, job.height, histogram.peak(), false, f);
+            }
+        }
+    });
+    const double rendered = duration_cast<milliseconds>(clock_now() - started).count() * 0.001;
+    writer.finish();
+    const ImageSequenceWriter::Stats written = writer.stats();
+    printf("Rendered in %.2fs, wrote %ld files in %.2fs, %.2f files/s, %.1f MB/s; "
+           "%.0f MB held at most, %.2fs waited for it%s\n", rendered, written.frames, written.seconds,
+           written.frames / written.seconds, written.bytes * 1.0e-6 / written.seconds, written.peakMemory * 1.0e-6,
+           written.waitSeconds, written.failed > 0 ? ", SOME FAILED" : "");
+    return written.failed == 0;
+}
@@ -0,0 +1,216 @@
+#include "chaosgame_state.hpp"
+
+namespace GPUOrbits {
+    bool enabled = false;
+
+    GLuint program;
+    GLuint vertexArray;
+    GLint paramsLoc;
+    GLint stateLoc;
+    GLuint stateBuffers[CGameGLContext::MAX_ATTRACTORS][2];
+    int current[CGameGLContext::MAX_ATTRACTORS];
+}
+
+/**
+ * Runs `steps` transform feedback passes over attractor k's orbits;
+ * pass j captures its points into LOD slice j of the head slot.
+ */
+static void runOrbitPasses(int k, int steps) {
+    using namespace CGameGLContext;
+    using namespace GPUOrbits;
+
+    const AttractorLayer &layer = Layers::layers[k];
+    glUniform4f(paramsLoc, (GLfloat)layer.a, (GLfloat)layer.attractor.getB(),
+                (GLfloat)layer.attractor.getC(), (GLfloat)layer.attractor.getD());
+
+    for (int j = 0; j < steps; j++) {
+        glBindBuffer(GL_ARRAY_BUFFER, stateBuffers[k][current[k]]);
+        glVertexAttribPointer(stateLoc, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, stateBuffers[k][current[k] ^ 1]);
+        const GLint first = k * layerRegion + (j % LOD_SLICES) * sliceRegion
+                            + std::max(headFrame, 0) * slicePoints;
+        glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 1, pointBuffer,
+                          (GLintptr)first * 4 * sizeof(GLfloat),
+                          (GLsizeiptr)CGameGLContext::slicePoints * 4 * sizeof(GLfloat));
+
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, CGameGLContext::slicePoints);
+        glEndTransformFeedback();
+        current[k] ^= 1;
+    }
+}
+
+/**
+ * Advances the orbits of every attractor on the GPU, `steps` points per orbit.
+ */
+static void runOrbits(int steps) {
+    using namespace GPUOrbits;
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glUseProgram(program);
+    glBindVertexArray(vertexArray);
+    for (int k = 0; k < Layers::count; k++) {
+        runOrbitPasses(k, steps);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, CGameGLContext::pointBuffer);
+    glUseProgram(CGameGLContext::program);
+    glDisable(GL_RASTERIZER_DISCARD);
+}
+
+void stepGPU() {
+    using namespace CGameGLContext;
+
+    advanceRing();
+    for (int k = 0; k < Layers::count; k++) {
+        for (int j = 0; j < activeSlices; j++) {
+            Cull::counts[slotIndex(k, j, headFrame)] = slicePoints;
+        }
+    }
+    runOrbits(CGameGLContext::activeSlices);
+    animate();
+}
+
+bool initGPUOrbits() {
+    using namespace GPUOrbits;
+
+    if (GLVersion.major < 3) {
+        eggLogMessage("GPU orbits need OpenGL 3.0, using CPU orbits.\n");
+        return false;
+    }
+    EggShader vertex = eggLoadVertShaderFile("./orbit.vs");
+    if (vertex.error != SHADER_NO_ERROR) {
+        eggLogMessage("Unable to load orbit.vs, using CPU orbits.\n");
+        return false;
+    }
+    const char *varyings[] = {"v_state", "v_point"};
+    program = eggShaderCreateFeedbackProgram(vertex.id, varyings, 2, GL_SEPARATE_ATTRIBS);
+    glDeleteShader(vertex.id);
+    eggFreeShader(vertex);
+    if (program == 0) {
+        eggLogMessage("Unable to link orbit.vs, using CPU orbits.\n");
+        return false;
+    }
+    paramsLoc = glGetUniformLocation(program, "u_params");
+    stateLoc = glGetAttribLocation(program, "a_state");
+
+    // The orbit state is the only attribute, in a vertex array of its own.
+    glGenVertexArrays(1, &vertexArray);
+    glBindVertexArray(vertexArray);
+    glEnableVertexAttribArray(stateLoc);
+    glBindVertexArray(0);
+
+    // Start the orbits spread evenly around each attractor's seed, see Seeds.
+    std::vector<GLfloat> states((size_t)CGameGLContext::slicePoints * 2);
+    for (int k = 0; k < Layers::count; k++) {
+        const OrbitSeeds seeds(Seeds::sequence, (uint64_t)k, Layers::layers[k].x, Layers::layers[k].y, Seeds::RADIUS);
+        for (int i = 0; i < CGameGLContext::slicePoints; i++) {
+            double x, y;
+            seeds.seed(i, x, y);
+            states[i * 2 + 0] = (GLfloat)x;
+            states[i * 2 + 1] = (GLfloat)y;
+        }
+        glGenBuffers(2, stateBuffers[k]);
+        for (int b = 0; b < 2; b++) {
+            glBindBuffer(GL_ARRAY_BUFFER, stateBuffers[k][b]);
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)states.size() * sizeof(GLfloat),
+                         states.data(), GL_DYNAMIC_COPY);
+        }
+        current[k] = 0;
+    }
+    // The warm-up points land in the first slot, which the first frame overwrites.
+    runOrbits(WARMUP_STEPS);
+    return true;
+}
+
+/**
+ * Mean, deviation and a coarse density histogram of a point set, to compare two orbit kernels.
+ */
+struct OrbitStats {
+    static constexpr int BINS = 32;
+    double meanX = 0, meanY = 0, devX = 0, devY = 0;
+    std::vector<double> density = std::vector<double>(BINS * BINS, 0.0);
+
+    OrbitStats(const GLfloat *points, int count, int stride) {
+        for (int i = 0; i < count; i++) {
+            meanX += points[i * stride];
+            meanY += points[i * stride + 1];
+        }
+        meanX /= count;
+        meanY /= count;
+        for (int i = 0; i < count; i++) {
+            const double px = points[i * stride], py = points[i * stride + 1];
+            devX += (px - meanX) * (px - meanX);
+            devY += (py - meanY) * (py - meanY);
+            // Clifford orbits stay within [-1 - |c|, 1 + |c|], so [-3, 3] holds any of ours.
+            const int bx = std::min(std::max((int)((px + 3.0) / 6.0 * BINS), 0), BINS - 1);
+            const int by = std::min(std::max((int)((py + 3.0) / 6.0 * BINS), 0), BINS - 1);
+            density[by * BINS + bx] += 1.0 / count;
+        }
+        devX = std::sqrt(devX / count);
+        devY = std::sqrt(devY / count);
+    }
+
+    /** Total variation distance between two densities, 0 (same) to 1 (disjoint). */
+    double distance(const OrbitStats &other) const {
+        double sum = 0.0;
+        for (int i = 0; i < BINS * BINS; i++) {
+            sum += std::abs(density[i] - other.density[i]);
+        }
+        return sum * 0.5;
+    }
+};
+
+bool VerifyGPUOrbitsCGame() {
+    using namespace CGameGLContext;
+
+    if (!GPUOrbits::enabled) {
+        eggLogMessage("GPU orbits are not running.\n");
+        return false;
+    }
+    // One GPU frame of every slice against one CPU frame, from the same parameters: the budget
+    // would otherwise leave slices unwritten, and each further step moves the attractors.
+    const int budgetSlices = activeSlices;
+    activeSlices = LOD_SLICES;
+    const std::vector<AttractorLayer> cpuLayers(Layers::layers, Layers::layers + Layers::count);
+    stepGPU();
+    bool passed = true;
+    for (int k = 0; k < Layers::count; k++) {
+        AttractorLayer cpuLayer = cpuLayers[k];
+        std::vector<GLfloat> gpu((size_t)numParticles * 4);
+        glBindBuffer(GL_ARRAY_BUFFER, pointBuffer);
+        for (int j = 0; j < activeSlices; j++) {
+            const GLint first = k * layerRegion + j * sliceRegion + headFrame * slicePoints;
+            glGetBufferSubData(GL_ARRAY_BUFFER, (GLintptr)first * 4 * sizeof(GLfloat),
+                               slicePoints * 4 * sizeof(GLfloat), gpu.data() + j * slicePoints * 4);
+        }
+        std::vector<GLfloat> cpu((size_t)numParticles * 4);
+        step(cpuLayer, cpu.data());
+
+        const OrbitStats g(gpu.data(), numParticles, 4), c(cpu.data(), numParticles, 4);
+        const double tv = g.distance(c);
+        const double meanError = std::max(std::abs(g.meanX - c.meanX), std::abs(g.meanY - c.meanY));
+        const double devError = std::max(std::abs(g.devX - c.devX), std::abs(g.devY - c.devY));
+        const bool ok = tv < 0.05 && meanError < 0.05 && devError < 0.05;
+        eggLogMessage("Attractor %d: GPU mean (%.4f, %.4f) dev (%.4f, %.4f), "
+                      "CPU mean (%.4f, %.4f) dev (%.4f, %.4f), density distance %.4f: %s\n",
+                      k, g.meanX, g.meanY, g.devX, g.devY, c.meanX, c.meanY, c.devX, c.devY,
+                      tv, ok ? "ok" : "MISMATCH");
+        passed = passed && ok;
+    }
+    activeSlices = budgetSlices;
+    return passed;
+}
+
+void releaseGPUOrbits() {
+    using namespace GPUOrbits;
+
+    if (!enabled) {
+        return;
+    }
+    for (int k = 0; k < Layers::count; k++) {
+        glDeleteBuffers(2, stateBuffers[k]);
+    }
+    glDeleteVertexArrays(1, &vertexArray);
+    glDeleteProgram(program);
+}
@@ -0,0 +1,184 @@
+#include "chaosgame_state.hpp"
+
+using namespace Parameters;
+
+namespace Histogram {
+    bool enabled = false;
+
+    GLuint splatProgram;
+    GLuint resolveProgram;
+    GLuint vertexArray;
+    GLuint density;
+    GLuint peakBuffer;
+    GLuint zeroBuffer;
+    GLint imageWidth, imageHeight;
+    GLint originX, originY;
+
+    GLint firstLoc, countLoc, layerPointsLoc, viewLoc;
+}
+
+void splatRanges() {
+    using namespace Histogram;
+
+    glUseProgram(splatProgram);
+    glUniformMatrix3fv(viewLoc, 1, GL_FALSE, View::matrix);
+    for (size_t r = 0; r < LOD::firsts.size(); r++) {
+        glUniform1i(firstLoc, LOD::firsts[r]);
+        glUniform1i(countLoc, LOD::counts[r]);
+        glDispatchCompute((GLuint)(LOD::counts[r] + 255) / 256, 1, 1);
+    }
+    glUseProgram(CGameGLContext::program);
+}
+
+void clearHistogram() {
+    using namespace Histogram;
+
+    const GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, peakBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), &zero);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, density);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, zeroBuffer);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, imageWidth, imageHeight, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void resolveHistogram() {
+    using namespace Histogram;
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    glDisable(GL_BLEND);
+    glUseProgram(resolveProgram);
+    glBindVertexArray(vertexArray);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glUseProgram(CGameGLContext::program);
+    glEnable(GL_BLEND);
+}
+
+bool initHistogram() {
+    using namespace Histogram;
+
+    if (!eggHasComputeShaders()) {
+        eggLogMessage("Density rendering needs OpenGL 4.3 compute shaders, drawing sprites.\n");
+        return false;
+    }
+    EggShader comp = eggLoadCompShaderFile("./splat.cs");
+    if (comp.error != SHADER_NO_ERROR) {
+        eggLogMessage("Unable to load splat.cs, drawing sprites.\n");
+        return false;
+    }
+    splatProgram = eggShaderCreateComputeProgram(comp.id);
+    glDeleteShader(comp.id);
+    eggFreeShader(comp);
+
+    EggShader vertex = eggLoadVertShaderFile("./density.vs");
+    EggShader frag = eggLoadFragShaderFile("./density.fs");
+    if (vertex.error == SHADER_NO_ERROR && frag.error == SHADER_NO_ERROR) {
+        resolveProgram = eggShaderCreateProgram(vertex.id, frag.id);
+    }
+    glDeleteShader(vertex.id);
+    glDeleteShader(frag.id);
+    eggFreeShader(vertex);
+    eggFreeShader(frag);
+
+    if (splatProgram == 0 || resolveProgram == 0) {
+        eggLogMessage("Unable to build the density programs, drawing sprites.\n");
+        glDeleteProgram(splatProgram);
+        glDeleteProgram(resolveProgram);
+        return false;
+    }
+    firstLoc = glGetUniformLocation(splatProgram, "u_first");
+    countLoc = glGetUniformLocation(splatProgram, "u_count");
+    layerPointsLoc = glGetUniformLocation(splatProgram, "u_layerPoints");
+    viewLoc = glGetUniformLocation(splatProgram, "u_view");
+    glUseProgram(splatProgram);
+    glUniform1i(layerPointsLoc, CGameGLContext::layerRegion);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    originX = viewport[0];
+    originY = viewport[1];
+    imageWidth = viewport[2];
+    imageHeight = viewport[3];
+
+    glUseProgram(resolveProgram);
+    glUniform1i(glGetUniformLocation(resolveProgram, "u_density"), 1);
+    glUniform2i(glGetUniformLocation(resolveProgram, "u_origin"), originX, originY);
+    glUniform3f(glGetUniformLocation(resolveProgram, "u_background"), 0.0f, 0.2f, 0.2f);
+    glUseProgram(CGameGLContext::program);
+
+    glActiveTexture(GL_TEXTURE1);
+    glGenTextures(1, &density);
+    glBindTexture(GL_TEXTURE_2D, density);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32UI, imageWidth, imageHeight);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindImageTexture(0, density, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32UI);
+    glActiveTexture(GL_TEXTURE0);
+
+    glGenBuffers(1, &zeroBuffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, zeroBuffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)imageWidth * imageHeight * sizeof(GLuint), nullptr, GL_STATIC_DRAW);
+    std::vector<GLuint> zeros((size_t)imageWidth * imageHeight, 0);
+    glBufferSubData(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)zeros.size() * sizeof(GLuint), zeros.data());
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    glGenBuffers(1, &peakBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, peakBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, peakBuffer);
+    // The ring itself is read by splat.cs.
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, CGameGLContext::pointBuffer);
+
+    glGenVertexArrays(1, &vertexArray);
+    clearHistogram();
+    return true;
+}
+
+void SaveDensityCGame() {
+    using namespace Histogram;
+
+    if (!enabled || !glGetTexImage) {
+        eggLogMessage("Only density rendering keeps a density to save.\n");
+        return;
+    }
+    std::vector<GLuint> counts((size_t)imageWidth * imageHeight);
+    GLuint peak = 0;
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, density);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, counts.data());
+    glActiveTexture(GL_TEXTURE0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, peakBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(peak), &peak);
+
+    const DensityFormat format = Capture::images.density != DENSITY_NONE ? Capture::images.density : DENSITY_PFM;
+    char path[4096];
+    snprintf(path, sizeof path, "%s/density_%06ld.%s", Capture::directory, (long)frameCounter,
+             densityExtension(format));
+    // Rows of the image run from the bottom of the screen.
+    if (writeDensity(path, format, counts.data(), imageWidth, imageHeight, peak, true)) {
+        eggLogMessage("Saved the density as %s, peak %u\n", path, peak);
+    } else {
+        eggLogMessage("Unable to write %s\n", path);
+    }
+}
+
+void releaseHistogram() {
+    using namespace Histogram;
+
+    if (!enabled) {
+        return;
+    }
+    glDeleteTextures(1, &density);
+    glDeleteBuffers(1, &peakBuffer);
+    glDeleteBuffers(1, &zeroBuffer);
+    glDeleteVertexArrays(1, &vertexArray);
+    glDeleteProgram(splatProgram);
+    glDeleteProgram(resolveProgram);
+}
@@ -0,0 +1,83 @@
+#include "chaosgame_state.hpp"
+
+bool PosterCGame(const CGameOptions &options, const CGamePoster &poster) {
+    constexpr int POSTER_ORBITS = 256;
+    const PosterOptions &tiling = poster.options;
+    if (!poster.output || tiling.width <= 0 || tiling.height <= 0 || poster.points <= 0) {
+        fprintf(stderr, "Nothing to render.\n");
+        return false;
+    }
+    if (tiling.format == IMAGE_QOI) {
+        fprintf(stderr, "Posters are written as ppm, png or png16, not qoi.\n");
+        return false;
+    }
+    Seeds::sequence = options.seeds;
+    WorkerPool pool(poster.threads);
+    const AttractorLayer &layer = Layers::layers[0];
+    const ViewFit fit = options.autoFrame
+                        ? frameAttractors(&layer, 1, (double)tiling.width / tiling.height, pool)
+                        : handTunedFit();
+
+    TiledPoster tiled(tiling, pool);
+    const TiledPoster::Stats layout = tiled.stats();
+    if (!tiled.ok()) {
+        fprintf(stderr, "Unable to make %d spill files in %s.\n", layout.tiles,
+                tiling.spillDirectory ? tiling.spillDirectory : ".");
+        return false;
+    }
+    printf("Poster of %lld points at %dx%d, %d tiles of %d rows, %.0f MB budget, %u threads\n", poster.points,
+           tiling.width, tiling.height, layout.tiles, layout.tileRows, tiling.memoryBudget / 1048576.0,
+           pool.size());
+
+    const double a = layer.a, b = layer.attractor.getB();
+    const double c = layer.attractor.getC(), d = layer.attractor.getD();
+    const double halfWidth = tiling.width * 0.5, halfHeight = tiling.height * 0.5;
+    const bool binned = tiled.bin([&](int w, int workers, PosterBinner &binner) {
+        constexpr int BATCH = 1024;
+        float xs[BATCH], ys[BATCH];
+        for (int orbit = w; orbit < POSTER_ORBITS; orbit += workers) {
+            const long long count = poster.points * (orbit + 1) / POSTER_ORBITS - poster.points * orbit / POSTER_ORBITS;
+            double x, y;
+            OrbitSeeds(Seeds::sequence, 0, layer.x, layer.y, Seeds::RADIUS).seed(orbit, x, y);
+            for (int i = 0; i < Seeds::BURN_IN; i++) {
+                cliffordStep(x, y, a, b, c, d);
+            }
+            for (long long i = 0; i < count; i += BATCH) {
+                const int n = (int)std::min<long long>(BATCH, count - i);
+                for (int k = 0; k < n; k++) {
+                    cliffordStep(x, y, a, b, c, d);
+                    // Clip space to pixels, rows from the top.
+                    xs[k] = (float)((x * fit.scaleX + fit.offsetX + 1.0) * halfWidth);
+                    ys[k] = (float)((1.0 - (y * fit.scaleY + fit.offsetY)) * halfHeight);
+                }
+                binner.add(xs, ys, n);
+            }
+        }
+    });
+    if (!binned) {
+        fprintf(stderr, "Unable to write the spill files in %s.\n",
+                tiling.spillDirectory ? tiling.spillDirectory : ".");
+        return false;
+    }
+
+    std::string densityPath;
+    if (poster.density != DENSITY_NONE) {
+        // The image's name, with the density's extension.
+        densityPath = poster.output;
+        const size_t dot = densityPath.find_last_of('.');
+        if (dot != std::string::npos && densityPath.find_first_of("/\\", dot) == std::string::npos) {
+            densityPath.erase(dot);
+        }
+        densityPath += std::string(".") + densityExtension(poster.density);
+    }
+    const bool written = tiled.write(poster.output, densityPath.empty() ? nullptr : densityPath.c_str(),
+                                     poster.density);
+    const TiledPoster::Stats done = tiled.stats();
+    printf("Binned %llu points in %.2fs, %.1f Mpoints/s, %.0f MB spilled\n", (unsigned long long)done.points,
+           done.binSeconds, done.points / done.binSeconds * 1.0e-6, done.spillBytes * 1.0e-6);
+    printf("Accumulated in %d groups in %.2fs, peak %u; tone mapped and wrote %s in %.2fs%s\n", done.groups,
+           done.accumulateSeconds, done.peak, poster.output, done.writeSeconds, written ? "" : ", NOT WRITTEN");
+    printf("Held %.0f MB at most of the %.0f MB budget, peak RSS %.0f MB\n", done.peakHeld / 1048576.0,
+           tiling.memoryBudget / 1048576.0, done.peakRSS / 1048576.0);
+    return written;
+}
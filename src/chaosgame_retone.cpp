@@ -0,0 +1,42 @@
+#include "chaosgame_state.hpp"
+
+using namespace std::chrono;
+
+bool RetoneCGame(const char *input, const char *output, const ToneMapSettings &settings, ImageFormat format) {
+    auto started = clock_now();
+    DensityImage density;
+    if (!readDensity(input, density)) {
+        fprintf(stderr, "%s is not a density (PFM or raw).\n", input);
+        return false;
+    }
+    const double readMS = duration_cast<microseconds>(clock_now() - started).count() * 0.001;
+
+    started = clock_now();
+    WorkerPool pool;
+    const ToneMapper mapper(settings);
+    const size_t pixels = (size_t)density.width * density.height;
+    std::vector<uint8_t> encoded;
+    if (format == IMAGE_PNG16) {
+        std::vector<uint16_t> rgba(pixels * 4);
+        mapper.toRGBA16(density.counts.data(), pixels, density.peak, rgba.data(), &pool);
+        encodeImage16(rgba.data(), density.width, density.height, false, encoded);
+    } else {
+        std::vector<uint8_t> rgba(pixels * 4);
+        mapper.toRGBA8(density.counts.data(), pixels, density.peak, rgba.data(), &pool);
+        encodeImage(format, rgba.data(), density.width, density.height, false, encoded);
+    }
+    const double mapMS = duration_cast<microseconds>(clock_now() - started).count() * 0.001;
+
+    FILE *file = fopen(output, "wb");
+    bool written = file && fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+    if (file) {
+        written = fclose(file) == 0 && written;
+    }
+    if (!written) {
+        fprintf(stderr, "Unable to write %s.\n", output);
+        return false;
+    }
+    printf("%dx%d, peak %u: read in %.1f ms, tone mapped and encoded as %s in %.1f ms\n", density.width,
+           density.height, density.peak, readMS, imageFormatName(format), mapMS);
+    return true;
+}
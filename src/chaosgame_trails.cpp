@@ -0,0 +1,46 @@
+#include "chaosgame_state.hpp"
+
+namespace Trails {
+    bool enabled = false;
+    int frames = 8;
+
+    GLint framesLoc;
+    GLint headLoc;
+}
+
+void drawTrail(GLint points) {
+    using namespace CGameGLContext;
+
+    const int frames = std::min(Trails::frames, residentFrames);
+    const int oldest = (headFrame - frames + 1 + ringFrames) % ringFrames;
+    const GLint trailPoints = frames * slicePoints;
+    const int slices = std::max(1, std::min(activeSlices, (points + trailPoints - 1) / trailPoints));
+    LOD::firsts.clear();
+    LOD::counts.clear();
+    for (int k = 0; k < Layers::count; k++) {
+        for (int j = 0; j < slices; j++) {
+            for (int f = 0; f < frames; f++) {
+                addSlot(k, j, (oldest + f) % ringFrames, slicePoints);
+            }
+        }
+    }
+    glUniform1i(Trails::headLoc, headFrame);
+    submitDraws();
+}
+
+void updateTrailUniforms() {
+    glUniform1i(Trails::framesLoc, Trails::enabled ? Trails::frames : 0);
+}
+
+void ToggleTrailsCGame() {
+    Trails::enabled = !Trails::enabled;
+    eggLogMessage("Trails %s (%d frames)\n", Trails::enabled ? "on" : "off", Trails::frames);
+    updateTrailUniforms();
+    View::isDirty = true;
+}
+
+void ResizeTrailsCGame(int frames) {
+    Trails::frames = std::min(std::max(Trails::frames + frames, 1), CGameGLContext::ringFrames);
+    eggLogMessage("Trails of %d frames\n", Trails::frames);
+    updateTrailUniforms();
+}
@@ -0,0 +1,179 @@
+#include "checkpoint_index.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    constexpr char MAGIC[4] = {'E', 'G', 'K', 'F'};
+    constexpr uint32_t VERSION = 2;
+
+    bool seekTo(FILE *file, uint64_t offset) {
+#ifdef __unix__
+        return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#else
+        return fseek(file, (long)offset, SEEK_SET) == 0;
+#endif
+    }
+
+    /** Bytes in `file`, 0 when they cannot be told; leaves it at the end. */
+    uint64_t fileLength(FILE *file) {
+#ifdef __unix__
+        const off_t end = fseeko(file, 0, SEEK_END) == 0 ? ftello(file) : -1;
+#else
+        const long end = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+#endif
+        return end > 0 ? (uint64_t)end : 0;
+    }
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        char app[16];
+        uint32_t stateSize;
+        uint32_t interval;
+        uint32_t particles;
+        uint32_t seeds;
+    };
+}
+
+CheckpointIndex::CheckpointIndex(const char *app, int stateSize, int interval, int particles, int seeds)
+        : size(stateSize), every(std::max(interval, 1)), particles(particles), seeds(seeds) {
+    strncpy(this->app, app, sizeof(this->app) - 1);
+}
+
+CheckpointIndex::~CheckpointIndex() {
+    if (file) {
+        fclose(file);
+    }
+}
+
+bool CheckpointIndex::due(uint64_t frame) const {
+    if (frame % every != 0) {
+        return false;
+    }
+    const uint64_t n = frame / every;
+    return n >= present.size() || !present[n];
+}
+
+void CheckpointIndex::record(uint64_t frame, const double *state) {
+    keep(frame, state);
+    if (file && !writeKeyframe(frame, state)) {
+        fprintf(stderr, "Unable to append to the checkpoint index, no more keyframes are written.\n");
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+bool CheckpointIndex::nearest(uint64_t frame, uint64_t &keyFrame, std::vector<double> &state) const {
+    if (present.empty()) {
+        return false;
+    }
+    // Gaps are only left before a seek's target, so this rarely steps more than once.
+    for (size_t n = std::min((size_t)(frame / every), present.size() - 1) + 1; n-- > 0;) {
+        if (present[n]) {
+            keyFrame = (uint64_t)n * every;
+            state.assign(states.begin() + n * size, states.begin() + (n + 1) * size);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CheckpointIndex::open(const char *path) {
+    if (file) {
+        fclose(file);
+    }
+    file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+    Header header = {};
+    memcpy(header.magic, MAGIC, sizeof MAGIC);
+    header.version = VERSION;
+    memcpy(header.app, app, sizeof app);
+    header.stateSize = (uint32_t)size;
+    header.interval = (uint32_t)every;
+    header.particles = (uint32_t)particles;
+    header.seeds = (uint32_t)seeds;
+    bool written = fwrite(&header, sizeof header, 1, file) == 1;
+    for (size_t n = 0; written && n < present.size(); n++) {
+        if (present[n]) {
+            written = writeKeyframe((uint64_t)n * every, states.data() + n * size);
+        }
+    }
+    if (!written) {
+        fclose(file);
+        file = nullptr;
+    }
+    return written;
+}
+
+void CheckpointIndex::keep(uint64_t frame, const double *state) {
+    const size_t n = (size_t)(frame / every);
+    if (n >= present.size()) {
+        present.resize(n + 1, false);
+        states.resize((n + 1) * size);
+    }
+    std::copy(state, state + size, states.begin() + n * size);
+    present[n] = true;
+}
+
+bool CheckpointIndex::writeKeyframe(uint64_t frame, const double *state) {
+    // Flushed per keyframe: they are rare, and a killed run should keep them.
+    return fwrite(&frame, sizeof frame, 1, file) == 1
+           && fwrite(state, sizeof(double), (size_t)size, file) == (size_t)size
+           && fflush(file) == 0;
+}
+
+bool CheckpointIndex::load(const char *path) {
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        return false;
+    }
+    Header header;
+    const bool valid = fread(&header, sizeof header, 1, in) == 1
+                       && memcmp(header.magic, MAGIC, sizeof MAGIC) == 0
+                       && header.version == VERSION
+                       && strncmp(header.app, app, sizeof app) == 0
+                       && header.stateSize == (uint32_t)size
+                       && header.interval > 0
+                       && header.particles == (uint32_t)particles
+                       && header.seeds == (uint32_t)seeds;
+    if (!valid) {
+        fclose(in);
+        return false;
+    }
+    // Files are written from frame 0 on, so keyframe n of a sound file is among its first n + 1
+    // records: a frame past the records it holds is damage, and would size the index by itself.
+    const uint64_t length = fileLength(in);
+    const uint64_t records = length > sizeof header
+                             ? (length - sizeof header) / (sizeof(uint64_t) + (uint64_t)size * sizeof(double)) : 0;
+    if (!seekTo(in, sizeof header)) {
+        fclose(in);
+        return false;
+    }
+    every = (int)header.interval;
+    states.clear();
+    present.clear();
+    uint64_t frame;
+    std::vector<double> state((size_t)size);
+    bool sound = true;
+    // A keyframe cut short by a killed run is dropped with the rest of the tail.
+    while (sound && fread(&frame, sizeof frame, 1, in) == 1
+           && fread(state.data(), sizeof(double), (size_t)size, in) == (size_t)size) {
+        sound = frame / every < records;
+        if (sound && frame % every == 0) {
+            keep(frame, state.data());
+        }
+    }
+    fclose(in);
+    if (!sound) {
+        states.clear();
+        present.clear();
+    }
+    return sound;
+}
+
+size_t CheckpointIndex::count() const {
+    return (size_t)std::count(present.begin(), present.end(), true);
+}
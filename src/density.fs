@@ -0,0 +1,23 @@
+#version 430 core
+// Tone maps the splatted density: log density, a hue ramp, then the Reinhard curve of chaos.fs.
+layout(std430, binding = 2) readonly buffer Peak {
+    uint peak;
+};
+layout(location = 0) out vec4 fragColor;
+uniform usampler2D u_density;
+uniform ivec2 u_origin;
+uniform vec3 u_background;
+
+void main()
+{
+    uint n = texelFetch(u_density, ivec2(gl_FragCoord.xy) - u_origin, 0).r;
+    float v = log(1.0 + float(n)) / log(1.0 + float(max(peak, 1u)));
+
+    vec3 ramp = 0.5 + 0.5 * cos(6.28318 * (vec3(0.0, 0.33, 0.67) + v * 0.8));
+    vec3 c = ramp * v * 2.5;
+    float luminance = dot(c, vec3(0.2126, 0.7152, 0.0722));
+    vec3 toneMappedColor = c / (c + vec3(1.0));
+    toneMappedColor *= (1.0 + luminance) * 1.2;
+
+    fragColor = vec4(mix(u_background, toneMappedColor, min(v * 4.0, 1.0)), 1.0);
+}
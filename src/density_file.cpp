@@ -0,0 +1,280 @@
+#include "density_file.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace {
+    constexpr char MAGIC[4] = {'E', 'G', 'G', 'D'};
+    constexpr uint32_t VERSION = 1;
+
+    void putLE32(uint8_t *at, uint32_t v) {
+        at[0] = (uint8_t)v;
+        at[1] = (uint8_t)(v >> 8);
+        at[2] = (uint8_t)(v >> 16);
+        at[3] = (uint8_t)(v >> 24);
+    }
+
+    uint32_t getLE32(const uint8_t *at) {
+        return (uint32_t)at[0] | (uint32_t)at[1] << 8 | (uint32_t)at[2] << 16 | (uint32_t)at[3] << 24;
+    }
+
+    uint32_t getBE32(const uint8_t *at) {
+        return (uint32_t)at[3] | (uint32_t)at[2] << 8 | (uint32_t)at[1] << 16 | (uint32_t)at[0] << 24;
+    }
+
+    void putHeader(DensityFormat format, int width, int height, uint32_t peak, std::vector<uint8_t> &out) {
+        if (format == DENSITY_RAW) {
+            out.resize(20);
+            memcpy(out.data(), MAGIC, sizeof MAGIC);
+            putLE32(out.data() + 4, VERSION);
+            putLE32(out.data() + 8, (uint32_t)width);
+            putLE32(out.data() + 12, (uint32_t)height);
+            putLE32(out.data() + 16, peak);
+            return;
+        }
+        char header[64];
+        const int length = snprintf(header, sizeof header, "Pf\n%d %d\n-1.0\n", width, height);
+        out.assign(header, header + length);
+    }
+
+    bool seekTo(FILE *file, uint64_t offset) {
+#ifdef __unix__
+        return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#else
+        return fseek(file, (long)offset, SEEK_SET) == 0;
+#endif
+    }
+
+    /** The count a PFM sample, as stored, holds: rounded, and clamped to uint32. */
+    uint32_t toCount(uint32_t stored, bool littleEndian) {
+        const uint8_t *bytes = (const uint8_t *)&stored;
+        const uint32_t bits = littleEndian ? getLE32(bytes) : getBE32(bytes);
+        float value;
+        memcpy(&value, &bits, sizeof value);
+        // Clamped as a float, to the largest below 2^32, so that the rounded value always fits.
+        return value > 0.0f ? (uint32_t)std::llround(std::min(value, 4294967040.0f)) : 0u;
+    }
+
+    /** Bytes in `file`, 0 when they cannot be told. */
+    uint64_t fileLength(FILE *file) {
+#ifdef __unix__
+        const off_t end = fseeko(file, 0, SEEK_END) == 0 ? ftello(file) : -1;
+#else
+        const long end = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+#endif
+        return end > 0 ? (uint64_t)end : 0;
+    }
+
+    /**
+     * Reads `pixels` uint32 into `counts` at `offset`, as they are stored, without a copy of the file.
+     * A file too short for them is refused before anything is allocated: its header may be damaged.
+     */
+    bool readCounts(FILE *file, uint64_t offset, size_t pixels, std::vector<uint32_t> &counts) {
+        const uint64_t length = fileLength(file);
+        if (length < offset || (length - offset) / sizeof(uint32_t) < pixels) {
+            return false;
+        }
+        counts.resize(pixels);
+        return seekTo(file, offset) && fread(counts.data(), sizeof(uint32_t), pixels, file) == pixels;
+    }
+
+    bool readRaw(FILE *file, const uint8_t *head, size_t length, DensityImage &image) {
+        constexpr size_t HEADER = 20;
+        if (length < HEADER || getLE32(head + 4) != VERSION) {
+            return false;
+        }
+        image.width = (int)getLE32(head + 8);
+        image.height = (int)getLE32(head + 12);
+        image.peak = getLE32(head + 16);
+        if (image.width <= 0 || image.height <= 0) {
+            return false;
+        }
+        const size_t pixels = (size_t)image.width * image.height;
+        if (!readCounts(file, HEADER, pixels, image.counts)) {
+            return false;
+        }
+        for (uint32_t &count : image.counts) {
+            count = getLE32((const uint8_t *)&count);
+        }
+        return true;
+    }
+
+    bool readPFM(FILE *file, const uint8_t *head, size_t length, DensityImage &image) {
+        // "Pf", width, height and scale, each followed by one whitespace character.
+        const std::string text(head, head + length);
+        int width = 0, height = 0, consumed = 0;
+        double scale = 0.0;
+        if (sscanf(text.c_str(), "Pf %d %d %lf%n", &width, &height, &scale, &consumed) != 3
+            || width <= 0 || height <= 0 || scale == 0.0) {
+            return false;
+        }
+        const size_t pixels = (size_t)width * height;
+        if (!readCounts(file, (uint64_t)consumed + 1, pixels, image.counts)) {
+            return false;
+        }
+        image.width = width;
+        image.height = height;
+        image.peak = 0;
+        const bool littleEndian = scale < 0.0;
+        // PFM rows run bottom to top: each row of the top half is swapped with its mirror as they are converted.
+        for (int y = 0; y <= height - 1 - y; y++) {
+            uint32_t *row = image.counts.data() + (size_t)y * width;
+            uint32_t *mirror = image.counts.data() + (size_t)(height - 1 - y) * width;
+            for (int x = 0; x < width; x++) {
+                const uint32_t top = toCount(mirror[x], littleEndian);
+                const uint32_t bottom = toCount(row[x], littleEndian);
+                row[x] = top;
+                mirror[x] = bottom;
+                image.peak = std::max(image.peak, std::max(top, bottom));
+            }
+        }
+        return true;
+    }
+}
+
+const char *densityFormatName(DensityFormat format) {
+    switch (format) {
+        case DENSITY_PFM: return "pfm";
+        case DENSITY_RAW: return "raw";
+        default: return "none";
+    }
+}
+
+const char *densityExtension(DensityFormat format) {
+    return format == DENSITY_RAW ? "egd" : "pfm";
+}
+
+bool parseDensityFormat(const char *name, DensityFormat &format) {
+    for (DensityFormat candidate : {DENSITY_NONE, DENSITY_PFM, DENSITY_RAW}) {
+        if (strcmp(name, densityFormatName(candidate)) == 0) {
+            format = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void encodeDensity(DensityFormat format, const uint32_t *counts, int width, int height, uint32_t peak,
+                   bool bottomUp, std::vector<uint8_t> &out) {
+    putHeader(format, width, height, peak, out);
+    const size_t length = out.size();
+    out.resize(length + (size_t)width * height * 4);
+    if (format == DENSITY_RAW) {
+        for (int y = 0; y < height; y++) {
+            const uint32_t *row = counts + (size_t)(bottomUp ? height - 1 - y : y) * width;
+            uint8_t *dst = out.data() + length + (size_t)y * width * 4;
+            for (int x = 0; x < width; x++) {
+                putLE32(dst + x * 4, row[x]);
+            }
+        }
+        return;
+    }
+    for (int y = 0; y < height; y++) {
+        // Bottom row first, as PFM has it.
+        const uint32_t *row = counts + (size_t)(bottomUp ? y : height - 1 - y) * width;
+        uint8_t *dst = out.data() + length + (size_t)y * width * 4;
+        for (int x = 0; x < width; x++) {
+            const float value = (float)row[x];
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof bits);
+            putLE32(dst + x * 4, bits);
+        }
+    }
+}
+
+bool writeDensity(const char *path, DensityFormat format, const uint32_t *counts, int width, int height,
+                  uint32_t peak, bool bottomUp) {
+    std::vector<uint8_t> encoded;
+    encodeDensity(format, counts, width, height, peak, bottomUp, encoded);
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+    const bool written = fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+    return fclose(file) == 0 && written;
+}
+
+DensityStripWriter::DensityStripWriter(const char *path, DensityFormat format, int width, int height)
+        : file(nullptr), format(format), width(width), height(height), row((size_t)width * 4) {
+    if (format == DENSITY_NONE || width <= 0 || height <= 0) {
+        return;
+    }
+    file = fopen(path, "wb");
+    if (!file) {
+        return;
+    }
+    // The peak is filled in by finish().
+    std::vector<uint8_t> header;
+    putHeader(format, width, height, 0, header);
+    headerBytes = header.size();
+    failed = fwrite(header.data(), 1, header.size(), file) != header.size();
+}
+
+DensityStripWriter::~DensityStripWriter() {
+    if (file) {
+        fclose(file);
+    }
+}
+
+bool DensityStripWriter::write(const uint32_t *counts, int rows) {
+    for (int y = 0; y < rows && ok(); y++, rowsWritten++) {
+        if (rowsWritten >= height) {
+            failed = true;
+            break;
+        }
+        const uint32_t *in = counts + (size_t)y * width;
+        for (int x = 0; x < width; x++) {
+            uint32_t bits = in[x];
+            if (format == DENSITY_PFM) {
+                const float value = (float)in[x];
+                memcpy(&bits, &value, sizeof bits);
+            }
+            putLE32(row.data() + x * 4, bits);
+        }
+        const int at = format == DENSITY_PFM ? height - 1 - rowsWritten : rowsWritten;
+        if (!seekTo(file, headerBytes + (uint64_t)at * width * 4)
+            || fwrite(row.data(), 1, row.size(), file) != row.size()) {
+            failed = true;
+        }
+    }
+    return ok();
+}
+
+bool DensityStripWriter::finish(uint32_t peak) {
+    if (!file) {
+        return false;
+    }
+    if (format == DENSITY_RAW) {
+        uint8_t bytes[4];
+        putLE32(bytes, peak);
+        if (!seekTo(file, 16) || fwrite(bytes, 1, 4, file) != 4) {
+            failed = true;
+        }
+    }
+    if (fclose(file) != 0) {
+        failed = true;
+    }
+    file = nullptr;
+    return !failed && rowsWritten == height;
+}
+
+bool readDensity(const char *path, DensityImage &image) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    // Enough for either header; the counts are then read straight into the image.
+    uint8_t head[256];
+    const size_t length = fread(head, 1, sizeof head, file);
+    bool read = false;
+    if (length >= 4 && memcmp(head, MAGIC, sizeof MAGIC) == 0) {
+        read = readRaw(file, head, length, image);
+    } else if (length >= 2 && head[0] == 'P' && head[1] == 'f') {
+        read = readPFM(file, head, length, image);
+    }
+    fclose(file);
+    return read;
+}
@@ -0,0 +1,148 @@
+#include "density_histogram.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // Private histograms are summed while this many bytes of them stay cheap to reduce;
+    // past it (1080p at 4 threads), tiles were faster in --bench-histogram.
+    constexpr size_t PRIVATE_BYTES = 32u * 1024 * 1024;
+    // Tiles per worker, so that an uneven image still keeps every owner busy.
+    constexpr size_t TILES_PER_WORKER = 4;
+}
+
+const char *histogramStrategyName(HistogramStrategy strategy) {
+    switch (strategy) {
+        case HISTOGRAM_PRIVATE: return "private";
+        case HISTOGRAM_TILED: return "tiled";
+        case HISTOGRAM_ATOMIC: return "atomic";
+        default: return "auto";
+    }
+}
+
+bool parseHistogramStrategy(const char *name, HistogramStrategy &strategy) {
+    for (HistogramStrategy candidate : {HISTOGRAM_AUTO, HISTOGRAM_PRIVATE, HISTOGRAM_TILED, HISTOGRAM_ATOMIC}) {
+        if (strcmp(name, histogramStrategyName(candidate)) == 0) {
+            strategy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+HistogramStrategy pickStrategy(unsigned threads, int width, int height) {
+    const size_t bytes = (size_t)width * height * sizeof(uint32_t);
+    if (threads <= 1 || bytes * threads <= PRIVATE_BYTES) {
+        return HISTOGRAM_PRIVATE;
+    }
+    return HISTOGRAM_TILED;
+}
+
+DensityHistogram::DensityHistogram(int width, int height, WorkerPool &pool,
+                                   HistogramStrategy strategy, StreamPages pages)
+        : columns(width), rows(height), pixels((size_t)width * height), pool(pool),
+          used(strategy == HISTOGRAM_AUTO ? pickStrategy(pool.size(), width, height) : strategy),
+          shared(pixels * sizeof(uint32_t), pages, false) {
+    const unsigned workers = pool.size();
+    if (used == HISTOGRAM_PRIVATE) {
+        for (unsigned w = 1; w < workers; w++) {
+            privates.emplace_back(pixels * sizeof(uint32_t), pages, false);
+        }
+        pool.parallelForStatic((int)workers, [this](int w) {
+            if (w > 0) {
+                memset(privates[w - 1].data(), 0, pixels * sizeof(uint32_t));
+            }
+        });
+    } else if (used == HISTOGRAM_TILED) {
+        const size_t tilePixels = std::max<size_t>(pixels / (workers * TILES_PER_WORKER), 1);
+        while (((size_t)1 << tileShift) < tilePixels) {
+            tileShift++;
+        }
+        const size_t tiles = (pixels + ((size_t)1 << tileShift) - 1) >> tileShift;
+        queues.assign(workers, std::vector<std::vector<uint64_t>>(tiles));
+        tileLocks = std::vector<std::mutex>(tiles);
+        pool.parallelForStatic((int)workers, [this](int w) {
+            for (std::vector<uint64_t> &queue : queues[w]) {
+                queue.reserve(HistogramSplatter::QUEUE_ENTRIES);
+            }
+        });
+    }
+    clear();
+}
+
+void HistogramSplatter::flush(uint32_t tile) {
+    std::vector<uint64_t> &queue = (*queues)[tile];
+    std::lock_guard<std::mutex> lock(tileLocks[tile]);
+    for (uint64_t entry : queue) {
+        bins[(uint32_t)entry] += (uint32_t)(entry >> 32);
+    }
+    queue.clear();
+}
+
+void DensityHistogram::forOwned(const std::function<void(size_t first, size_t last)> &task) {
+    if (used == HISTOGRAM_TILED) {
+        const size_t tilePixels = (size_t)1 << tileShift;
+        pool.parallelForStatic((int)queues[0].size(), [&](int t) {
+            task(t * tilePixels, std::min(pixels, (t + 1) * tilePixels));
+        });
+        return;
+    }
+    const size_t workers = pool.size();
+    pool.parallelForStatic((int)workers, [&](int w) {
+        // Whole rows, so a band is contiguous and its owner never shares a cache line.
+        const size_t first = (size_t)rows * w / workers * columns;
+        const size_t last = (size_t)rows * (w + 1) / workers * columns;
+        task(first, last);
+    });
+}
+
+void DensityHistogram::clear() {
+    uint32_t *bins = shared.as<uint32_t>();
+    forOwned([bins](size_t first, size_t last) {
+        memset(bins + first, 0, (last - first) * sizeof(uint32_t));
+    });
+}
+
+void DensityHistogram::accumulate(
+        const std::function<void(int worker, int workers, HistogramSplatter &splatter)> &produce) {
+    const int workers = (int)pool.size();
+    pool.parallelForStatic(workers, [&](int w) {
+        HistogramSplatter splatter;
+        splatter.strategy = used;
+        splatter.bins = used == HISTOGRAM_PRIVATE && w > 0 ? privates[w - 1].as<uint32_t>()
+                                                           : shared.as<uint32_t>();
+        splatter.queues = used == HISTOGRAM_TILED ? &queues[w] : nullptr;
+        splatter.tileLocks = tileLocks.data();
+        splatter.tileShift = tileShift;
+        produce(w, workers, splatter);
+    });
+
+    uint32_t *bins = shared.as<uint32_t>();
+    if (used == HISTOGRAM_PRIVATE && !privates.empty()) {
+        forOwned([this, bins](size_t first, size_t last) {
+            for (StreamBuffer &buffer : privates) {
+                uint32_t *own = buffer.as<uint32_t>();
+                for (size_t p = first; p < last; p++) {
+                    bins[p] += own[p];
+                }
+                memset(own + first, 0, (last - first) * sizeof(uint32_t));
+            }
+        });
+    } else if (used == HISTOGRAM_TILED) {
+        // Only the owner of a tile writes it now, so no atomics or locks are needed.
+        forOwned([this, bins](size_t first, size_t) {
+            const size_t tile = first >> tileShift;
+            for (auto &worker : queues) {
+                for (uint64_t entry : worker[tile]) {
+                    bins[(uint32_t)entry] += (uint32_t)(entry >> 32);
+                }
+                worker[tile].clear();
+            }
+        });
+    }
+}
+
+uint32_t DensityHistogram::peak() const {
+    const uint32_t *bins = counts();
+    return bins ? *std::max_element(bins, bins + pixels) : 0;
+}
@@ -16,12 +16,69 @@
  */
 #define EGG_VERSION 0x000305
 
+#include <string.h>
+
 #include "egg2d.h"
 
+#ifdef EGG_EGL
+//  Only the surfaceless and pbuffer paths are used; no X11 types.
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
 static SDL_Surface *screenSurface = NULL;
 static SDL_Window *window = NULL;
 static SDL_Renderer *renderer = NULL;
 
+//  Headless: no window shows; everything is drawn into an offscreen framebuffer object.
+static int headless = 0;
+static GLuint offscreenFramebuffer = 0;
+static GLuint offscreenColor = 0;
+static GLuint offscreenDepth = 0;
+#ifdef EGG_EGL
+static EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+static EGLContext eglContext = EGL_NO_CONTEXT;
+static EGLSurface eglSurface = EGL_NO_SURFACE;
+#endif
+
+//  Frame capture: a ring of pixel-pack buffers, each read into at one frame's UpdateWindow and
+//  mapped only once its fence has passed, a frame or two later, so glReadPixels never waits for
+//  the GPU. Without buffer objects and fences (OpenGL before 3.2, GLES2), frames are read at once.
+#if !defined(__ANDROID__)
+#define EGG_CAPTURE_ASYNC
+#endif
+#define EGG_CAPTURE_MAX_BUFFERS 8
+
+struct CaptureSlot {
+    GLuint buffer;
+    GLsizeiptr size;
+#ifdef EGG_CAPTURE_ASYNC
+    GLsync fence;
+#endif
+    GLsizei width, height;
+    long frame;
+};
+
+static struct {
+    int active;
+    int async;
+    int buffers;
+//  Next slot to read into; the `pending` slots before it wait for their fences, oldest first.
+    int head;
+    int pending;
+    int requested;
+    long requestedFrame;
+    long dropped;
+    EggCaptureCallback callback;
+    void *user;
+    struct CaptureSlot slots[EGG_CAPTURE_MAX_BUFFERS];
+} capture;
+
+//  The one buffer of the frames read at once, kept between frames.
+static unsigned char *capturePool = NULL;
+static size_t capturePoolSize = 0;
+
 static void  *assetsBuffer[13];
 static char assetsIndex = 0;
 static GLuint memoryUsage = 0;
@@ -54,7 +111,12 @@ typedef struct {
 static void initViewPort() {
 
 //  Compute the aspect, horizontal or vertical scale, horizontal crop, and vertical crop.
-    SDL_GetWindowSize(window, &g_actualWidth, &g_actualHeight);
+    if (headless) {
+        g_actualWidth = g_targetWidth;
+        g_actualHeight = g_targetHeight;
+    } else {
+        SDL_GetWindowSize(window, &g_actualWidth, &g_actualHeight);
+    }
 
     g_aspect = (int) ( (float)g_actualWidth / (float)g_actualHeight);
     g_cropH = 0;
@@ -109,7 +171,9 @@ static int init2D() {
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
-    SDL_GL_SwapWindow(window);
+    if (!headless) {
+        SDL_GL_SwapWindow(window);
+    }
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
@@ -205,6 +269,176 @@ int CreateWindow(const char *title) {
     return init2D();
 }
 
+/**
+ * \private Creates an OpenGL context with no window through EGL: on Mesa's surfaceless platform
+ * when there is one (no display server, no GPU needed with its software drivers), else on the
+ * default display with a pbuffer surface.
+ * @return 0 on success, with the context current.
+ */
+#ifdef EGG_EGL
+static int createEGLContext() {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    int surfaceless = 0;
+    if (getPlatformDisplay && clientExtensions && strstr(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        surfaceless = eglDisplay != EGL_NO_DISPLAY;
+    }
+    if (eglDisplay == EGL_NO_DISPLAY) {
+        eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    EGLint major, minor;
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+        fprintf(stderr, "Unable to initialize EGL (0x%x)\n", eglGetError());
+        return -1;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        fprintf(stderr, "EGL has no desktop OpenGL (0x%x)\n", eglGetError());
+        return -1;
+    }
+
+//  The context needs a config even if it never draws to an EGL surface.
+    const EGLint configAttributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configs = 0;
+    if (!eglChooseConfig(eglDisplay, configAttributes, &config, 1, &configs) || configs == 0) {
+        fprintf(stderr, "No EGL config for an OpenGL pbuffer (0x%x)\n", eglGetError());
+        return -1;
+    }
+    eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, NULL);
+    if (eglContext == EGL_NO_CONTEXT) {
+        fprintf(stderr, "There was an error creating the EGL context (0x%x)\n", eglGetError());
+        return -1;
+    }
+
+//  Without EGL_KHR_surfaceless_context the context must be made current on some surface;
+//  a 1x1 pbuffer will do, since the framebuffer object is drawn to instead.
+    const char *extensions = eglQueryString(eglDisplay, EGL_EXTENSIONS);
+    if (!surfaceless && !(extensions && strstr(extensions, "EGL_KHR_surfaceless_context"))) {
+        const EGLint pbufferAttributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+        eglSurface = eglCreatePbufferSurface(eglDisplay, config, pbufferAttributes);
+        if (eglSurface == EGL_NO_SURFACE) {
+            fprintf(stderr, "There was an error creating the EGL pbuffer (0x%x)\n", eglGetError());
+            return -1;
+        }
+    }
+    if (!eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext)) {
+        fprintf(stderr, "Unable to make the EGL context current (0x%x)\n", eglGetError());
+        return -1;
+    }
+    printf("EGL %d.%d, %s\n", major, minor, surfaceless ? "surfaceless" : "pbuffer");
+    return 0;
+}
+#endif
+
+/**
+ * \private Creates the framebuffer object of the headless window,
+ * g_targetWidth x g_targetHeight of RGBA8 with depth and stencil, and binds it.
+ */
+static int createOffscreenFramebuffer() {
+    glGenRenderbuffers(1, &offscreenColor);
+    glBindRenderbuffer(GL_RENDERBUFFER, offscreenColor);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, g_targetWidth, g_targetHeight);
+    glGenRenderbuffers(1, &offscreenDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, offscreenDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, g_targetWidth, g_targetHeight);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &offscreenFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, offscreenFramebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreenColor);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, offscreenDepth);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "The offscreen framebuffer is incomplete\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \EGG ::Creates a Headless Window. \n
+ * Like CreateWindow, but nothing is shown: the OpenGL context comes from EGL (see EGG_EGL),
+ * or else from a hidden window of SDL's offscreen video driver, and ClearScreen/UpdateWindow
+ * work on a g_targetWidth x g_targetHeight framebuffer object instead of a window.
+ * There is no vsync, so frames run as fast as they render; for render nodes without a display.
+ * @param title The title of the window, when there is one.
+ * @return -1: on error; 0 on success.
+ */
+int CreateHeadlessWindow(const char *title) {
+    headless = 1;
+#ifdef EGG_EGL
+//  Events and timers only: no video driver is touched.
+    if (SDL_Init(SDL_INIT_EVENTS | SDL_INIT_TIMER) != 0) {
+        fprintf(stderr, "SDL_Init error: %s\n", SDL_GetError());
+        return -1;
+    }
+    (void) title;
+    if (createEGLContext() != 0) {
+        SDL_Quit();
+        return -1;
+    }
+    GLADloadproc load = (GLADloadproc) eglGetProcAddress;
+#else
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "offscreen");
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS | SDL_INIT_TIMER) != 0) {
+        fprintf(stderr, "SDL_Init error: %s\n", SDL_GetError());
+        return -1;
+    }
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
+    window = SDL_CreateWindow(title, 0, 0, g_targetWidth, g_targetHeight,
+                              SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+    if (!window) {
+        fprintf(stderr, "SDL_CreateWindow error: %s\n", SDL_GetError());
+        SDL_Quit();
+        return -1;
+    }
+    SDL_GLContext gl = SDL_GL_CreateContext(window);
+    if (gl == NULL) {
+        fprintf(stderr, "There was an error creating GL_Context (%s)", SDL_GetError());
+        return -1;
+    }
+    SDL_GL_MakeCurrent(window, gl);
+    SDL_GL_SetSwapInterval(0);
+    GLADloadproc load = (GLADloadproc) SDL_GL_GetProcAddress;
+#endif
+
+#if !defined(__ANDROID__)
+    if (!gladLoadGLLoader(load)) {
+        fprintf(stderr, "Cannot load GLAD\n");
+        return -1;
+    }
+#else
+    (void) load;
+#endif
+    if (createOffscreenFramebuffer() != 0) {
+        return -1;
+    }
+
+    initViewPort();
+
+    printf("Vendor:   %s\n", glGetString(GL_VENDOR));
+    printf("Renderer: %s\n", glGetString(GL_RENDERER));
+    printf("Version:  %s\n", glGetString(GL_VERSION));
+    printf("Headless: %dx%d offscreen\n", g_targetWidth, g_targetHeight);
+
+    return init2D();
+}
+
+/**
+ * \EGG ::Is Headless.
+ * @returns 1 when the window was created by CreateHeadlessWindow; otherwise 0.
+ */
+int eggIsHeadless() {
+    return headless;
+}
+
 /**
  * \EGG ::Quit Program.\n
  * It will release the renderer, window, and additional loaded resources,
@@ -213,8 +447,30 @@ int CreateWindow(const char *title) {
  * Call this when terminating your ..::[Egg2D]::.. program.
  */
 void EGG_Quit() {
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
+    eggCaptureStop();
+    if (offscreenFramebuffer != 0) {
+        glDeleteFramebuffers(1, &offscreenFramebuffer);
+        glDeleteRenderbuffers(1, &offscreenColor);
+        glDeleteRenderbuffers(1, &offscreenDepth);
+        offscreenFramebuffer = 0;
+    }
+#ifdef EGG_EGL
+    if (eglDisplay != EGL_NO_DISPLAY) {
+        eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (eglSurface != EGL_NO_SURFACE) {
+            eglDestroySurface(eglDisplay, eglSurface);
+        }
+        eglDestroyContext(eglDisplay, eglContext);
+        eglTerminate(eglDisplay);
+        eglDisplay = EGL_NO_DISPLAY;
+    }
+#endif
+    if (renderer) {
+        SDL_DestroyRenderer(renderer);
+    }
+    if (window) {
+        SDL_DestroyWindow(window);
+    }
     eggUnload();
     SDL_Quit();
 }
@@ -312,6 +568,51 @@ GLuint eggShaderCreateProgram(GLuint vertexShaderObj, GLuint fragmentShaderObj)
     return shaderProgramObj;
 }
 
+/**
+ * \EGG ::Creates and Links a Transform Feedback Program.\n
+ * Links a vertex-only shader program whose outputs are captured by transform feedback;
+ * there is no fragment stage, draw it with GL_RASTERIZER_DISCARD enabled.
+ * @vertexShaderObj the vertex shader id;
+ * @varyings the names of the captured outputs, in capture order;
+ * @count the number of captured outputs;
+ * @bufferMode GL_INTERLEAVED_ATTRIBS or GL_SEPARATE_ATTRIBS;
+ * @returns the id of the program; 0 on error.
+ */
+GLuint eggShaderCreateFeedbackProgram(GLuint vertexShaderObj, const char *const *varyings,
+                                      GLsizei count, GLenum bufferMode) {
+    GLint linked;
+
+    GLuint shaderProgramObj = glCreateProgram();
+    if (shaderProgramObj == 0) {
+        fprintf(stderr, "There's an error creating feedback shaderProgramObj.\n");
+        GL_CHECK();
+        return 0;
+    }
+    glAttachShader(shaderProgramObj, vertexShaderObj);
+//  The captured outputs must be named before linking.
+    glTransformFeedbackVaryings(shaderProgramObj, count, (const GLchar *const *) varyings, bufferMode);
+    glLinkProgram(shaderProgramObj);
+
+    glGetProgramiv(shaderProgramObj, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        GLint infoLen = 0;
+
+        glGetProgramiv(shaderProgramObj, GL_INFO_LOG_LENGTH, &infoLen);
+
+        if (infoLen > 0) {
+            char *infoLog = (char *) malloc(sizeof(char) * infoLen);
+
+            glGetProgramInfoLog(shaderProgramObj, infoLen, NULL, infoLog);
+            fprintf(stderr, "Error linking feedback shader-program [obj]\n%s\n", infoLog);
+
+            free(infoLog);
+        }
+        glDeleteProgram(shaderProgramObj);
+        return 0;
+    }
+    return shaderProgramObj;
+}
+
 
 /**
  * \EGG ::Load Vertex Shader File.\n
@@ -442,6 +743,112 @@ struct EggShader eggLoadFragShaderFile(const char *relativePath) {
     return frag;
 }
 
+/**
+ * \EGG ::Load Compute Shader File.\n
+ * Loads the file, relative to the current path,
+ * compiles, then return an `EggShader` (needs OpenGL 4.3).
+ * \type SHADER_COMP;
+ * \error either one of SHADER_NO_ERROR, SHADER_READ_ERROR, or SHADER_COMPILE_ERROR.
+ */
+struct EggShader eggLoadCompShaderFile(const char *relativePath) {
+
+    EggFileContext eggFile = eggFileOpen(NULL, relativePath);
+
+    if (eggFile.size == -1) {
+        return (struct EggShader) {
+            .type = SHADER_COMP,
+            .src = (struct TextResource) {
+                .src = NULL,
+                .size = -1
+            },
+            .error = SHADER_READ_ERROR
+        };
+    }
+
+    long computeBytesLen = (long)sizeof(char) * eggFile.size;
+    char *computeShaderSrc = (char *) malloc(computeBytesLen + 1);
+
+    size_t bytesRead = eggFileRead(eggFile.filePointer, computeBytesLen, computeShaderSrc);
+    computeShaderSrc[bytesRead] = '\0';
+
+    struct EggShader comp = {
+            .type = SHADER_COMP,
+            .id = 0,
+            .src = (struct TextResource) {
+                .src = computeShaderSrc,
+                .size = (long)bytesRead
+            },
+            .error = SHADER_NO_ERROR
+    };
+
+//  Compile the compute shader.
+    GLuint computeShaderObj = eggCompileShader(GL_COMPUTE_SHADER, computeShaderSrc);
+
+    comp.id = computeShaderObj;
+    eggFileClose(eggFile.filePointer);
+
+    if (computeShaderObj == 0) {
+        fprintf(stderr,
+                "There's an error compiling the compute-shader [obj].\n");
+        GL_CHECK();
+        free(computeShaderSrc);
+        comp.src.src = NULL;
+        comp.src.size = -1;
+        comp.error = SHADER_COMPILE_ERROR;
+    }
+    return comp;
+}
+
+/**
+ * \EGG ::Creates and Links a Compute Program.\n
+ * @computeShaderObj the compute shader id; use eggLoadCompShaderFile.
+ * @returns the id of the program; 0 on error.
+ */
+GLuint eggShaderCreateComputeProgram(GLuint computeShaderObj) {
+    GLint linked;
+
+    GLuint shaderProgramObj = glCreateProgram();
+    if (shaderProgramObj == 0) {
+        fprintf(stderr, "There's an error creating compute shaderProgramObj.\n");
+        GL_CHECK();
+        return 0;
+    }
+    glAttachShader(shaderProgramObj, computeShaderObj);
+    glLinkProgram(shaderProgramObj);
+
+    glGetProgramiv(shaderProgramObj, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        GLint infoLen = 0;
+
+        glGetProgramiv(shaderProgramObj, GL_INFO_LOG_LENGTH, &infoLen);
+
+        if (infoLen > 0) {
+            char *infoLog = (char *) malloc(sizeof(char) * infoLen);
+
+            glGetProgramInfoLog(shaderProgramObj, infoLen, NULL, infoLog);
+            fprintf(stderr, "Error linking compute shader-program [obj]\n%s\n", infoLog);
+
+            free(infoLog);
+        }
+        glDeleteProgram(shaderProgramObj);
+        return 0;
+    }
+    return shaderProgramObj;
+}
+
+/**
+ * \EGG ::Has Compute Shaders.\n
+ * @returns non-zero when the context is OpenGL 4.3 or later with compute shaders loaded.
+ */
+int eggHasComputeShaders() {
+#if defined(__ANDROID__)
+    return 0;
+#else
+    return (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 3))
+           && glDispatchCompute != NULL;
+#endif
+}
+
 /**
  * \EGG ::Free/Release Shader.
  *
@@ -655,15 +1062,190 @@ EGG_API char *eggLoadPCM(void *ioContext, const char *fileName, int *width, int
 
 /**
  * \private ::Frame Buffer to Texture.
- * @returns the allocated texture of snapshot to framebuffer.
+ * Reads a rectangle of the bound read framebuffer as RGBA8, waiting for the GPU to finish it.
+ * @returns the pixels, in a buffer kept for the next call; NULL when out of memory.
+ */
+static unsigned char *frameBufferToTexture(GLint x, GLint y, GLsizei width, GLsizei height) {
+    const size_t texLength = (size_t) width * height * 4;
+    if (texLength > capturePoolSize) {
+        unsigned char *texture = (unsigned char *) realloc(capturePool, texLength);
+        if (texture == NULL) {
+            return NULL;
+        }
+        capturePool = texture;
+        capturePoolSize = texLength;
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, capturePool);
+    return capturePool;
+}
+
+// --- Frame Capture ---
+
+/**
+ * \EGG ::Start Capture.\n
+ * Sets up the readback of the frames asked for with eggCaptureFrame(): each is read at its
+ * UpdateWindow() into one of `buffers` pixel-pack buffers, and handed to `callback` once the GPU
+ * is done with it, while the next frames render; 3 buffers read frame N back as frame N + 2 renders.
+ * The buffers are allocated once, and again only when the viewport size changes.
+ * @buffers 2 to 8 pixel-pack buffers.
+ * @callback receives the viewport's pixels as RGBA8, bottom row first; they are only valid during the call.
+ * @returns 1 with asynchronous readback, 0 when frames are read at once (no buffer objects or fences), -1 on error.
  */
-static char* frameBufferToTexture(GLuint framebuffer, GLsizei width, GLsizei height) {
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-    int texLength = width * height * 4;
-    char *texture = (char *) malloc(texLength);
+int eggCaptureStart(int buffers, EggCaptureCallback callback, void *user) {
+    if (callback == NULL) {
+        return -1;
+    }
+    if (capture.active) {
+        eggCaptureStop();
+    }
+    memset(&capture, 0, sizeof capture);
+    capture.callback = callback;
+    capture.user = user;
+    capture.buffers = buffers < 2 ? 2 : buffers > EGG_CAPTURE_MAX_BUFFERS ? EGG_CAPTURE_MAX_BUFFERS : buffers;
+#ifdef EGG_CAPTURE_ASYNC
+    capture.async = (GLVersion.major > 3 || (GLVersion.major == 3 && GLVersion.minor >= 2))
+                    && glFenceSync != NULL && glMapBufferRange != NULL;
+    if (capture.async) {
+        for (int i = 0; i < capture.buffers; i++) {
+            glGenBuffers(1, &capture.slots[i].buffer);
+        }
+    }
+#endif
+    capture.active = 1;
+    return capture.async;
+}
 
-    glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, texture);
-    return texture;
+/**
+ * \EGG ::Capture Frame.\n
+ * Asks for the frame being drawn: it is read back at the next UpdateWindow(), before it is shown.
+ * @frame handed to the callback with the pixels.
+ */
+void eggCaptureFrame(long frame) {
+    capture.requested = capture.active;
+    capture.requestedFrame = frame;
+}
+
+/**
+ * \private Hands the oldest pending frames whose fences have passed to the callback.
+ * @wait waits for every pending frame instead.
+ */
+static void captureDeliver(int wait) {
+#ifdef EGG_CAPTURE_ASYNC
+    while (capture.pending > 0) {
+        const int oldest = (capture.head - capture.pending + capture.buffers) % capture.buffers;
+        struct CaptureSlot *slot = &capture.slots[oldest];
+        const GLenum status = glClientWaitSync(slot->fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                               wait ? (GLuint64) 1000000000 : 0);
+        if (status == GL_TIMEOUT_EXPIRED && !wait) {
+            return;
+        }
+        glDeleteSync(slot->fence);
+        slot->fence = NULL;
+        capture.pending--;
+        if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED) {
+            capture.dropped++;
+            continue;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+        const unsigned char *pixels = (const unsigned char *) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot->size,
+                                                                               GL_MAP_READ_BIT);
+        if (pixels != NULL) {
+            capture.callback(pixels, slot->width, slot->height, slot->frame, capture.user);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        } else {
+            capture.dropped++;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+#else
+    (void) wait;
+#endif
+}
+
+/**
+ * \private Reads the frame asked for by eggCaptureFrame(), from the framebuffer about to be shown.
+ */
+static void captureRead() {
+    const int requested = capture.requested;
+    capture.requested = 0;
+    if (!capture.async) {
+        if (requested) {
+            const unsigned char *pixels = frameBufferToTexture(g_cropH, g_cropV, g_scaledWidth, g_scaledHeight);
+            if (pixels != NULL) {
+                capture.callback(pixels, g_scaledWidth, g_scaledHeight, capture.requestedFrame, capture.user);
+            } else {
+                capture.dropped++;
+            }
+        }
+        return;
+    }
+#ifdef EGG_CAPTURE_ASYNC
+    captureDeliver(0);
+    if (!requested) {
+        return;
+    }
+//  Every buffer still in flight: the frame is dropped rather than the GPU waited for.
+    if (capture.pending == capture.buffers) {
+        capture.dropped++;
+        return;
+    }
+    struct CaptureSlot *slot = &capture.slots[capture.head];
+    const GLsizeiptr size = (GLsizeiptr) g_scaledWidth * g_scaledHeight * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+    if (slot->size != size) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        slot->size = size;
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(g_cropH, g_cropV, g_scaledWidth, g_scaledHeight, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot->width = g_scaledWidth;
+    slot->height = g_scaledHeight;
+    slot->frame = capture.requestedFrame;
+    capture.head = (capture.head + 1) % capture.buffers;
+    capture.pending++;
+#endif
+}
+
+/**
+ * \EGG ::Drain Capture.\n
+ * Waits for the frames still being read back and hands them to the callback; for the last
+ * frames of a capture, or a screenshot that is wanted now.
+ */
+void eggCaptureDrain() {
+    if (capture.active) {
+        captureDeliver(1);
+    }
+}
+
+/**
+ * \EGG ::Dropped Captures.
+ * @returns the frames asked for that were not read back: every buffer was in flight, or mapping failed.
+ */
+long eggCaptureDropped() {
+    return capture.dropped;
+}
+
+/**
+ * \EGG ::Stop Capture.\n
+ * Drains the pending frames, then releases the pixel-pack buffers.
+ */
+void eggCaptureStop() {
+    if (!capture.active) {
+        return;
+    }
+    eggCaptureDrain();
+    for (int i = 0; i < capture.buffers; i++) {
+        if (capture.slots[i].buffer != 0) {
+            glDeleteBuffers(1, &capture.slots[i].buffer);
+        }
+    }
+    free(capturePool);
+    capturePool = NULL;
+    capturePoolSize = 0;
+    capture.active = 0;
 }
 
 /**
@@ -718,7 +1300,16 @@ void ClearScreen() {
 
 /**
  * \EGG2D_API Updates and synchronize the window.
+ * A frame asked for with eggCaptureFrame() is read back first.
+ * Headless, there is nothing to present: the frame's commands are only flushed.
  */
 void UpdateWindow() {
+    if (capture.active) {
+        captureRead();
+    }
+    if (headless) {
+        glFlush();
+        return;
+    }
     SDL_GL_SwapWindow(window);
 }
\ No newline at end of file
@@ -1,5 +1,9 @@
 
 #include "fractal_renderer.hpp"
+#include "checkpoint_index.hpp"
+#include "frame_budget.hpp"
+#include "stream_buffer.hpp"
+#include "view_framing.hpp"
 
 #include <chrono>
 
@@ -52,9 +56,15 @@ namespace /* std:: */ {
 namespace GLContext {
 //   Intel i3 2.10Ghz with OpenGL 4.4 >
 #define NUM_PARTICLES 20666
+//   The frame budget moves the particle count within [MIN_PARTICLES, MAX_PARTICLES].
+#define MIN_PARTICLES (NUM_PARTICLES / 16)
+#define MAX_PARTICLES (NUM_PARTICLES * 16)
 
-    static GLfloat vertexData[NUM_PARTICLES * 2];
-    static GLfloat colorData[NUM_PARTICLES * 3];
+    // Sized for MAX_PARTICLES at startup, 64-byte aligned, optionally on huge pages.
+    StreamBuffer vertexStream;
+    StreamBuffer colorStream;
+    GLfloat *vertexData;
+    GLfloat *colorData;
 
 // OpenGL ES 2.0 uses shaders
 
@@ -63,6 +73,42 @@ namespace GLContext {
 
 }; using namespace GLContext;
 
+namespace Framing {
+    // (u, v) to clip space, fitted to the percentile bounds of the first points of the next frame,
+    // and again once t has drifted by T_STEP; off, the hand-tuned 1440x900 fit above.
+    bool enabled = true;
+    ViewFit fit;
+    double framedT = 0.0;
+
+    constexpr double T_STEP = 0.1;
+    constexpr int SAMPLES = 8192;
+    constexpr double TAIL = 0.002;
+    constexpr double MARGIN = 0.05;
+    constexpr double TOLERANCE = 0.03;
+}
+
+namespace Checkpoints {
+    // Keyframes of x, y, t and the framing (fit and framed t), see CheckpointIndex. Every frame steps
+    // NUM_PARTICLES points whatever the budget, so keyframes hold at any --target-ms.
+    CheckpointIndex *index = nullptr;
+    constexpr int STATE = 8;
+    uint64_t frame = 0;
+}
+
+namespace Budget {
+    FrameBudget *frame;
+    int computeStage;
+    int drawStage;
+    int presentStage;
+    // The draw stage is timed on the GPU, where the fill happens: two timer queries, one being read
+    // back while the other times, and the particles each timed; without timer queries, the CPU time.
+    bool gpuTimed = false;
+    GLuint drawQueries[2];
+    int queryPoints[2];
+    int queryIndex = 0;
+    double nsPerPoint = 0.0;
+}
+
 
 static void enableTexturing() {
 
@@ -74,7 +120,166 @@ static void enableTexturing() {
 
 }
 
-void RendererInit() {
+static ViewFit handTunedFit() {
+    ViewFit fit;
+    fit.scaleX = daw;
+    fit.scaleY = dah;
+    fit.offsetX = (0.5 - minX) * daw;
+    fit.offsetY = (0.5 - minY) * dah + 0.5;
+    return fit;
+}
+
+/**
+ * Runs the first points of the next frame on copies of the state, and fits their percentile bounds
+ * to the viewport. A frame is one serial recurrence, so its prefix is sampled rather than split up.
+ */
+static ViewFit frameBubbles() {
+    const int samples = std::min(NUM_PARTICLES, Framing::SAMPLES);
+    std::vector<double> us((size_t)samples), vs((size_t)samples);
+    double sx = x, sy = y, j = 0;
+    for (int i = 0; i < samples; i++) {
+        const double u = sin(i + sy) + sin(j / (NUM_PARTICLES * M_PI) + sx);
+        const double v = cos(i + sy) + cos(j / (NUM_PARTICLES * M_PI) + sx);
+        sx = u + t;
+        sy = v + t;
+        us[i] = u;
+        vs[i] = v;
+        j += t;
+    }
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    const double aspect = (double)std::max(viewport[2], 1) / std::max(viewport[3], 1);
+    return fitBounds(percentileBounds(us, vs, Framing::TAIL), aspect, Framing::MARGIN);
+}
+
+/**
+ * Frames the next frame again once t has drifted by Framing::T_STEP.
+ * @param force frames now, whatever the drift.
+ */
+static void reframe(bool force) {
+    using namespace Framing;
+
+    if (!enabled || (!force && fabs(t - framedT) <= T_STEP)) {
+        return;
+    }
+    framedT = t;
+    const ViewFit next = frameBubbles();
+    if (force || fitDiffers(fit, next, TOLERANCE)) {
+        fit = next;
+    }
+}
+
+static void saveState(double *state) {
+    state[0] = x;
+    state[1] = y;
+    state[2] = t;
+    state[3] = Framing::fit.scaleX;
+    state[4] = Framing::fit.scaleY;
+    state[5] = Framing::fit.offsetX;
+    state[6] = Framing::fit.offsetY;
+    state[7] = Framing::framedT;
+}
+
+static void restoreState(const double *state) {
+    x = state[0];
+    y = state[1];
+    t = state[2];
+    Framing::fit.scaleX = state[3];
+    Framing::fit.scaleY = state[4];
+    Framing::fit.offsetX = state[5];
+    Framing::fit.offsetY = state[6];
+    Framing::framedT = state[7];
+}
+
+/**
+ * Computes `count` particles of the next frame into the streams, and advances the animation.
+ * The animation always steps NUM_PARTICLES points, whatever the budget, so that frame N is the same
+ * on any machine: fewer particles are an even subset of the same curve, more carry it on from a
+ * copy of the state. The recurrence is serial, so a smaller budget saves the colours, writes and
+ * fill of the points dropped, not their steps.
+ */
+static void computeFrame(int count) {
+    if (Checkpoints::index && Checkpoints::index->due(Checkpoints::frame)) {
+        double state[Checkpoints::STATE];
+        saveState(state);
+        Checkpoints::index->record(Checkpoints::frame, state);
+    }
+    reframe(false);
+//    Paul Dunn's Bubble Universe 3
+//  Using REL's GlowImage <u>https://rel.phatcode.net</u>
+    const int steps = std::max(count, NUM_PARTICLES);
+    double j = 0;
+    double px = x, py = y;
+    int drawn = 0;
+    for (int i = 0; i < steps; i++) {
+        // PaulDunn, creator of SpecBasic, interpreter for SinClair Basic.
+        const double u = sin(i + py) + sin(j / (NUM_PARTICLES * M_PI) + px);
+        const double v = cos(i + py) + cos(j / (NUM_PARTICLES * M_PI) + px);
+        px = u + t;
+        py = v + t;
+        j += t;
+        if (i == NUM_PARTICLES - 1) {
+            x = px;
+            y = py;
+        }
+        // Point i is drawn when it starts a new one of `count` even steps over the NUM_PARTICLES.
+        if (count < NUM_PARTICLES
+            && (long long)i * count / NUM_PARTICLES == (long long)(i + 1) * count / NUM_PARTICLES) {
+            continue;
+        }
+
+        const Color color = Color::createHue(
+                cos(cos(i) - sin(t *PHI *PHI *PHI)));
+
+        const auto vX = static_cast<GLfloat>(u * Framing::fit.scaleX + Framing::fit.offsetX);
+        const auto vY = static_cast<GLfloat>(v * Framing::fit.scaleY + Framing::fit.offsetY);
+
+        const int vI = drawn * 2;
+        vertexData[vI + 0] = vX;
+        vertexData[vI + 1] = vY;
+
+        const int cI = drawn * 3;
+        colorData[cI + 0] = static_cast<GLfloat>(color.r);
+        colorData[cI + 1] = static_cast<GLfloat>(color.g);
+        colorData[cI + 2] = static_cast<GLfloat>(color.b);
+        drawn++;
+    }
+    t += 1.0 / 600.0;
+    Checkpoints::frame++;
+}
+
+/**
+ * Restores the keyframe before `frame` and computes the frames in between, undrawn.
+ */
+static bool seek(uint64_t frame) {
+    uint64_t keyFrame;
+    std::vector<double> state;
+    if (!Checkpoints::index->nearest(frame, keyFrame, state)) {
+        return false;
+    }
+    restoreState(state.data());
+    Checkpoints::frame = keyFrame;
+    // Undrawn, so with as few particles as allowed: the animation steps the same.
+    while (Checkpoints::frame < frame) {
+        computeFrame(MIN_PARTICLES);
+    }
+    eggLogMessage("Seeked to frame %llu from the keyframe of frame %llu\n",
+                  (unsigned long long)frame, (unsigned long long)keyFrame);
+    return true;
+}
+
+void RendererInit(double targetMS, StreamPages pages, bool autoFrame, const CheckpointOptions &checkpoints) {
+    vertexStream = StreamBuffer(MAX_PARTICLES * 2 * sizeof(GLfloat), pages);
+    colorStream = StreamBuffer(MAX_PARTICLES * 3 * sizeof(GLfloat), pages);
+    vertexData = vertexStream.as<GLfloat>();
+    colorData = colorStream.as<GLfloat>();
+    if (!vertexData || !colorData) {
+        fprintf(stderr, "Unable to allocate the particle streams.\n");
+        SDL_Quit();
+    }
+    eggLogMessage("Particle streams on %s pages\n", streamPagesName(vertexStream.pages()));
+
     // Creates new OpenGL shader, (330 core)
 
 ////  Read vert shader source.
@@ -130,6 +335,79 @@ void RendererInit() {
     glPointSize(32);
 
     setBackgroundColor(0.0f, 0.2f, 0.2f, 0.0f);
+
+    Budget::frame = new FrameBudget(MIN_PARTICLES, MAX_PARTICLES, targetMS, NUM_PARTICLES);
+    Budget::computeStage = Budget::frame->addStage("compute");
+    Budget::drawStage = Budget::frame->addStage("draw");
+    // The swap waits for vsync, whatever the particle count.
+    Budget::presentStage = Budget::frame->addStage("present", false);
+    Budget::gpuTimed = glGenQueries && glBeginQuery && glGetQueryObjectui64v;
+    if (Budget::gpuTimed) {
+        glGenQueries(2, Budget::drawQueries);
+        Budget::queryPoints[0] = Budget::queryPoints[1] = 0;
+    }
+    eggLogMessage("Frame budget: %.1fms of work, %d to %d particles\n",
+                  targetMS, MIN_PARTICLES, MAX_PARTICLES);
+
+    Framing::enabled = autoFrame;
+    Framing::fit = handTunedFit();
+    reframe(true);
+    eggLogMessage("Framing %s\n", autoFrame ? "from the sampled bounds" : "hand-tuned");
+
+    if (checkpoints.path) {
+        Checkpoints::index = new CheckpointIndex("PaulDunn", Checkpoints::STATE, checkpoints.interval,
+                                                 NUM_PARTICLES);
+        // A seek only reads the index; a run from the start writes it.
+        if (checkpoints.seek >= 0) {
+            if (!Checkpoints::index->load(checkpoints.path) || !seek((uint64_t)checkpoints.seek)) {
+                eggLogMessage("Unable to seek to frame %ld with %s\n", checkpoints.seek, checkpoints.path);
+            }
+        } else if (!Checkpoints::index->open(checkpoints.path)) {
+            eggLogMessage("Unable to create %s\n", checkpoints.path);
+        }
+    }
+}
+
+/**
+ * Collects the finished timer query, if any, and starts timing the draw of `count` particles.
+ */
+static void beginTimedDraw(int count) {
+    using namespace Budget;
+
+    if (!gpuTimed) {
+        return;
+    }
+    const int prev = queryIndex ^ 1;
+    GLint available = 0;
+    if (queryPoints[prev] > 0) {
+        glGetQueryObjectiv(drawQueries[prev], GL_QUERY_RESULT_AVAILABLE, &available);
+    }
+    if (available) {
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(drawQueries[prev], GL_QUERY_RESULT, &ns);
+        const double cost = (double)ns / queryPoints[prev];
+        nsPerPoint = nsPerPoint > 0.0 ? nsPerPoint * 0.9 + cost * 0.1 : cost;
+        queryPoints[prev] = 0;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, drawQueries[queryIndex]);
+    queryPoints[queryIndex] = count;
+}
+
+/**
+ * Ends the timed draw, and hands the budget the GPU time of `count` particles, from the frames
+ * read back so far.
+ */
+static void endTimedDraw(int count) {
+    using namespace Budget;
+
+    if (!gpuTimed) {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    queryIndex ^= 1;
+    if (nsPerPoint > 0.0) {
+        frame->setStageMS(drawStage, nsPerPoint * count * 1.0e-6);
+    }
 }
 
 void updateTiming(const time_point<system_clock, milliseconds> lastFrameTime) {
@@ -147,6 +425,7 @@ void updateTiming(const time_point<system_clock, milliseconds> lastFrameTime) {
 
     if (elapsedMS >= 1000) {
         eggLogMessage("%d FPS, %dms lagged\n", frames, latency);
+        eggLogMessage("%ld particles (%s)\n", Budget::frame->budget(), Budget::frame->report().c_str());
         frames = 0;
         elapsedMS = 0;
         latency = 0;
@@ -159,44 +438,38 @@ void Render() {
     const auto lastTime = clock_now();
 
     if (paused) return;
+    Budget::frame->beginFrame();
     ClearScreen();
 
-//    Paul Dunn's Bubble Universe 3
-//  Using REL's GlowImage <u>https://rel.phatcode.net</u>
-    double j = 0;
-    for (int i = 0; i < NUM_PARTICLES; i++) {
-        // PaulDunn, creator of SpecBasic, interpreter for SinClair Basic.
-        const double u = sin(i + y) + sin(j / (NUM_PARTICLES * M_PI) + x);
-        const double v = cos(i + y) + cos(j / (NUM_PARTICLES * M_PI) + x);
-        x = u + t;
-        y = v + t;
+    const int count = static_cast<int>(Budget::frame->budget());
+    computeFrame(count);
+    Budget::frame->endStage(Budget::computeStage);
 
-        const Color color = Color::createHue(
-                cos(cos(i) - sin(t *PHI *PHI *PHI)));
-
-        const auto vX = static_cast<GLfloat>((u - minX + 0.5) * daw);
-        const auto vY = static_cast<GLfloat>((v - minY + 0.5) * dah + 0.5);
-
-        const int vI = i * 2;
-        vertexData[vI + 0] = vX;
-        vertexData[vI + 1] = vY;
-
-        const int cI = i * 3;
-        colorData[cI + 0] = static_cast<GLfloat>(color.r);
-        colorData[cI + 1] = static_cast<GLfloat>(color.g);
-        colorData[cI + 2] = static_cast<GLfloat>(color.b);
-        j += t;
-    }
-    t += 1.0 / 600.0;
-
-    glDrawArrays(GL_POINTS, 0, NUM_PARTICLES);
+    beginTimedDraw(count);
+    glDrawArrays(GL_POINTS, 0, count);
+    Budget::frame->endStage(Budget::drawStage);
+    endTimedDraw(count);
 
     updateTiming(std::chrono::time_point_cast<milliseconds, system_clock>( lastTime));
 
     UpdateWindow();
+    Budget::frame->endStage(Budget::presentStage);
+    Budget::frame->endFrame();
 
 }
 
 void Shutdown() {
     eggLogMessage("Rendered %d frames over %.2fs\n", totalFrames, (double)totalTimeMS / 1000.0);
+    if (Checkpoints::index) {
+        eggLogMessage("%zu keyframes, one every %d frames\n", Checkpoints::index->count(),
+                      Checkpoints::index->interval());
+        delete Checkpoints::index;
+        Checkpoints::index = nullptr;
+    }
+    if (Budget::gpuTimed) {
+        glDeleteQueries(2, Budget::drawQueries);
+    }
+    delete Budget::frame;
+    vertexStream = StreamBuffer();
+    colorStream = StreamBuffer();
 }
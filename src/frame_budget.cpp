@@ -0,0 +1,98 @@
+#include "frame_budget.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+    // Work times within 10% of the target leave the budget alone.
+    constexpr double band = 0.10;
+    // Shrink quickly so a stall is short, grow slowly so it does not oscillate.
+    constexpr int shrinkFrames = 3;
+    constexpr int growFrames = 15;
+    constexpr double maxShrink = 0.5;
+    constexpr double maxGrow = 1.25;
+    // Weight of the newest frame in the smoothed times.
+    constexpr double smoothing = 0.2;
+    constexpr int warmupFrames = 8;
+}
+
+FrameBudget::FrameBudget(long floor, long ceiling, double targetMS, long start)
+        : floor(std::max(1L, std::min(floor, ceiling))), ceiling(std::max(1L, ceiling)),
+          targetMS(targetMS), current(std::min(std::max(start, this->floor), this->ceiling)),
+          warmup(warmupFrames) {
+}
+
+int FrameBudget::addStage(const char *name, bool counted) {
+    stages.push_back({name, counted, 0.0, 0.0});
+    return static_cast<int>(stages.size()) - 1;
+}
+
+void FrameBudget::beginFrame() {
+    stageStart = Clock::now();
+    for (Stage &stage : stages) {
+        stage.lastMS = 0.0;
+    }
+}
+
+void FrameBudget::endStage(int stage) {
+    const auto now = Clock::now();
+    const double ms = std::chrono::duration<double, std::milli>(now - stageStart).count();
+    stages[stage].lastMS += ms;
+    stageStart = now;
+}
+
+void FrameBudget::setStageMS(int stage, double ms) {
+    stages[stage].lastMS = ms;
+}
+
+long FrameBudget::endFrame() {
+    double ms = 0.0;
+    for (Stage &stage : stages) {
+        stage.ms += (stage.lastMS - stage.ms) * smoothing;
+        if (stage.counted) {
+            ms += stage.lastMS;
+        }
+    }
+    // The first frames pay for shader compiles and page faults, they are not representative.
+    if (warmup > 0) {
+        warmup--;
+        return current;
+    }
+    smoothedMS = smoothedMS > 0.0 ? smoothedMS + (ms - smoothedMS) * smoothing : ms;
+    if (targetMS <= 0.0) {
+        return current;
+    }
+
+    if (smoothedMS > targetMS * (1.0 + band)) {
+        outside = std::max(outside, 0) + 1;
+    } else if (smoothedMS < targetMS * (1.0 - band)) {
+        outside = std::min(outside, 0) - 1;
+    } else {
+        outside = 0;
+    }
+    if (outside >= shrinkFrames || outside <= -growFrames) {
+        // Work is taken to scale linearly with its time, the step is bounded either way.
+        const double scale = std::min(std::max(targetMS / smoothedMS, maxShrink), maxGrow);
+        long next = static_cast<long>(current * scale);
+        if (next == current) {
+            next += outside > 0 ? -1 : 1;
+        }
+        next = std::min(std::max(next, floor), ceiling);
+        // The old work times were measured with the old budget.
+        smoothedMS *= static_cast<double>(next) / current;
+        current = next;
+        outside = 0;
+    }
+    return current;
+}
+
+std::string FrameBudget::report() const {
+    std::string text;
+    char stageText[64];
+    for (const Stage &stage : stages) {
+        snprintf(stageText, sizeof(stageText), "%s%s %.2fms",
+                 text.empty() ? "" : ", ", stage.name.c_str(), stage.ms);
+        text += stageText;
+    }
+    return text;
+}
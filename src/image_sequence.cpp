@@ -0,0 +1,648 @@
+#include "image_sequence.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef EGG_ZLIB
+#include <zlib.h>
+#endif
+#ifdef __unix__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    double secondsSince(Clock::time_point start, Clock::time_point now) {
+        return std::chrono::duration<double>(now - start).count();
+    }
+
+    const uint8_t *rowOf(const uint8_t *rgba, int width, int height, bool bottomUp, int y) {
+        return rgba + (size_t)(bottomUp ? height - 1 - y : y) * width * 4;
+    }
+
+    void putBE32(std::vector<uint8_t> &out, uint32_t v) {
+        const uint8_t bytes[4] = {(uint8_t)(v >> 24), (uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v};
+        out.insert(out.end(), bytes, bytes + 4);
+    }
+
+    void encodePPM(const uint8_t *rgba, int width, int height, bool bottomUp, std::vector<uint8_t> &out) {
+        char header[64];
+        const int length = snprintf(header, sizeof header, "P6\n%d %d\n255\n", width, height);
+        out.assign(header, header + length);
+        out.resize((size_t)length + (size_t)width * height * 3);
+        uint8_t *dst = out.data() + length;
+        for (int y = 0; y < height; y++) {
+            const uint8_t *in = rowOf(rgba, width, height, bottomUp, y);
+            for (int x = 0; x < width; x++, dst += 3) {
+                dst[0] = in[x * 4 + 0];
+                dst[1] = in[x * 4 + 1];
+                dst[2] = in[x * 4 + 2];
+            }
+        }
+    }
+
+    uint32_t crc32Of(const uint8_t *data, size_t length, uint32_t crc = 0) {
+        static uint32_t table[256];
+        static const bool built = [] {
+            for (uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++) {
+                    c = c & 1u ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                table[n] = c;
+            }
+            return true;
+        }();
+        (void)built;
+        crc = ~crc;
+        for (size_t i = 0; i < length; i++) {
+            crc = table[(crc ^ data[i]) & 0xFFu] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    const uint8_t PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+    void putChunk(std::vector<uint8_t> &out, const char type[4], const uint8_t *data, size_t length) {
+        putBE32(out, (uint32_t)length);
+        const size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data, data + length);
+        putBE32(out, crc32Of(out.data() + start, length + 4));
+    }
+
+    /** A zlib stream of `raw`: deflated at the fastest level with zlib, else in stored blocks. */
+    void zlibStream(const std::vector<uint8_t> &raw, std::vector<uint8_t> &out) {
+#ifdef EGG_ZLIB
+        uLongf length = compressBound((uLong)raw.size());
+        out.resize(length);
+        if (compress2(out.data(), &length, raw.data(), (uLong)raw.size(), Z_BEST_SPEED) == Z_OK) {
+            out.resize(length);
+            return;
+        }
+#endif
+        constexpr size_t BLOCK = 65535;
+        out.assign({0x78, 0x01});
+        uint32_t a = 1, b = 0;
+        for (size_t at = 0; at < raw.size() || at == 0; at += BLOCK) {
+            const size_t length = std::min(BLOCK, raw.size() - at);
+            const uint8_t last = at + length >= raw.size() ? 1 : 0;
+            const uint8_t header[5] = {last, (uint8_t)length, (uint8_t)(length >> 8),
+                                       (uint8_t)~length, (uint8_t)(~length >> 8)};
+            out.insert(out.end(), header, header + 5);
+            out.insert(out.end(), raw.begin() + at, raw.begin() + at + length);
+            for (size_t i = at; i < at + length; i++) {
+                a = (a + raw[i]) % 65521;
+                b = (b + a) % 65521;
+            }
+            if (last) {
+                break;
+            }
+        }
+        putBE32(out, b << 16 | a);
+    }
+
+    /** The signature and IHDR of an RGB PNG of `depth` bits per channel. */
+    void putPNGHeader(std::vector<uint8_t> &out, int width, int height, int depth) {
+        out.assign(PNG_SIGNATURE, PNG_SIGNATURE + 8);
+        std::vector<uint8_t> header;
+        putBE32(header, (uint32_t)width);
+        putBE32(header, (uint32_t)height);
+        // RGB, deflate, adaptive filters, no interlace.
+        header.insert(header.end(), {(uint8_t)depth, 2, 0, 0, 0});
+        putChunk(out, "IHDR", header.data(), header.size());
+    }
+
+    /** An RGB PNG of `depth` bits per channel, whose rows `fillRow(y, row)` fills from the top. */
+    template<typename FillRow>
+    void encodePNG(int width, int height, int depth, FillRow fillRow, std::vector<uint8_t> &out) {
+        // Every row filtered with Up, which suits the smooth gradients of the glow.
+        const size_t stride = (size_t)width * 3 * depth / 8;
+        std::vector<uint8_t> raw((stride + 1) * height);
+        std::vector<uint8_t> previous(stride, 0), current(stride);
+        for (int y = 0; y < height; y++) {
+            fillRow(y, current.data());
+            uint8_t *dst = raw.data() + (stride + 1) * y;
+            dst[0] = 2;
+            for (size_t i = 0; i < stride; i++) {
+                dst[1 + i] = (uint8_t)(current[i] - previous[i]);
+            }
+            previous.swap(current);
+        }
+        std::vector<uint8_t> deflated;
+        zlibStream(raw, deflated);
+
+        putPNGHeader(out, width, height, depth);
+        putChunk(out, "IDAT", deflated.data(), deflated.size());
+        putChunk(out, "IEND", nullptr, 0);
+    }
+
+    void encodePNG8(const uint8_t *rgba, int width, int height, bool bottomUp, std::vector<uint8_t> &out) {
+        encodePNG(width, height, 8, [&](int y, uint8_t *row) {
+            const uint8_t *in = rowOf(rgba, width, height, bottomUp, y);
+            for (int x = 0; x < width; x++) {
+                memcpy(row + x * 3, in + x * 4, 3);
+            }
+        }, out);
+    }
+
+    /** 8 bits widened to 16, so that a png16 sequence stays one format whatever was pushed. */
+    void encodePNG16(const uint8_t *rgba, int width, int height, bool bottomUp, std::vector<uint8_t> &out) {
+        encodePNG(width, height, 16, [&](int y, uint8_t *row) {
+            const uint8_t *in = rowOf(rgba, width, height, bottomUp, y);
+            for (int x = 0; x < width; x++) {
+                for (int c = 0; c < 3; c++) {
+                    row[(x * 3 + c) * 2] = row[(x * 3 + c) * 2 + 1] = in[x * 4 + c];
+                }
+            }
+        }, out);
+    }
+
+    void encodePNG16(const uint16_t *rgba, int width, int height, bool bottomUp, std::vector<uint8_t> &out) {
+        encodePNG(width, height, 16, [&](int y, uint8_t *row) {
+            const uint16_t *in = rgba + (size_t)(bottomUp ? height - 1 - y : y) * width * 4;
+            for (int x = 0; x < width; x++) {
+                for (int c = 0; c < 3; c++) {
+                    // PNG samples are big-endian.
+                    row[(x * 3 + c) * 2] = (uint8_t)(in[x * 4 + c] >> 8);
+                    row[(x * 3 + c) * 2 + 1] = (uint8_t)in[x * 4 + c];
+                }
+            }
+        }, out);
+    }
+
+    void encodeQOI(const uint8_t *rgba, int width, int height, bool bottomUp, std::vector<uint8_t> &out) {
+        constexpr uint8_t OP_RGB = 0xFE, OP_INDEX = 0x00, OP_DIFF = 0x40, OP_LUMA = 0x80, OP_RUN = 0xC0;
+        out.assign({'q', 'o', 'i', 'f'});
+        putBE32(out, (uint32_t)width);
+        putBE32(out, (uint32_t)height);
+        // RGB, sRGB with linear alpha.
+        out.insert(out.end(), {3, 0});
+        out.reserve(out.size() + (size_t)width * height * 4 + 8);
+
+        uint8_t seen[64][3] = {};
+        // The decoder's index starts out transparent black, which no pixel here matches.
+        bool known[64] = {};
+        uint8_t prev[3] = {0, 0, 0};
+        int run = 0;
+        for (int y = 0; y < height; y++) {
+            const uint8_t *in = rowOf(rgba, width, height, bottomUp, y);
+            for (int x = 0; x < width; x++) {
+                const uint8_t *px = in + x * 4;
+                if (px[0] == prev[0] && px[1] == prev[1] && px[2] == prev[2]) {
+                    if (++run == 62) {
+                        out.push_back((uint8_t)(OP_RUN | (run - 1)));
+                        run = 0;
+                    }
+                    continue;
+                }
+                if (run > 0) {
+                    out.push_back((uint8_t)(OP_RUN | (run - 1)));
+                    run = 0;
+                }
+                // Alpha is always 255 in RGB images.
+                const int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + 255 * 11) % 64;
+                if (known[hash] && memcmp(seen[hash], px, 3) == 0) {
+                    out.push_back((uint8_t)(OP_INDEX | hash));
+                } else {
+                    memcpy(seen[hash], px, 3);
+                    known[hash] = true;
+                    const int dr = (int8_t)(px[0] - prev[0]), dg = (int8_t)(px[1] - prev[1]);
+                    const int db = (int8_t)(px[2] - prev[2]);
+                    const int drg = dr - dg, dbg = db - dg;
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                        out.push_back((uint8_t)(OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                    } else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+                        out.push_back((uint8_t)(OP_LUMA | (dg + 32)));
+                        out.push_back((uint8_t)((drg + 8) << 4 | (dbg + 8)));
+                    } else {
+                        out.insert(out.end(), {OP_RGB, px[0], px[1], px[2]});
+                    }
+                }
+                memcpy(prev, px, 3);
+            }
+        }
+        if (run > 0) {
+            out.push_back((uint8_t)(OP_RUN | (run - 1)));
+        }
+        out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+    }
+}
+
+const char *imageFormatName(ImageFormat format) {
+    switch (format) {
+        case IMAGE_PNG: return "png";
+        case IMAGE_QOI: return "qoi";
+        case IMAGE_PNG16: return "png16";
+        default: return "ppm";
+    }
+}
+
+const char *imageExtension(ImageFormat format) {
+    return format == IMAGE_PNG16 ? "png" : imageFormatName(format);
+}
+
+bool parseImageFormat(const char *name, ImageFormat &format) {
+    for (ImageFormat candidate : {IMAGE_PPM, IMAGE_PNG, IMAGE_QOI, IMAGE_PNG16}) {
+        if (strcmp(name, imageFormatName(candidate)) == 0) {
+            format = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void encodeImage(ImageFormat format, const uint8_t *rgba, int width, int height, bool bottomUp,
+                 std::vector<uint8_t> &out) {
+    switch (format) {
+        case IMAGE_PNG: encodePNG8(rgba, width, height, bottomUp, out); break;
+        case IMAGE_QOI: encodeQOI(rgba, width, height, bottomUp, out); break;
+        case IMAGE_PNG16: encodePNG16(rgba, width, height, bottomUp, out); break;
+        default: encodePPM(rgba, width, height, bottomUp, out); break;
+    }
+}
+
+void encodeImage16(const uint16_t *rgba, int width, int height, bool bottomUp, std::vector<uint8_t> &out) {
+    encodePNG16(rgba, width, height, bottomUp, out);
+}
+
+ImageStripWriter::ImageStripWriter(const char *path, ImageFormat format, int width, int height)
+        : file(nullptr), format(format), width(width), height(height) {
+    if (format == IMAGE_QOI || width <= 0 || height <= 0) {
+        return;
+    }
+    file = fopen(path, "wb");
+    if (!file) {
+        return;
+    }
+    std::vector<uint8_t> header;
+    if (format == IMAGE_PPM) {
+        char text[64];
+        const int length = snprintf(text, sizeof text, "P6\n%d %d\n255\n", width, height);
+        header.assign(text, text + length);
+        put(header);
+        row.resize((size_t)width * 3);
+        return;
+    }
+    const int depth = format == IMAGE_PNG16 ? 16 : 8;
+    putPNGHeader(header, width, height, depth);
+    put(header);
+    const size_t stride = (size_t)width * 3 * depth / 8;
+    previous.assign(stride, 0);
+    row.resize(stride);
+    filtered.resize(stride + 1);
+#ifdef EGG_ZLIB
+    z_stream *z = new z_stream();
+    if (deflateInit(z, Z_BEST_SPEED) == Z_OK) {
+        stream = z;
+        return;
+    }
+    delete z;
+#endif
+    // Stored blocks, after the zlib header.
+    deflated.assign({0x78, 0x01});
+}
+
+ImageStripWriter::~ImageStripWriter() {
+    finish();
+}
+
+bool ImageStripWriter::write(const uint8_t *rgba, int rows) {
+    for (int y = 0; y < rows && ok(); y++, rowsWritten++) {
+        if (rowsWritten >= height) {
+            failed = true;
+            break;
+        }
+        const uint8_t *in = rgba + (size_t)y * width * 4;
+        for (int x = 0; x < width; x++) {
+            for (int c = 0; c < 3; c++) {
+                if (format == IMAGE_PNG16) {
+                    row[(x * 3 + c) * 2] = row[(x * 3 + c) * 2 + 1] = in[x * 4 + c];
+                } else {
+                    row[x * 3 + c] = in[x * 4 + c];
+                }
+            }
+        }
+        putRow();
+    }
+    return ok();
+}
+
+bool ImageStripWriter::write16(const uint16_t *rgba, int rows) {
+    for (int y = 0; y < rows && ok(); y++, rowsWritten++) {
+        if (rowsWritten >= height) {
+            failed = true;
+            break;
+        }
+        const uint16_t *in = rgba + (size_t)y * width * 4;
+        for (int x = 0; x < width; x++) {
+            for (int c = 0; c < 3; c++) {
+                if (format == IMAGE_PNG16) {
+                    row[(x * 3 + c) * 2] = (uint8_t)(in[x * 4 + c] >> 8);
+                    row[(x * 3 + c) * 2 + 1] = (uint8_t)in[x * 4 + c];
+                } else {
+                    row[x * 3 + c] = (uint8_t)((in[x * 4 + c] + 128) / 257);
+                }
+            }
+        }
+        putRow();
+    }
+    return ok();
+}
+
+bool ImageStripWriter::finish() {
+    if (!file) {
+        return false;
+    }
+    if (format != IMAGE_PPM) {
+        writeRaw(nullptr, 0, true);
+        std::vector<uint8_t> end;
+        putChunk(end, "IEND", nullptr, 0);
+        put(end);
+    }
+#ifdef EGG_ZLIB
+    if (stream) {
+        deflateEnd((z_stream *)stream);
+        delete (z_stream *)stream;
+        stream = nullptr;
+    }
+#endif
+    if (fclose(file) != 0) {
+        failed = true;
+    }
+    file = nullptr;
+    return !failed && rowsWritten == height;
+}
+
+void ImageStripWriter::putRow() {
+    if (format == IMAGE_PPM) {
+        put(row);
+        return;
+    }
+    // Up, as encodePNG() filters.
+    filtered[0] = 2;
+    for (size_t i = 0; i < row.size(); i++) {
+        filtered[1 + i] = (uint8_t)(row[i] - previous[i]);
+    }
+    previous.swap(row);
+    writeRaw(filtered.data(), filtered.size(), false);
+}
+
+void ImageStripWriter::writeRaw(const uint8_t *raw, size_t length, bool last) {
+    constexpr size_t IDAT_BYTES = (size_t)1 << 18;
+#ifdef EGG_ZLIB
+    if (stream) {
+        z_stream *z = (z_stream *)stream;
+        z->next_in = (Bytef *)raw;
+        z->avail_in = (uInt)length;
+        uint8_t out[1 << 16];
+        int result;
+        do {
+            z->next_out = out;
+            z->avail_out = sizeof out;
+            result = deflate(z, last ? Z_FINISH : Z_NO_FLUSH);
+            deflated.insert(deflated.end(), out, out + (sizeof out - z->avail_out));
+        } while (result != Z_STREAM_ERROR && (z->avail_out == 0 || (last && result != Z_STREAM_END)));
+        if (result == Z_STREAM_ERROR) {
+            failed = true;
+        }
+    } else
+#endif
+    {
+        constexpr size_t BLOCK = 65535;
+        for (size_t at = 0; at < length; at += BLOCK) {
+            const size_t block = std::min(BLOCK, length - at);
+            const uint8_t header[5] = {0, (uint8_t)block, (uint8_t)(block >> 8),
+                                       (uint8_t)~block, (uint8_t)(~block >> 8)};
+            deflated.insert(deflated.end(), header, header + 5);
+            deflated.insert(deflated.end(), raw + at, raw + at + block);
+            for (size_t i = at; i < at + block; i++) {
+                adlerA = (adlerA + raw[i]) % 65521;
+                adlerB = (adlerB + adlerA) % 65521;
+            }
+        }
+        if (last) {
+            // An empty final block ends the stream.
+            deflated.insert(deflated.end(), {1, 0, 0, 0xFF, 0xFF});
+            putBE32(deflated, adlerB << 16 | adlerA);
+        }
+    }
+    if (deflated.size() >= IDAT_BYTES || (last && !deflated.empty())) {
+        std::vector<uint8_t> chunk;
+        putChunk(chunk, "IDAT", deflated.data(), deflated.size());
+        put(chunk);
+        deflated.clear();
+    }
+}
+
+void ImageStripWriter::put(const std::vector<uint8_t> &bytes) {
+    if (fwrite(bytes.data(), 1, bytes.size(), file) != bytes.size()) {
+        failed = true;
+    }
+}
+
+ImageSequenceWriter::ImageSequenceWriter(const char *directory, const ImageSequenceOptions &options)
+        : directory(directory), options(options), started(Clock::now()), reported(started) {
+    unsigned threads = options.threads > 0 ? options.threads : std::thread::hardware_concurrency();
+    threads = std::max(threads, 1u);
+    for (unsigned i = 0; i < threads; i++) {
+        encoders.emplace_back(&ImageSequenceWriter::encoderLoop, this);
+    }
+}
+
+ImageSequenceWriter::~ImageSequenceWriter() {
+    finish();
+}
+
+void ImageSequenceWriter::push(const uint8_t *rgba, int width, int height, bool bottomUp, long frame) {
+    enqueue(Job::RGBA8, rgba, (size_t)width * height * 4, width, height, bottomUp, frame, 0);
+}
+
+void ImageSequenceWriter::push16(const uint16_t *rgba, int width, int height, bool bottomUp, long frame) {
+    enqueue(Job::RGBA16, (const uint8_t *)rgba, (size_t)width * height * 8, width, height, bottomUp, frame, 0);
+}
+
+void ImageSequenceWriter::pushDensity(const uint32_t *counts, int width, int height, uint32_t peak,
+                                      bool bottomUp, long frame) {
+    if (options.density == DENSITY_NONE) {
+        return;
+    }
+    enqueue(Job::DENSITY, (const uint8_t *)counts, (size_t)width * height * 4, width, height, bottomUp, frame,
+            peak);
+}
+
+void ImageSequenceWriter::enqueue(Job::Kind kind, const uint8_t *data, size_t bytes, int width, int height,
+                                  bool bottomUp, long frame, uint32_t peak) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (held > 0 && held + bytes > options.memoryCap) {
+        const Clock::time_point waited = Clock::now();
+        freed.wait(lock, [&] { return held == 0 || held + bytes <= options.memoryCap; });
+        totals.waitSeconds += secondsSince(waited, Clock::now());
+    }
+    held += bytes;
+    totals.peakMemory = std::max(totals.peakMemory, held);
+    Job job;
+    if (!spare.empty()) {
+        job.data.swap(spare.back());
+        spare.pop_back();
+    }
+    lock.unlock();
+
+    // The copy runs outside the lock, the only work left on the caller's thread.
+    job.data.assign(data, data + bytes);
+    job.kind = kind;
+    job.width = width;
+    job.height = height;
+    job.bottomUp = bottomUp;
+    job.frame = frame;
+    job.peak = peak;
+
+    lock.lock();
+    queued.push_back(std::move(job));
+    wake.notify_one();
+}
+
+void ImageSequenceWriter::finish() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (finishing) {
+            return;
+        }
+        finishing = true;
+    }
+    wake.notify_all();
+    for (std::thread &encoder : encoders) {
+        encoder.join();
+    }
+    encoders.clear();
+    const long unsyncable = syncBatch(unsynced);
+#ifdef __unix__
+    if (options.syncEvery > 0) {
+        // The new names, too, are only durable once the directory is synced.
+        const int fd = open(directory.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            fsync(fd);
+            close(fd);
+        }
+    }
+#endif
+    std::lock_guard<std::mutex> lock(mutex);
+    totals.failed += unsyncable;
+    totals.seconds = secondsSince(started, Clock::now());
+}
+
+ImageSequenceWriter::Stats ImageSequenceWriter::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats now = totals;
+    if (!finishing) {
+        now.seconds = secondsSince(started, Clock::now());
+    }
+    return now;
+}
+
+void ImageSequenceWriter::encoderLoop() {
+    std::vector<uint8_t> encoded;
+    for (;;) {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this] { return !queued.empty() || finishing; });
+        if (queued.empty()) {
+            return;
+        }
+        Job job = std::move(queued.front());
+        queued.pop_front();
+        lock.unlock();
+
+        const bool written = writeFile(job, encoded);
+
+        lock.lock();
+        held -= job.data.size();
+        if (written) {
+            totals.frames++;
+            totals.bytes += encoded.size();
+        } else {
+            totals.failed++;
+        }
+        spare.push_back(std::move(job.data));
+        freed.notify_all();
+        std::vector<std::string> batch;
+        if (options.syncEvery > 0 && (int)unsynced.size() >= options.syncEvery) {
+            batch.swap(unsynced);
+        }
+        const Clock::time_point now = Clock::now();
+        if (options.progress && secondsSince(reported, now) >= 1.0) {
+            report(now);
+        }
+        lock.unlock();
+        if (!batch.empty()) {
+            const long unsyncable = syncBatch(batch);
+            lock.lock();
+            totals.failed += unsyncable;
+        }
+    }
+}
+
+bool ImageSequenceWriter::writeFile(const Job &job, std::vector<uint8_t> &encoded) {
+    const char *extension = imageExtension(options.format);
+    switch (job.kind) {
+        case Job::RGBA8:
+            encodeImage(options.format, job.data.data(), job.width, job.height, job.bottomUp, encoded);
+            break;
+        case Job::RGBA16:
+            encodeImage16((const uint16_t *)job.data.data(), job.width, job.height, job.bottomUp, encoded);
+            extension = "png";
+            break;
+        case Job::DENSITY:
+            encodeDensity(options.density, (const uint32_t *)job.data.data(), job.width, job.height, job.peak,
+                          job.bottomUp, encoded);
+            extension = densityExtension(options.density);
+            break;
+    }
+    char path[4096];
+    snprintf(path, sizeof path, "%s/frame_%06ld.%s", directory.c_str(), job.frame, extension);
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+    const bool written = fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+    if (fclose(file) != 0 || !written) {
+        return false;
+    }
+#ifdef __unix__
+    // Synced later by name, so that a batch holds no descriptors open.
+    if (options.syncEvery > 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        unsynced.push_back(path);
+    }
+#endif
+    return true;
+}
+
+long ImageSequenceWriter::syncBatch(std::vector<std::string> &batch) {
+    long failures = 0;
+#ifdef __unix__
+    for (const std::string &path : batch) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        bool synced = fd >= 0 && fsync(fd) == 0;
+        if (fd >= 0 && close(fd) != 0) {
+            synced = false;
+        }
+        if (!synced) {
+            failures++;
+        }
+    }
+#endif
+    batch.clear();
+    return failures;
+}
+
+void ImageSequenceWriter::report(Clock::time_point now) {
+    const double seconds = secondsSince(reported, now);
+    printf("%ld frames written, %.1f frames/s, %.1f MB/s, %.0f MB held, %zu queued\n", totals.frames,
+           (totals.frames - reportedFrames) / seconds, (totals.bytes - reportedBytes) / seconds * 1.0e-6,
+           held * 1.0e-6, queued.size());
+    reported = now;
+    reportedFrames = totals.frames;
+    reportedBytes = totals.bytes;
+}
@@ -1,4 +1,6 @@
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <SDL2/SDL.h>
 
 #ifdef GLES2
@@ -8,6 +10,7 @@
 #ifdef HAVE_OPENGLES2
 
 #include "fractal_renderer.hpp"
+#include "video_stream.hpp"
 
 /**
  * SDL2 on Android and Linux.
@@ -37,11 +40,96 @@ double g_targetAspect = g_targetWidth / static_cast<double>(g_targetHeight);
 
 bool paused = false;
 
+/**
+ * Command line: [--target-ms MS] [--pages small|thp|explicit] [--fixed-frame]
+ *               [--checkpoints FILE] [--checkpoint-every N] [--seek FRAME] [--headless] [--frames N]
+ *               [--stream PATH|-] [--stream-format y4m|rgba] [--stream-policy drop|block] [--stream-fps N]
+ */
+struct RunOptions {
+    /** Renders offscreen, with no window or vsync. */
+    bool headless = false;
+    /** Quits after this many frames; 0 runs until Escape. */
+    long frames = 0;
+    /** Streams every frame shown to this path, "-" for stdout, see VideoStream. */
+    const char *stream = nullptr;
+    VideoFormat streamFormat = VIDEO_Y4M;
+    Backpressure backpressure = BACKPRESSURE_DROP;
+    int streamFPS = 60;
+};
+
+static void parseOptions(int argc, char *argv[], double &targetMS, StreamPages &pages, bool &autoFrame,
+                         CheckpointOptions &checkpoints, RunOptions &run) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--target-ms") == 0 && i + 1 < argc) {
+            targetMS = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--pages") == 0 && i + 1 < argc) {
+            if (!parseStreamPages(argv[++i], pages)) {
+                SDL_Log("Unknown page size '%s'", argv[i]);
+            }
+        } else if (strcmp(argv[i], "--fixed-frame") == 0) {
+            autoFrame = false;
+        } else if (strcmp(argv[i], "--checkpoints") == 0 && i + 1 < argc) {
+            checkpoints.path = argv[++i];
+        } else if (strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc) {
+            checkpoints.interval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seek") == 0 && i + 1 < argc) {
+            checkpoints.seek = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+            run.stream = argv[++i];
+        } else if (strcmp(argv[i], "--stream-format") == 0 && i + 1 < argc) {
+            if (!parseVideoFormat(argv[++i], run.streamFormat)) {
+                SDL_Log("Unknown stream format '%s'", argv[i]);
+            }
+        } else if (strcmp(argv[i], "--stream-policy") == 0 && i + 1 < argc) {
+            if (!parseBackpressure(argv[++i], run.backpressure)) {
+                SDL_Log("Unknown stream policy '%s'", argv[i]);
+            }
+        } else if (strcmp(argv[i], "--stream-fps") == 0 && i + 1 < argc) {
+            run.streamFPS = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            run.headless = true;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            run.frames = atol(argv[++i]);
+        } else {
+            SDL_Log("Unknown option '%s'", argv[i]);
+        }
+    }
+}
+
+/** Closes the stream of --stream, after its last frames are read back. */
+static void closeStream(VideoStream *stream) {
+    if (stream) {
+        stream->close();
+        SDL_Log("Streamed %ld frames, %ld dropped%s", stream->written(), stream->dropped(),
+                stream->failed() ? ", the stream failed" : "");
+        delete stream;
+    }
+}
+
+/** Hands a frame read back by Egg2D to the stream. */
+static void streamFrame(const unsigned char *rgba, int width, int height, long, void *stream) {
+    static_cast<VideoStream *>(stream)->push(rgba, width, height);
+}
+
 int main(int argc, char *argv[]) {
-    bool quit = CreateWindow("Bubble Universe 3.2") != 0;
+    double targetMS = 12.0;
+    StreamPages pages = PAGES_SMALL;
+    bool autoFrame = true;
+    CheckpointOptions checkpoints;
+    RunOptions run;
+    parseOptions(argc, argv, targetMS, pages, autoFrame, checkpoints, run);
+    // Before the window, as streaming to stdout moves the logs to stderr.
+    VideoStream *stream = run.stream ? new VideoStream(run.stream, run.streamFormat, run.backpressure,
+                                                       run.streamFPS) : nullptr;
+    bool quit = (run.headless ? CreateHeadlessWindow("Bubble Universe 3.2")
+                              : CreateWindow("Bubble Universe 3.2")) != 0;
 
     if (!quit)
-        RendererInit();
+        RendererInit(targetMS, pages, autoFrame, checkpoints);
+    if (!quit && stream && eggCaptureStart(3, streamFrame, stream) == 0) {
+        SDL_Log("No pixel-pack buffers or fences: frames are streamed synchronously");
+    }
+    long frame = 0;
 
     while (!quit) {
         SDL_Event event;
@@ -56,10 +144,19 @@ int main(int argc, char *argv[]) {
         }
 
         // Render Paul Dunn`s fractal
+        if (stream && !paused) {
+            eggCaptureFrame(frame++);
+        }
         Render();
+        if (run.frames > 0 && --run.frames == 0) {
+            quit = true;
+        }
     }
 
     Shutdown();
+    // The last frames in flight go out before the stream closes.
+    eggCaptureStop();
+    closeStream(stream);
 
     EGG_Quit();
     return 0;
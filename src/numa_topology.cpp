@@ -0,0 +1,154 @@
+#include "numa_topology.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    /**
+     * Parses a sysfs CPU list such as "0-3,8,10-11".
+     */
+    std::vector<int> parseCpuList(const char *text) {
+        std::vector<int> cpus;
+        while (*text) {
+            int first = 0, last = 0, used = 0;
+            if (sscanf(text, "%d-%d%n", &first, &last, &used) != 2) {
+                if (sscanf(text, "%d%n", &first, &used) != 1) {
+                    break;
+                }
+                last = first;
+            }
+            for (int cpu = first; cpu <= last; cpu++) {
+                cpus.push_back(cpu);
+            }
+            text += used;
+            if (*text == ',') {
+                text++;
+            }
+        }
+        return cpus;
+    }
+}
+
+const NumaTopology &NumaTopology::get() {
+    static const NumaTopology topology;
+    return topology;
+}
+
+NumaTopology::NumaTopology() {
+#ifdef __linux__
+    // Nodes are numbered sparsely at worst; 1024 is CONFIG_NODES_SHIFT=10.
+    for (int node = 0; node < 1024; node++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *file = fopen(path, "r");
+        if (!file) {
+            continue;
+        }
+        char text[4096] = {0};
+        if (fgets(text, sizeof(text), file)) {
+            text[strcspn(text, "\n")] = '\0';
+            std::vector<int> cpus = parseCpuList(text);
+            // Memory-only nodes have no CPU to pin to.
+            if (!cpus.empty()) {
+                nodeCpus.push_back(cpus);
+                nodeIds.push_back(node);
+            }
+        }
+        fclose(file);
+    }
+#endif
+    if (nodeCpus.empty()) {
+        nodeCpus.emplace_back();
+        nodeIds.push_back(0);
+    }
+}
+
+bool NumaTopology::pinCurrentThread(int node) const {
+#ifdef __linux__
+    if (node < 0 || node >= nodes() || nodeCpus[node].empty()) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : nodeCpus[node]) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)node;
+    return false;
+#endif
+}
+
+std::vector<long> NumaTopology::pagesPerNode(const void *data, size_t bytes) const {
+    std::vector<long> pages(nodes() + 1, 0);
+    if (!data || bytes == 0) {
+        return pages;
+    }
+#if defined(__linux__) && defined(__NR_move_pages)
+    const uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(data) / pageSize * pageSize;
+    const uintptr_t end = reinterpret_cast<uintptr_t>(data) + bytes;
+    // Queried in batches, a 10M point stream is tens of thousands of pages.
+    constexpr size_t batch = 4096;
+    void *addresses[batch];
+    int status[batch];
+    for (uintptr_t page = begin; page < end;) {
+        size_t count = 0;
+        for (; count < batch && page < end; count++, page += pageSize) {
+            addresses[count] = reinterpret_cast<void *>(page);
+        }
+        // With no target nodes move_pages only reports where each page is.
+        if (syscall(__NR_move_pages, 0, count, addresses, nullptr, status, 0) != 0) {
+            pages[nodes()] += (long)count;
+            continue;
+        }
+        for (size_t i = 0; i < count; i++) {
+            int index = nodes();
+            for (int node = 0; node < nodes(); node++) {
+                if (nodeIds[node] == status[i]) {
+                    index = node;
+                }
+            }
+            pages[index]++;
+        }
+    }
+#else
+    pages[nodes()] = (long)((bytes + 4095) / 4096);
+#endif
+    return pages;
+}
+
+std::vector<NumaTopology::NodeCounters> NumaTopology::counters() const {
+    std::vector<NodeCounters> result(nodes(), NodeCounters {0, 0});
+#ifdef __linux__
+    for (int node = 0; node < nodes(); node++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/numastat", nodeIds[node]);
+        FILE *file = fopen(path, "r");
+        if (!file) {
+            continue;
+        }
+        char name[32];
+        long long value;
+        while (fscanf(file, "%31s %lld", name, &value) == 2) {
+            if (strcmp(name, "local_node") == 0) {
+                result[node].local = value;
+            } else if (strcmp(name, "other_node") == 0) {
+                result[node].other = value;
+            }
+        }
+        fclose(file);
+    }
+#endif
+    return result;
+}
@@ -0,0 +1,16 @@
+#version 330 core
+// Advances one Clifford orbit by one step. Captured by transform feedback:
+// v_state feeds the next pass, v_point goes straight into the resident ring.
+attribute vec2 a_state;
+// a, b, c, d
+uniform vec4 u_params;
+varying vec2 v_state;
+varying vec4 v_point;
+
+void main()
+{
+    float u = sin(a_state.y * u_params.y) + u_params.z * sin(a_state.x * u_params.y);
+    float v = sin(a_state.x * u_params.x) + u_params.w * sin(a_state.y * u_params.x);
+    v_state = vec2(u, v);
+    v_point = vec4(a_state, u, v);
+}
@@ -0,0 +1,110 @@
+#include "orbit_seeds.hpp"
+
+#include <cstring>
+#include <initializer_list>
+
+namespace {
+    constexpr uint32_t PHILOX_M0 = 0xD2511F53u, PHILOX_M1 = 0xCD9E8D57u;
+    constexpr uint32_t PHILOX_W0 = 0x9E3779B9u, PHILOX_W1 = 0xBB67AE85u;
+    constexpr int PHILOX_ROUNDS = 10;
+
+    /** 1 / g and 1 / g^2 of the plastic number g, in 64-bit fixed point. */
+    constexpr uint64_t R2_ALPHA1 = 0xC13FA9A902A6328Full;
+    constexpr uint64_t R2_ALPHA2 = 0x91E10DA5C79E7B1Dull;
+
+    /** 64 fraction bits to [0, 1), the top 53 of them. */
+    inline double unit64(uint64_t fraction) {
+        return (double)(fraction >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    /**
+     * Sobol dimensions 1 and 2 as 32-bit fractions: the bit reversal of the index, and the
+     * direction numbers of the polynomial x + 1, v_k = v_{k-1} ^ (v_{k-1} >> 1).
+     */
+    void sobol(uint32_t index, uint32_t &first, uint32_t &second) {
+        first = second = 0;
+        uint32_t direction = 1u << 31;
+        for (int bit = 0; index != 0; bit++, index >>= 1) {
+            if (index & 1u) {
+                first ^= 1u << (31 - bit);
+                second ^= direction;
+            }
+            direction ^= direction >> 1;
+        }
+    }
+}
+
+void Philox4x32::block(uint64_t counter, uint32_t out[4]) const {
+    uint32_t c[4] = {(uint32_t)counter, (uint32_t)(counter >> 32), 0u, 0u};
+    uint32_t k[2] = {key[0], key[1]};
+    for (int round = 0; round < PHILOX_ROUNDS; round++) {
+        const uint64_t p0 = (uint64_t)PHILOX_M0 * c[0];
+        const uint64_t p1 = (uint64_t)PHILOX_M1 * c[2];
+        const uint32_t next[4] = {(uint32_t)(p1 >> 32) ^ c[1] ^ k[0], (uint32_t)p1,
+                                  (uint32_t)(p0 >> 32) ^ c[3] ^ k[1], (uint32_t)p0};
+        memcpy(c, next, sizeof c);
+        k[0] += PHILOX_W0;
+        k[1] += PHILOX_W1;
+    }
+    memcpy(out, c, sizeof c);
+}
+
+const char *seedSequenceName(SeedSequence sequence) {
+    switch (sequence) {
+        case SEEDS_SOBOL: return "sobol";
+        case SEEDS_R2: return "r2";
+        default: return "random";
+    }
+}
+
+bool parseSeedSequence(const char *name, SeedSequence &sequence) {
+    for (SeedSequence s : {SEEDS_RANDOM, SEEDS_SOBOL, SEEDS_R2}) {
+        if (strcmp(name, seedSequenceName(s)) == 0) {
+            sequence = s;
+            return true;
+        }
+    }
+    return false;
+}
+
+OrbitSeeds::OrbitSeeds(SeedSequence sequence, uint64_t key, double centerX, double centerY, double radius)
+        : sequence(sequence), philox(key), centerX(centerX), centerY(centerY), radius(radius) {
+    // The rotation takes the last block, out of reach of any orbit index.
+    uint32_t shift[4];
+    philox.block(~0ull, shift);
+    shiftU = Philox4x32::unit(shift[0]);
+    shiftV = Philox4x32::unit(shift[1]);
+}
+
+void OrbitSeeds::unitSeed(uint64_t index, double &u, double &v) const {
+    switch (sequence) {
+        case SEEDS_SOBOL: {
+            uint32_t first, second;
+            sobol((uint32_t)index, first, second);
+            u = Philox4x32::unit(first) + shiftU;
+            v = Philox4x32::unit(second) + shiftV;
+            break;
+        }
+        case SEEDS_R2:
+            // Exact modulo 1 for any index: the recurrence runs in fixed point.
+            u = unit64((1ull << 63) + index * R2_ALPHA1) + shiftU;
+            v = unit64((1ull << 63) + index * R2_ALPHA2) + shiftV;
+            break;
+        default: {
+            uint32_t words[4];
+            philox.block(index, words);
+            u = unit64((uint64_t)words[0] << 32 | words[1]);
+            v = unit64((uint64_t)words[2] << 32 | words[3]);
+            return;
+        }
+    }
+    u -= u >= 1.0 ? 1.0 : 0.0;
+    v -= v >= 1.0 ? 1.0 : 0.0;
+}
+
+void OrbitSeeds::seed(uint64_t index, double &x, double &y) const {
+    double u, v;
+    unitSeed(index, u, v);
+    x = centerX + (u * 2.0 - 1.0) * radius;
+    y = centerY + (v * 2.0 - 1.0) * radius;
+}
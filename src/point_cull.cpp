@@ -0,0 +1,69 @@
+#include "point_cull.hpp"
+
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+    inline bool visible(const float *point, const CullTransform &t) {
+        const float x = point[0] * t.scaleX + t.offsetX;
+        const float y = point[1] * t.scaleY + t.offsetY;
+        // Written so that NaN is culled too.
+        return x >= -t.bound && x <= t.bound && y >= -t.bound && y <= t.bound;
+    }
+}
+
+int compactVisible(float *points, const int32_t *ids, int32_t *keptIds, int count, const CullTransform &transform) {
+    int kept = 0;
+    int i = 0;
+#ifdef __SSE2__
+    // Four points per pass, transposed to test x and y lane-wise. Every point is stored at the
+    // write cursor, which only moves past the survivors: no branch per point, and the loads of
+    // a pass are done before its stores, so packing in place is safe.
+    const __m128 scaleX = _mm_set1_ps(transform.scaleX), scaleY = _mm_set1_ps(transform.scaleY);
+    const __m128 offsetX = _mm_set1_ps(transform.offsetX), offsetY = _mm_set1_ps(transform.offsetY);
+    const __m128 high = _mm_set1_ps(transform.bound), low = _mm_set1_ps(-transform.bound);
+    for (; i + 4 <= count; i += 4) {
+        const __m128 p0 = _mm_loadu_ps(points + i * 4);
+        const __m128 p1 = _mm_loadu_ps(points + i * 4 + 4);
+        const __m128 p2 = _mm_loadu_ps(points + i * 4 + 8);
+        const __m128 p3 = _mm_loadu_ps(points + i * 4 + 12);
+        // x0 x1 y0 y1 and x2 x3 y2 y3, then all x and all y.
+        const __m128 low01 = _mm_unpacklo_ps(p0, p1);
+        const __m128 low23 = _mm_unpacklo_ps(p2, p3);
+        const __m128 x = _mm_add_ps(_mm_mul_ps(_mm_movelh_ps(low01, low23), scaleX), offsetX);
+        const __m128 y = _mm_add_ps(_mm_mul_ps(_mm_movehl_ps(low23, low01), scaleY), offsetY);
+        const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(x, low), _mm_cmple_ps(x, high)),
+                                         _mm_and_ps(_mm_cmpge_ps(y, low), _mm_cmple_ps(y, high)));
+        const int mask = _mm_movemask_ps(inside);
+        if (mask == 0) {
+            continue;
+        }
+        int32_t id[4];
+        memcpy(id, ids + i, sizeof id);
+        _mm_storeu_ps(points + kept * 4, p0);
+        keptIds[kept] = id[0];
+        kept += mask & 1;
+        _mm_storeu_ps(points + kept * 4, p1);
+        keptIds[kept] = id[1];
+        kept += (mask >> 1) & 1;
+        _mm_storeu_ps(points + kept * 4, p2);
+        keptIds[kept] = id[2];
+        kept += (mask >> 2) & 1;
+        _mm_storeu_ps(points + kept * 4, p3);
+        keptIds[kept] = id[3];
+        kept += (mask >> 3) & 1;
+    }
+#endif
+    for (; i < count; i++) {
+        if (visible(points + i * 4, transform)) {
+            if (kept != i) {
+                memcpy(points + kept * 4, points + i * 4, 4 * sizeof(float));
+            }
+            keptIds[kept++] = ids[i];
+        }
+    }
+    return kept;
+}
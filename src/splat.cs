@@ -0,0 +1,41 @@
+#version 430 core
+// Splats resident orbit points into the density image, one atomic add per point.
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 1) readonly buffer Points {
+    // x, y, next x, next y; the same ring chaos.vs draws from
+    vec4 points[];
+};
+layout(std430, binding = 2) buffer Peak {
+    uint peak;
+};
+layout(std140, binding = 0) uniform Layers {
+    vec4 u_look[4];
+    vec4 u_fit[4];
+};
+layout(r32ui, binding = 0) uniform uimage2D u_density;
+
+uniform int u_first;
+uniform int u_count;
+uniform int u_layerPoints;
+uniform mat3 u_view;
+
+void main()
+{
+    int i = int(gl_GlobalInvocationID.x);
+    if (i >= u_count) {
+        return;
+    }
+    int index = u_first + i;
+    vec4 fit = u_fit[min(index / u_layerPoints, 3)];
+    vec2 pos = points[index].xy * fit.xy + fit.zw;
+    vec2 clip = (u_view * vec3(pos, 1.0)).xy;
+
+    ivec2 size = imageSize(u_density);
+    ivec2 pixel = ivec2(floor((clip * 0.5 + 0.5) * vec2(size)));
+    if (any(lessThan(pixel, ivec2(0))) || any(greaterThanEqual(pixel, size))) {
+        return;
+    }
+    uint n = imageAtomicAdd(u_density, pixel, 1u) + 1u;
+    atomicMax(peak, n);
+}
@@ -0,0 +1,386 @@
+#include "sprite_raster.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+    /** Largest point size drawn; GL_POINT_SIZE_RANGE is at least 64 wherever the apps run. */
+    constexpr int MAX_SIZE = 64;
+    /** Texels past the last plane, for the vector reads at the end of its last row. */
+    constexpr int PADDING = 4;
+    /**
+     * Sprite centres further out than this, on either axis, are dropped before their pixels are
+     * worked out: no framebuffer reaches them, and int holds every pixel of those within it.
+     */
+    constexpr float MAX_CENTRE = 16777216.0f;
+
+    /** GL_LINEAR with GL_REPEAT of an RGBA8 texture at (s, t), into c[4] in [0, 1]. */
+    void sampleLinear(const uint8_t *rgba, int width, int height, float s, float t, float c[4]) {
+        const float u = s * (float)width - 0.5f;
+        const float v = t * (float)height - 0.5f;
+        const float iu = std::floor(u), iv = std::floor(v);
+        const float fu = u - iu, fv = v - iv;
+        const int x0 = (((int)iu % width) + width) % width, x1 = (x0 + 1) % width;
+        const int y0 = (((int)iv % height) + height) % height, y1 = (y0 + 1) % height;
+        for (int k = 0; k < 4; k++) {
+            const float top = rgba[(y0 * width + x0) * 4 + k] * (1.0f - fu) + rgba[(y0 * width + x1) * 4 + k] * fu;
+            const float bottom = rgba[(y1 * width + x0) * 4 + k] * (1.0f - fu) + rgba[(y1 * width + x1) * 4 + k] * fu;
+            c[k] = (top * (1.0f - fv) + bottom * fv) * (1.0f / 255.0f);
+        }
+    }
+
+    /** The first pixel a sprite covers on one axis, and the sub-pixel phase of its texels; |centre| < MAX_CENTRE. */
+    inline int firstPixel(float centre, int size, int &phase) {
+        const float edge = centre - (float)size * 0.5f;
+        // Pixel i is covered when its centre i + 0.5 lies in [edge, edge + size).
+        const int first = (int)std::ceil(edge - 0.5f);
+        const float offset = (float)first + 0.5f - edge;
+        phase = std::min(std::max((int)(offset * GlowKernel::PHASES), 0), GlowKernel::PHASES - 1);
+        return first;
+    }
+
+    /**
+     * hsv() of chaos.vs: a saturated hue, h in turns.
+     */
+    void hueColour(float h, float rgb[3]) {
+        const int i = (int)(h * 6.0f);
+        const float f = h * 6.0f - std::floor(h * 6.0f);
+        const float p = 1.0f - f;
+        // GLSL's mod() is never negative.
+        const int v = (int)((float)i - 6.0f * std::floor((float)i / 6.0f));
+        const float table[6][3] = {{1.0f, f, 0.0f}, {p, 1.0f, 0.0f}, {0.0f, 1.0f, f},
+                                   {0.0f, p, 1.0f}, {f, 0.0f, 1.0f}, {1.0f, 0.0f, p}};
+        std::copy(table[v], table[v] + 3, rgb);
+    }
+
+    inline float saturate(float v) {
+        return std::min(std::max(v, 0.0f), 1.0f);
+    }
+
+    /** What a fragment adds with GL_SRC_ALPHA, GL_ONE to an RGBA8 framebuffer, rounded as it is. */
+    inline uint8_t blended(float colour, float alpha) {
+        return (uint8_t)(saturate(colour) * (alpha * 255.0f) + 0.5f);
+    }
+
+    /**
+     * The tone map of the shaders, m = c / (c + 1) scaled by luminance / (0.2126, 1.7152, 0.0722) . m,
+     * over a common denominator so that a fragment costs one division; 0 where the weighted sum is 0,
+     * which the GPU leaves undefined.
+     */
+    inline void toneMap(float cr, float cg, float cb, float luminance, float &mr, float &mg, float &mb) {
+        const float dr = cr + 1.0f, dg = cg + 1.0f, db = cb + 1.0f;
+        mr = cr * dg * db;
+        mg = cg * dr * db;
+        mb = cb * dr * dg;
+        const float weight = 0.2126f * mr + 1.7152f * mg + 0.0722f * mb;
+        const float lift = weight > 0.0f ? luminance / weight : 0.0f;
+        mr *= lift;
+        mg *= lift;
+        mb *= lift;
+    }
+
+    inline void addPixel(uint8_t *pixel, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+        pixel[0] = (uint8_t)std::min(pixel[0] + r, 255);
+        pixel[1] = (uint8_t)std::min(pixel[1] + g, 255);
+        pixel[2] = (uint8_t)std::min(pixel[2] + b, 255);
+        pixel[3] = (uint8_t)std::min(pixel[3] + a, 255);
+    }
+
+#ifdef __SSE2__
+    inline __m128 saturate4(__m128 v) {
+        return _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    }
+
+    /** blended() of four fragments' channels, packed into four RGBA8 pixels. */
+    inline __m128i blended4(__m128 r, __m128 g, __m128 b, __m128 a) {
+        const __m128 scale = _mm_mul_ps(a, _mm_set1_ps(255.0f));
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128i ri = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(saturate4(r), scale), half));
+        const __m128i gi = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(saturate4(g), scale), half));
+        const __m128i bi = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(saturate4(b), scale), half));
+        const __m128i ai = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(a, scale), half));
+        return _mm_or_si128(_mm_or_si128(ri, _mm_slli_epi32(gi, 8)),
+                            _mm_or_si128(_mm_slli_epi32(bi, 16), _mm_slli_epi32(ai, 24)));
+    }
+
+    /** toneMap() of four fragments. */
+    inline void toneMap4(__m128 cr, __m128 cg, __m128 cb, __m128 luminance, __m128 &mr, __m128 &mg, __m128 &mb) {
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 dr = _mm_add_ps(cr, one), dg = _mm_add_ps(cg, one), db = _mm_add_ps(cb, one);
+        mr = _mm_mul_ps(_mm_mul_ps(cr, dg), db);
+        mg = _mm_mul_ps(_mm_mul_ps(cg, dr), db);
+        mb = _mm_mul_ps(_mm_mul_ps(cb, dr), dg);
+        const __m128 weight = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.2126f), mr),
+                                                    _mm_mul_ps(_mm_set1_ps(1.7152f), mg)),
+                                         _mm_mul_ps(_mm_set1_ps(0.0722f), mb));
+        const __m128 lift = _mm_and_ps(_mm_cmpgt_ps(weight, _mm_setzero_ps()), _mm_div_ps(luminance, weight));
+        mr = _mm_mul_ps(mr, lift);
+        mg = _mm_mul_ps(mg, lift);
+        mb = _mm_mul_ps(mb, lift);
+    }
+#endif
+
+#ifdef __SSE2__
+    /** Adds four RGBA8 pixels to `dst` with saturation, only the first `pixels` of them at a row's end. */
+    inline void addPixels4(uint8_t *dst, __m128i added, int pixels) {
+        if (pixels >= 4) {
+            _mm_storeu_si128((__m128i *)dst, _mm_adds_epu8(_mm_loadu_si128((const __m128i *)dst), added));
+            return;
+        }
+        // The pixels past the end may be another tile's, another thread's to write.
+        for (int k = 0; k < pixels; k++, dst += 4, added = _mm_srli_si128(added, 4)) {
+            int32_t pixel;
+            memcpy(&pixel, dst, 4);
+            pixel = _mm_cvtsi128_si32(_mm_adds_epu8(_mm_cvtsi32_si128(pixel), added));
+            memcpy(dst, &pixel, 4);
+        }
+    }
+#endif
+
+    /**
+     * chaos.fs over `count` texels of a row, blended into the `count` pixels at `dst`.
+     * The SSE2 and scalar code do the same float operations in the same order, so they agree.
+     */
+    void shadeChaos(const Sprite &sprite, const float *tr, const float *tg, const float *tb, const float *ta,
+                    int count, uint8_t *dst) {
+        const float r = sprite.r, g = sprite.g, b = sprite.b;
+        const float alpha = (r + g + b) / 3.0f;
+#ifdef __SSE2__
+        const __m128 one = _mm_set1_ps(1.0f), glow = _mm_set1_ps(1.9f);
+        const __m128 r4 = _mm_set1_ps(r), g4 = _mm_set1_ps(g), b4 = _mm_set1_ps(b);
+        // The last texels of a row are shaded four at a time too, GlowKernel pads the planes.
+        for (int j = 0; j < count; j += 4) {
+            const __m128 texR = _mm_loadu_ps(tr + j), texG = _mm_loadu_ps(tg + j), texB = _mm_loadu_ps(tb + j);
+            const __m128 k = _mm_sub_ps(one, _mm_mul_ps(_mm_set1_ps(alpha), _mm_loadu_ps(ta + j)));
+            const __m128 cr = _mm_add_ps(r4, _mm_mul_ps(_mm_sub_ps(texR, r4), k));
+            const __m128 cg = _mm_add_ps(g4, _mm_mul_ps(_mm_sub_ps(texG, g4), k));
+            const __m128 cb = _mm_add_ps(b4, _mm_mul_ps(_mm_sub_ps(texB, b4), k));
+            const __m128 luminance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.2126f), cr),
+                                                           _mm_mul_ps(_mm_set1_ps(1.7152f), cg)),
+                                                _mm_mul_ps(_mm_set1_ps(0.5722f), cb));
+            __m128 mr, mg, mb;
+            toneMap4(cr, cg, cb, luminance, mr, mg, mb);
+            const __m128 a = saturate4(_mm_mul_ps(_mm_set1_ps(sprite.sensitivity), texB));
+            const __m128i added = blended4(_mm_mul_ps(_mm_mul_ps(_mm_mul_ps(cr, mr), texR), glow),
+                                           _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(cg, mg), texG), glow),
+                                           _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(cb, mb), texB), glow), a);
+            addPixels4(dst + j * 4, added, count - j);
+        }
+#else
+        for (int j = 0; j < count; j++) {
+            const float k = 1.0f - alpha * ta[j];
+            const float cr = r + (tr[j] - r) * k;
+            const float cg = g + (tg[j] - g) * k;
+            const float cb = b + (tb[j] - b) * k;
+            const float luminance = 2.2126f * cr + 1.7152f * cg + 0.5722f * cb;
+            float mr, mg, mb;
+            toneMap(cr, cg, cb, luminance, mr, mg, mb);
+            const float a = saturate(sprite.sensitivity * tb[j]);
+            addPixel(dst + j * 4, blended(cr * mr * tr[j] * 1.9f, a), blended(cg * mg * tg[j] * 1.9f, a),
+                     blended(cb * mb * tb[j] * 1.9f, a), blended(a, a));
+        }
+#endif
+    }
+
+    /** basic.fs, as shadeChaos(). */
+    void shadeBasic(const Sprite &sprite, const float *tr, const float *tg, const float *tb, const float *ta,
+                    int count, uint8_t *dst) {
+        constexpr float THRESHOLD = 0.003f;
+        const float alpha = (sprite.r + sprite.g + sprite.b) / 3.0f;
+#ifdef __SSE2__
+        const __m128 r4 = _mm_set1_ps(sprite.r), g4 = _mm_set1_ps(sprite.g), b4 = _mm_set1_ps(sprite.b);
+        const __m128 one = _mm_set1_ps(1.0f), bright = _mm_set1_ps(5.5f);
+        for (int j = 0; j < count; j += 4) {
+            const __m128 cr = _mm_mul_ps(r4, _mm_loadu_ps(tr + j));
+            const __m128 cg = _mm_mul_ps(g4, _mm_loadu_ps(tg + j));
+            const __m128 cb = _mm_mul_ps(b4, _mm_loadu_ps(tb + j));
+            const __m128 ca = _mm_mul_ps(_mm_set1_ps(1.0f - alpha), _mm_loadu_ps(ta + j));
+            const __m128 above = _mm_cmpgt_ps(_mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(cr, cg), cb), ca),
+                                                         _mm_set1_ps(0.25f)), _mm_set1_ps(THRESHOLD));
+            const __m128 luminance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(1.2126f), cr),
+                                                           _mm_mul_ps(_mm_set1_ps(1.7152f), cg)),
+                                                _mm_mul_ps(_mm_set1_ps(1.0722f), cb));
+            __m128 mr, mg, mb;
+            toneMap4(cr, cg, cb, luminance, mr, mg, mb);
+            // Above the threshold: c * tone map times d = 5.5 c; below it c * c.
+            const __m128 sr = _mm_or_ps(_mm_and_ps(above, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(cr, mr), cr), bright)),
+                                        _mm_andnot_ps(above, _mm_mul_ps(cr, cr)));
+            const __m128 sg = _mm_or_ps(_mm_and_ps(above, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(cg, mg), cg), bright)),
+                                        _mm_andnot_ps(above, _mm_mul_ps(cg, cg)));
+            const __m128 sb = _mm_or_ps(_mm_and_ps(above, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(cb, mb), cb), bright)),
+                                        _mm_andnot_ps(above, _mm_mul_ps(cb, cb)));
+            const __m128 da = _mm_or_ps(_mm_and_ps(above, _mm_mul_ps(_mm_set1_ps(sprite.sensitivity), ca)),
+                                        _mm_andnot_ps(above, ca));
+            addPixels4(dst + j * 4, blended4(sr, sg, sb, saturate4(_mm_sub_ps(one, da))), count - j);
+        }
+#else
+        for (int j = 0; j < count; j++) {
+            const float cr = sprite.r * tr[j], cg = sprite.g * tg[j], cb = sprite.b * tb[j];
+            const float ca = (1.0f - alpha) * ta[j];
+            const bool above = (cr + cg + cb + ca) * 0.25f > THRESHOLD;
+            const float luminance = 1.2126f * cr + 1.7152f * cg + 1.0722f * cb;
+            float mr, mg, mb;
+            toneMap(cr, cg, cb, luminance, mr, mg, mb);
+            const float sr = above ? cr * mr * cr * 5.5f : cr * cr;
+            const float sg = above ? cg * mg * cg * 5.5f : cg * cg;
+            const float sb = above ? cb * mb * cb * 5.5f : cb * cb;
+            const float a = saturate(1.0f - (above ? sprite.sensitivity * ca : ca));
+            addPixel(dst + j * 4, blended(sr, a), blended(sg, a), blended(sb, a), blended(a, a));
+        }
+#endif
+    }
+}
+
+void spriteVertices(const float *points, int count, const SpriteLook &look, const ViewFit &fit,
+                    int width, int height, Sprite *sprites) {
+    for (int i = 0; i < count; i++) {
+        const float *point = points + (size_t)i * 4;
+        const float x = (float)(point[0] * fit.scaleX + fit.offsetX), y = (float)(point[1] * fit.scaleY + fit.offsetY);
+        const float nextX = (float)(point[2] * fit.scaleX + fit.offsetX);
+        const float nextY = (float)(point[3] * fit.scaleY + fit.offsetY);
+        const float dist = std::sqrt((nextX - x) * (nextX - x) + (nextY - y) * (nextY - y));
+        const float colorAngle = std::cos(std::cos((float)i) - look.angle);
+        // (1 - dist) * normalize(dist) * dist / dist, normalize() of a float being its sign. A point
+        // that does not move, a fixed or repeated one, is NaN on the GPU; here it takes the far hue alone.
+        const float r = dist > 0.0f ? 1.0f - dist : 0.0f;
+        float near[3], far[3];
+        hueColour(r + look.hueOffset, near);
+        hueColour(colorAngle + look.hueOffset, far);
+        const float mix = 1.0f - (r > 0.0f ? 1.0f : r < 0.0f ? -1.0f : 0.0f) * colorAngle;
+        Sprite &sprite = sprites[i];
+        sprite.x = (x + 1.0f) * 0.5f * (float)width;
+        sprite.y = (1.0f - y) * 0.5f * (float)height;
+        sprite.r = near[0] + (far[0] - near[0]) * mix;
+        sprite.g = near[1] + (far[1] - near[1]) * mix;
+        sprite.b = near[2] + (far[2] - near[2]) * mix;
+        sprite.sensitivity = look.sensitivity;
+    }
+}
+
+GlowKernel::GlowKernel(const uint8_t *rgba, int width, int height, int size)
+        : points(std::min(std::max(size, 1), MAX_SIZE)),
+          planes((size_t)PHASES * PHASES * 4 * points * points + PADDING), spans((size_t)PHASES * PHASES * points * 2) {
+    const int area = points * points;
+    for (int py = 0; py < PHASES; py++) {
+        for (int px = 0; px < PHASES; px++) {
+            float *plane = planes.data() + ((size_t)py * PHASES + px) * 4 * area;
+            // gl_PointCoord of texel (i, j): the first pixel centre sits (phase + 0.5) / PHASES past the edge.
+            const float offsetX = (px + 0.5f) / PHASES, offsetY = (py + 0.5f) / PHASES;
+            for (int i = 0; i < points; i++) {
+                int first = points, end = 0;
+                for (int j = 0; j < points; j++) {
+                    float c[4];
+                    sampleLinear(rgba, width, height, (j + offsetX) / points, (i + offsetY) / points, c);
+                    for (int k = 0; k < 4; k++) {
+                        plane[k * area + i * points + j] = c[k];
+                    }
+                    if (c[2] > 0.0f) {
+                        first = std::min(first, j);
+                        end = j + 1;
+                    }
+                }
+                uint8_t *span = spans.data() + (((size_t)py * PHASES + px) * points + i) * 2;
+                span[0] = (uint8_t)std::min(first, end);
+                span[1] = (uint8_t)end;
+            }
+        }
+    }
+}
+
+SpriteRasterizer::SpriteRasterizer(int width, int height, WorkerPool &pool)
+        : columns(width), rows(height),
+          tilesX((width + TILE - 1) / TILE), tilesY((height + TILE - 1) / TILE),
+          pool(pool), framebuffer((size_t)width * height * 4),
+          bins(pool.size(), std::vector<std::vector<uint32_t>>((size_t)tilesX * tilesY)) {
+}
+
+void SpriteRasterizer::clear(float red, float green, float blue, float alpha) {
+    const uint8_t colour[4] = {(uint8_t)std::lround(saturate(red) * 255.0f),
+                               (uint8_t)std::lround(saturate(green) * 255.0f),
+                               (uint8_t)std::lround(saturate(blue) * 255.0f),
+                               (uint8_t)std::lround(saturate(alpha) * 255.0f)};
+    pool.parallelFor(rows, [&](int y) {
+        uint8_t *row = framebuffer.data() + (size_t)y * columns * 4;
+        for (int x = 0; x < columns; x++) {
+            std::copy(colour, colour + 4, row + x * 4);
+        }
+    });
+}
+
+void SpriteRasterizer::bin(const Sprite *sprites, size_t count, int size) {
+    const int workers = (int)pool.size();
+    pool.parallelForStatic(workers, [&](int w) {
+        std::vector<std::vector<uint32_t>> &lists = bins[w];
+        for (std::vector<uint32_t> &list : lists) {
+            list.clear();
+        }
+        const size_t begin = count * w / workers, end = count * (w + 1) / workers;
+        for (size_t i = begin; i < end; i++) {
+            // Written so that NaN is dropped too.
+            if (!(std::fabs(sprites[i].x) < MAX_CENTRE && std::fabs(sprites[i].y) < MAX_CENTRE)) {
+                continue;
+            }
+            int phase;
+            const int x0 = firstPixel(sprites[i].x, size, phase);
+            const int y0 = firstPixel(sprites[i].y, size, phase);
+            if (!(x0 + size > 0 && x0 < columns && y0 + size > 0 && y0 < rows)) {
+                continue;
+            }
+            const int tx0 = std::max(x0, 0) / TILE, tx1 = std::min(x0 + size - 1, columns - 1) / TILE;
+            const int ty0 = std::max(y0, 0) / TILE, ty1 = std::min(y0 + size - 1, rows - 1) / TILE;
+            for (int ty = ty0; ty <= ty1; ty++) {
+                for (int tx = tx0; tx <= tx1; tx++) {
+                    lists[(size_t)ty * tilesX + tx].push_back((uint32_t)i);
+                }
+            }
+        }
+    });
+}
+
+void SpriteRasterizer::shadeTile(int tile, const Sprite *sprites, const GlowKernel &kernel, SpriteShader shader) {
+    const int size = kernel.size();
+    const int area = size * size;
+    const int left = tile % tilesX * TILE, top = tile / tilesX * TILE;
+    const int right = std::min(left + TILE, columns), bottom = std::min(top + TILE, rows);
+    for (const std::vector<std::vector<uint32_t>> &lists : bins) {
+        for (uint32_t index : lists[tile]) {
+            const Sprite &sprite = sprites[index];
+            int phaseX, phaseY;
+            const int x0 = firstPixel(sprite.x, size, phaseX);
+            const int y0 = firstPixel(sprite.y, size, phaseY);
+            const int c0 = std::max(left - x0, 0), c1 = std::min(right - x0, size);
+            const int r0 = std::max(top - y0, 0), r1 = std::min(bottom - y0, size);
+            const float *texels = kernel.texels(phaseX, phaseY);
+            for (int i = r0; i < r1; i++) {
+                int first = c0, end = c1;
+                if (shader == SPRITE_CHAOS) {
+                    kernel.blueSpan(phaseX, phaseY, i, first, end);
+                    first = std::max(first, c0);
+                    end = std::min(end, c1);
+                }
+                if (first >= end) {
+                    continue;
+                }
+                const float *tr = texels + i * size + first;
+                uint8_t *dst = framebuffer.data() + ((size_t)(y0 + i) * columns + x0 + first) * 4;
+                if (shader == SPRITE_BASIC) {
+                    shadeBasic(sprite, tr, tr + area, tr + 2 * area, tr + 3 * area, end - first, dst);
+                } else {
+                    shadeChaos(sprite, tr, tr + area, tr + 2 * area, tr + 3 * area, end - first, dst);
+                }
+            }
+        }
+    }
+}
+
+void SpriteRasterizer::draw(const Sprite *sprites, size_t count, const GlowKernel &kernel, SpriteShader shader) {
+    bin(sprites, count, kernel.size());
+    pool.parallelFor(tilesX * tilesY, [&](int tile) {
+        shadeTile(tile, sprites, kernel, shader);
+    });
+}
@@ -0,0 +1,180 @@
+#include "stream_buffer.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr size_t HUGE_PAGE = 2 * 1024 * 1024;
+
+    size_t roundUp(size_t bytes, size_t to) {
+        return (bytes + to - 1) / to * to;
+    }
+}
+
+const char *streamPagesName(StreamPages pages) {
+    switch (pages) {
+        case PAGES_TRANSPARENT: return "thp";
+        case PAGES_EXPLICIT: return "explicit";
+        default: return "small";
+    }
+}
+
+bool parseStreamPages(const char *name, StreamPages &pages) {
+    for (StreamPages candidate : {PAGES_SMALL, PAGES_TRANSPARENT, PAGES_EXPLICIT}) {
+        if (strcmp(name, streamPagesName(candidate)) == 0) {
+            pages = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+StreamBuffer::StreamBuffer(size_t bytes, StreamPages pages, bool touch) : bytes(bytes) {
+    if (bytes == 0) {
+        return;
+    }
+#ifdef __linux__
+    if (pages == PAGES_EXPLICIT) {
+        const size_t length = roundUp(bytes, HUGE_PAGE);
+        void *map = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (map != MAP_FAILED) {
+            // Anonymous mappings are zeroed already.
+            memory = map;
+            mapped = length;
+            obtained = PAGES_EXPLICIT;
+            return;
+        }
+        pages = PAGES_TRANSPARENT;
+    }
+    if (pages == PAGES_TRANSPARENT) {
+        // Huge page aligned, so the whole range can be backed by huge pages.
+        if (posix_memalign(&memory, HUGE_PAGE, roundUp(bytes, HUGE_PAGE)) == 0) {
+            if (madvise(memory, roundUp(bytes, HUGE_PAGE), MADV_HUGEPAGE) == 0) {
+                obtained = PAGES_TRANSPARENT;
+            }
+            if (touch) {
+                memset(memory, 0, bytes);
+            }
+            return;
+        }
+        memory = nullptr;
+    }
+#else
+    (void)pages;
+#endif
+    if (posix_memalign(&memory, ALIGNMENT, roundUp(bytes, ALIGNMENT)) != 0) {
+        memory = nullptr;
+        this->bytes = 0;
+        return;
+    }
+    if (touch) {
+        memset(memory, 0, bytes);
+    }
+}
+
+StreamBuffer::~StreamBuffer() {
+    release();
+}
+
+StreamBuffer::StreamBuffer(StreamBuffer &&other) noexcept {
+    *this = std::move(other);
+}
+
+StreamBuffer &StreamBuffer::operator=(StreamBuffer &&other) noexcept {
+    if (this != &other) {
+        release();
+        std::swap(memory, other.memory);
+        std::swap(bytes, other.bytes);
+        std::swap(mapped, other.mapped);
+        std::swap(obtained, other.obtained);
+    }
+    return *this;
+}
+
+void StreamBuffer::release() {
+#ifdef __linux__
+    if (mapped > 0) {
+        munmap(memory, mapped);
+    } else
+#endif
+    {
+        free(memory);
+    }
+    memory = nullptr;
+    bytes = 0;
+    mapped = 0;
+    obtained = PAGES_SMALL;
+}
+
+#ifdef __linux__
+static int openTLBCounter(int op, int group) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (op << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = group < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+TLBMissCounter::TLBMissCounter() {
+#ifdef __linux__
+    loadMisses = openTLBCounter(PERF_COUNT_HW_CACHE_OP_READ, -1);
+    if (loadMisses >= 0) {
+        // Some PMUs have no store-miss event; the load misses alone are reported then.
+        storeMisses = openTLBCounter(PERF_COUNT_HW_CACHE_OP_WRITE, loadMisses);
+    }
+#endif
+}
+
+TLBMissCounter::~TLBMissCounter() {
+#ifdef __linux__
+    if (storeMisses >= 0) {
+        close(storeMisses);
+    }
+    if (loadMisses >= 0) {
+        close(loadMisses);
+    }
+#endif
+}
+
+void TLBMissCounter::start() {
+#ifdef __linux__
+    if (available()) {
+        ioctl(loadMisses, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(loadMisses, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+}
+
+long long TLBMissCounter::stop() {
+#ifdef __linux__
+    if (!available()) {
+        return -1;
+    }
+    ioctl(loadMisses, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    long long misses = 0;
+    for (int fd : {loadMisses, storeMisses}) {
+        long long count = 0;
+        if (fd >= 0 && read(fd, &count, sizeof(count)) == sizeof(count)) {
+            misses += count;
+        }
+    }
+    return misses;
+#else
+    return -1;
+#endif
+}
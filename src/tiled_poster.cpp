@@ -0,0 +1,298 @@
+#include "tiled_poster.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#ifdef __unix__
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // Points per tile in each binner's buffer: the budget's half for binning sets it, within these.
+    constexpr size_t MIN_SPILL_POINTS = 1024;
+    constexpr size_t MAX_SPILL_POINTS = 65536;
+    // Offsets read back at once by each accumulating worker.
+    constexpr size_t READ_POINTS = 262144;
+    // Held per pixel of a strip while it is written: its counts read back, and its RGBA16.
+    constexpr size_t STRIP_BYTES = 4 + 8;
+
+    double secondsSince(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    /** A new file in `directory` for spilling to, gone once closed where the system allows. */
+    FILE *openSpill(const std::string &directory, const char *stem, int index, std::string &name) {
+#ifdef __unix__
+        (void)index;
+        (void)name;
+        std::string pattern = directory + "/" + stem + "_XXXXXX";
+        const int fd = mkstemp(&pattern[0]);
+        if (fd < 0) {
+            return nullptr;
+        }
+        unlink(pattern.c_str());
+        FILE *file = fdopen(fd, "w+b");
+        if (!file) {
+            close(fd);
+        }
+        return file;
+#else
+        name = directory + "/" + stem + "_" + std::to_string(index) + ".bin";
+        return fopen(name.c_str(), "w+b");
+#endif
+    }
+}
+
+void PosterBinner::add(const float *xs, const float *ys, int count) {
+    const float width = (float)poster->options.width, height = (float)poster->options.height;
+    const uint32_t columns = (uint32_t)poster->options.width, rows = (uint32_t)poster->tileRows;
+    const size_t capacity = poster->spillPoints;
+    for (int i = 0; i < count; i++) {
+        // Written so that NaN is dropped too.
+        if (!(xs[i] >= 0.0f && ys[i] >= 0.0f && xs[i] < width && ys[i] < height)) {
+            continue;
+        }
+        const uint32_t x = (uint32_t)xs[i], y = (uint32_t)ys[i];
+        const uint32_t tile = y / rows;
+        buffers[tile * capacity + filled[tile]] = (y - tile * rows) * columns + x;
+        if (++filled[tile] == capacity) {
+            spill((int)tile);
+        }
+        points++;
+    }
+}
+
+void PosterBinner::spill(int tile) {
+    const size_t count = filled[tile];
+    if (count == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(poster->spillLocks[tile]);
+    const uint32_t *offsets = buffers.data() + (size_t)tile * poster->spillPoints;
+    if (fwrite(offsets, sizeof(uint32_t), count, poster->spills[tile]) != count) {
+        poster->failed = true;
+    }
+    spilled += count * sizeof(uint32_t);
+    filled[tile] = 0;
+}
+
+TiledPoster::TiledPoster(const PosterOptions &options, WorkerPool &pool)
+        : options(options), pool(pool) {
+    if (options.width <= 0 || options.height <= 0) {
+        failed = true;
+        tiles = tileRows = 0;
+        spillPoints = 0;
+        return;
+    }
+    // A tile's offsets must fit 32 bits, and a tile of counts with its strip half the budget.
+    const size_t width = (size_t)options.width;
+    size_t rows = (size_t)std::max(options.tileRows, 1);
+    rows = std::min(rows, (size_t)UINT32_MAX / width);
+    rows = std::min(rows, std::max<size_t>(options.memoryBudget / 2 / (width * (4 + STRIP_BYTES)), 1));
+    tileRows = (int)std::min(rows, (size_t)options.height);
+    tiles = (options.height + tileRows - 1) / tileRows;
+    spillPoints = options.memoryBudget / 2 / ((size_t)pool.size() * tiles * sizeof(uint32_t));
+    spillPoints = std::min(std::max(spillPoints, MIN_SPILL_POINTS), MAX_SPILL_POINTS);
+    totals.tiles = tiles;
+    totals.tileRows = tileRows;
+
+    spillLocks = std::vector<std::mutex>((size_t)tiles);
+    spills.assign((size_t)tiles, nullptr);
+    const std::string directory = options.spillDirectory ? options.spillDirectory : ".";
+    for (int t = 0; t < tiles && !failed; t++) {
+        std::string name;
+        spills[t] = openSpill(directory, "poster_spill", t, name);
+        if (!spills[t]) {
+            failed = true;
+        }
+        if (!name.empty()) {
+            spillNames.push_back(name);
+        }
+    }
+}
+
+TiledPoster::~TiledPoster() {
+    for (FILE *file : spills) {
+        if (file) {
+            fclose(file);
+        }
+    }
+    for (const std::string &name : spillNames) {
+        remove(name.c_str());
+    }
+}
+
+bool TiledPoster::bin(const std::function<void(int worker, int workers, PosterBinner &binner)> &produce) {
+    if (failed || written) {
+        return false;
+    }
+    const Clock::time_point started = Clock::now();
+    const int workers = (int)pool.size();
+    std::vector<PosterBinner> binners((size_t)workers);
+    for (PosterBinner &binner : binners) {
+        binner.poster = this;
+        binner.buffers.resize((size_t)tiles * spillPoints);
+        binner.filled.assign((size_t)tiles, 0);
+    }
+    account((size_t)workers * tiles * spillPoints * sizeof(uint32_t));
+    pool.parallelForStatic(workers, [&](int w) {
+        produce(w, workers, binners[w]);
+        for (int t = 0; t < tiles; t++) {
+            binners[w].spill(t);
+        }
+    });
+    for (const PosterBinner &binner : binners) {
+        totals.points += binner.points;
+        totals.spillBytes += binner.spilled;
+    }
+    totals.binSeconds += secondsSince(started);
+    return !failed;
+}
+
+bool TiledPoster::write(const char *path, const char *densityPath, DensityFormat density) {
+    if (failed || written) {
+        return false;
+    }
+    written = true;
+    ImageStripWriter image(path, options.format, options.width, options.height);
+    DensityStripWriter densityFile(densityPath ? densityPath : "", densityPath ? density : DENSITY_NONE,
+                                   options.width, options.height);
+    if (!image.ok() || (densityPath && !densityFile.ok())) {
+        return false;
+    }
+
+    // As many tiles per group as the budget holds next to the strip pass, which keeps the last group.
+    Clock::time_point started = Clock::now();
+    const size_t tileBytes = (size_t)options.width * tileRows * sizeof(uint32_t);
+    const size_t reserved = (size_t)options.width * tileRows * STRIP_BYTES
+                            + (size_t)pool.size() * READ_POINTS * sizeof(uint32_t);
+    const size_t spare = options.memoryBudget > reserved ? options.memoryBudget - reserved : 0;
+    const int groupTiles = (int)std::min<size_t>(std::max<size_t>(spare / tileBytes, 1), (size_t)tiles);
+    const int groups = (tiles + groupTiles - 1) / groupTiles;
+    const int lastGroup = (groups - 1) * groupTiles;
+    totals.groups = groups;
+    account(tileBytes * groupTiles + reserved);
+
+    std::vector<uint32_t> group((size_t)groupTiles * options.width * tileRows);
+    std::vector<uint32_t> peaks((size_t)tiles, 0);
+    std::string countsName;
+    FILE *counts = nullptr;
+    if (groups > 1) {
+        counts = openSpill(options.spillDirectory ? options.spillDirectory : ".", "poster_counts", tiles,
+                           countsName);
+        if (!counts) {
+            return false;
+        }
+    }
+    for (int first = 0; first < tiles; first += groupTiles) {
+        const int count = std::min(groupTiles, tiles - first);
+        pool.parallelFor(count, [&](int i) {
+            peaks[first + i] = accumulate(first + i, group.data() + (size_t)i * options.width * tileRows);
+        });
+        if (first < lastGroup) {
+            // Every tile of these groups is full height.
+            const size_t pixels = (size_t)count * options.width * tileRows;
+            if (fwrite(group.data(), sizeof(uint32_t), pixels, counts) != pixels) {
+                failed = true;
+            }
+        }
+    }
+    totals.peak = *std::max_element(peaks.begin(), peaks.end());
+    totals.accumulateSeconds = secondsSince(started);
+
+    started = Clock::now();
+    const ToneMapper mapper(options.toneMap);
+    const bool deep = options.format == IMAGE_PNG16;
+    std::vector<uint32_t> readBack(counts ? (size_t)options.width * tileRows : 0);
+    std::vector<uint8_t> rgba(deep ? 0 : (size_t)options.width * tileRows * 4);
+    std::vector<uint16_t> rgba16(deep ? (size_t)options.width * tileRows * 4 : 0);
+    if (counts) {
+        rewind(counts);
+    }
+    for (int t = 0; t < tiles && !failed; t++) {
+        const size_t pixels = tilePixels(t);
+        const int rows = (int)(pixels / options.width);
+        const uint32_t *strip = group.data() + (size_t)(t - lastGroup) * options.width * tileRows;
+        if (t < lastGroup) {
+            if (fread(readBack.data(), sizeof(uint32_t), pixels, counts) != pixels) {
+                failed = true;
+                break;
+            }
+            strip = readBack.data();
+        }
+        if (deep) {
+            mapper.toRGBA16(strip, pixels, totals.peak, rgba16.data(), &pool);
+            image.write16(rgba16.data(), rows);
+        } else {
+            mapper.toRGBA8(strip, pixels, totals.peak, rgba.data(), &pool);
+            image.write(rgba.data(), rows);
+        }
+        if (densityPath) {
+            densityFile.write(strip, rows);
+        }
+    }
+    if (counts) {
+        fclose(counts);
+        if (!countsName.empty()) {
+            remove(countsName.c_str());
+        }
+    }
+    bool finished = image.finish() && !failed;
+    if (densityPath) {
+        finished = densityFile.finish(totals.peak) && finished;
+    }
+    totals.writeSeconds = secondsSince(started);
+    return finished;
+}
+
+TiledPoster::Stats TiledPoster::stats() const {
+    Stats now = totals;
+#ifdef __unix__
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        // Kilobytes on Linux.
+        now.peakRSS = (size_t)usage.ru_maxrss * 1024;
+    }
+#endif
+    return now;
+}
+
+uint32_t TiledPoster::accumulate(int tile, uint32_t *counts) {
+    const size_t pixels = tilePixels(tile);
+    memset(counts, 0, pixels * sizeof(uint32_t));
+    FILE *file = spills[tile];
+    rewind(file);
+    std::vector<uint32_t> offsets(READ_POINTS);
+    size_t got;
+    while ((got = fread(offsets.data(), sizeof(uint32_t), READ_POINTS, file)) > 0) {
+        for (size_t i = 0; i < got; i++) {
+            if (offsets[i] < pixels) {
+                counts[offsets[i]]++;
+            }
+        }
+    }
+    if (ferror(file)) {
+        failed = true;
+    }
+    // Its points are counted: the spill file's disk goes back before the next group's.
+    fclose(file);
+    spills[tile] = nullptr;
+    uint32_t peak = 0;
+    for (size_t p = 0; p < pixels; p++) {
+        peak = std::max(peak, counts[p]);
+    }
+    return peak;
+}
+
+size_t TiledPoster::tilePixels(int tile) const {
+    const int rows = std::min(tileRows, options.height - tile * tileRows);
+    return (size_t)options.width * rows;
+}
+
+void TiledPoster::account(size_t bytes) {
+    totals.peakHeld = std::max(totals.peakHeld, bytes);
+}
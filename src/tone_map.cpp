@@ -0,0 +1,260 @@
+#include "tone_map.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define TONE_MAP_AVX2
+#endif
+
+namespace {
+    /**
+     * log2(1 + t) on [0, 1), least squares quartic: under 2e-4 off, a twentieth of a table
+     * step at a peak of 2^20. The same float operations in every path keep their indices equal.
+     */
+    constexpr float LOG2_C1 = 1.43854679f;
+    constexpr float LOG2_C2 = -0.67808149f;
+    constexpr float LOG2_C3 = 0.32363037f;
+    constexpr float LOG2_C4 = -0.08428509f;
+
+    constexpr float TOP_BIT = 2147483648.0f;
+    constexpr float LAST = (float)(ToneMapper::LUT_SIZE - 1);
+
+    /** Pixels per task handed to the pool; a multiple of every vector width. */
+    constexpr size_t CHUNK = 1 << 16;
+
+    inline int indexScalar(uint32_t n, float scale) {
+        // Converted as the vector paths must, without unsigned conversions.
+        const float x = (float)(int32_t)(n & 0x7fffffffu) + ((n >> 31) ? TOP_BIT : 0.0f) + 1.0f;
+        uint32_t bits;
+        memcpy(&bits, &x, sizeof bits);
+        const float exponent = (float)((int32_t)(bits >> 23) - 127);
+        const uint32_t mantissaBits = (bits & 0x007fffffu) | 0x3f800000u;
+        float mantissa;
+        memcpy(&mantissa, &mantissaBits, sizeof mantissa);
+        const float t = mantissa - 1.0f;
+        const float log2x = exponent + t * (LOG2_C1 + t * (LOG2_C2 + t * (LOG2_C3 + t * LOG2_C4)));
+        return (int)std::min(log2x * scale + 0.5f, LAST);
+    }
+
+    template<typename Pixel>
+    void mapScalar(const uint32_t *counts, size_t begin, size_t end, float scale,
+                   const Pixel *lut, void *out) {
+        for (size_t i = begin; i < end; i++) {
+            memcpy((char *)out + i * sizeof(Pixel), &lut[indexScalar(counts[i], scale)], sizeof(Pixel));
+        }
+    }
+
+#ifdef __SSE2__
+    inline __m128i indexSSE2(__m128i n, __m128 scale) {
+        const __m128 low = _mm_cvtepi32_ps(_mm_and_si128(n, _mm_set1_epi32(0x7fffffff)));
+        const __m128 high = _mm_and_ps(_mm_castsi128_ps(_mm_srai_epi32(n, 31)), _mm_set1_ps(TOP_BIT));
+        const __m128 x = _mm_add_ps(_mm_add_ps(low, high), _mm_set1_ps(1.0f));
+        const __m128i bits = _mm_castps_si128(x);
+        const __m128 exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+        const __m128 mantissa = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)),
+                                                              _mm_set1_epi32(0x3f800000)));
+        const __m128 t = _mm_sub_ps(mantissa, _mm_set1_ps(1.0f));
+        __m128 p = _mm_add_ps(_mm_set1_ps(LOG2_C3), _mm_mul_ps(t, _mm_set1_ps(LOG2_C4)));
+        p = _mm_add_ps(_mm_set1_ps(LOG2_C2), _mm_mul_ps(t, p));
+        p = _mm_add_ps(_mm_set1_ps(LOG2_C1), _mm_mul_ps(t, p));
+        const __m128 log2x = _mm_add_ps(exponent, _mm_mul_ps(t, p));
+        const __m128 index = _mm_add_ps(_mm_mul_ps(log2x, scale), _mm_set1_ps(0.5f));
+        return _mm_cvttps_epi32(_mm_min_ps(index, _mm_set1_ps(LAST)));
+    }
+
+    template<typename Pixel>
+    void mapSSE2(const uint32_t *counts, size_t begin, size_t end, float scale,
+                 const Pixel *lut, void *out) {
+        const __m128 scales = _mm_set1_ps(scale);
+        alignas(16) int32_t index[4];
+        alignas(16) Pixel pixels[4];
+        size_t i = begin;
+        for (; i + 4 <= end; i += 4) {
+            _mm_store_si128((__m128i *)index, indexSSE2(_mm_loadu_si128((const __m128i *)(counts + i)), scales));
+            for (int k = 0; k < 4; k++) {
+                pixels[k] = lut[index[k]];
+            }
+            memcpy((char *)out + i * sizeof(Pixel), pixels, sizeof pixels);
+        }
+        mapScalar(counts, i, end, scale, lut, out);
+    }
+#endif
+
+#ifdef TONE_MAP_AVX2
+    __attribute__((target("avx2"))) inline __m256i indexAVX2(__m256i n, __m256 scale) {
+        const __m256 low = _mm256_cvtepi32_ps(_mm256_and_si256(n, _mm256_set1_epi32(0x7fffffff)));
+        const __m256 high = _mm256_and_ps(_mm256_castsi256_ps(_mm256_srai_epi32(n, 31)), _mm256_set1_ps(TOP_BIT));
+        const __m256 x = _mm256_add_ps(_mm256_add_ps(low, high), _mm256_set1_ps(1.0f));
+        const __m256i bits = _mm256_castps_si256(x);
+        const __m256 exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23),
+                                                                    _mm256_set1_epi32(127)));
+        const __m256 mantissa = _mm256_castsi256_ps(_mm256_or_si256(
+                _mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f800000)));
+        const __m256 t = _mm256_sub_ps(mantissa, _mm256_set1_ps(1.0f));
+        // No FMA: it would round differently from the other paths.
+        __m256 p = _mm256_add_ps(_mm256_set1_ps(LOG2_C3), _mm256_mul_ps(t, _mm256_set1_ps(LOG2_C4)));
+        p = _mm256_add_ps(_mm256_set1_ps(LOG2_C2), _mm256_mul_ps(t, p));
+        p = _mm256_add_ps(_mm256_set1_ps(LOG2_C1), _mm256_mul_ps(t, p));
+        const __m256 log2x = _mm256_add_ps(exponent, _mm256_mul_ps(t, p));
+        const __m256 index = _mm256_add_ps(_mm256_mul_ps(log2x, scale), _mm256_set1_ps(0.5f));
+        return _mm256_cvttps_epi32(_mm256_min_ps(index, _mm256_set1_ps(LAST)));
+    }
+
+    __attribute__((target("avx2"))) void mapAVX2(const uint32_t *counts, size_t begin, size_t end, float scale,
+                                                 const uint32_t *lut, void *out) {
+        const __m256 scales = _mm256_set1_ps(scale);
+        size_t i = begin;
+        for (; i + 8 <= end; i += 8) {
+            const __m256i index = indexAVX2(_mm256_loadu_si256((const __m256i *)(counts + i)), scales);
+            const __m256i pixels = _mm256_i32gather_epi32((const int *)lut, index, 4);
+            _mm256_storeu_si256((__m256i *)((char *)out + i * sizeof(uint32_t)), pixels);
+        }
+        mapScalar(counts, i, end, scale, lut, out);
+    }
+
+    __attribute__((target("avx2"))) void mapAVX2(const uint32_t *counts, size_t begin, size_t end, float scale,
+                                                 const uint64_t *lut, void *out) {
+        const __m256 scales = _mm256_set1_ps(scale);
+        size_t i = begin;
+        for (; i + 8 <= end; i += 8) {
+            const __m256i index = indexAVX2(_mm256_loadu_si256((const __m256i *)(counts + i)), scales);
+            const __m256i first = _mm256_i64gather_epi64((const long long *)lut,
+                                                         _mm256_cvtepi32_epi64(_mm256_castsi256_si128(index)), 8);
+            const __m256i second = _mm256_i64gather_epi64((const long long *)lut,
+                                                          _mm256_cvtepi32_epi64(_mm256_extracti128_si256(index, 1)), 8);
+            char *pixels = (char *)out + i * sizeof(uint64_t);
+            _mm256_storeu_si256((__m256i *)pixels, first);
+            _mm256_storeu_si256((__m256i *)(pixels + 32), second);
+        }
+        mapScalar(counts, i, end, scale, lut, out);
+    }
+#endif
+
+    /** The palette colour at v, from the stops or the hue ramp of density.fs. */
+    void paletteColour(const std::vector<PaletteStop> &palette, float v, float rgb[3]) {
+        if (palette.empty()) {
+            static const float phase[3] = {0.0f, 0.33f, 0.67f};
+            for (int c = 0; c < 3; c++) {
+                rgb[c] = 0.5f + 0.5f * std::cos(6.28318f * (phase[c] + v * 0.8f));
+            }
+            return;
+        }
+        if (v <= palette.front().position || palette.size() == 1) {
+            rgb[0] = palette.front().r, rgb[1] = palette.front().g, rgb[2] = palette.front().b;
+            return;
+        }
+        for (size_t s = 1; s < palette.size(); s++) {
+            const PaletteStop &a = palette[s - 1], &b = palette[s];
+            if (v <= b.position) {
+                const float f = b.position > a.position ? (v - a.position) / (b.position - a.position) : 1.0f;
+                rgb[0] = a.r + (b.r - a.r) * f;
+                rgb[1] = a.g + (b.g - a.g) * f;
+                rgb[2] = a.b + (b.b - a.b) * f;
+                return;
+            }
+        }
+        rgb[0] = palette.back().r, rgb[1] = palette.back().g, rgb[2] = palette.back().b;
+    }
+
+    template<typename Pixel>
+    void mapAll(const uint32_t *counts, size_t pixels, uint32_t peak, const Pixel *lut, void *out,
+                WorkerPool *pool, ToneMapPath path) {
+        const float scale = (float)(LAST / std::log2(1.0 + std::max<uint32_t>(peak, 1)));
+        path = std::min(path, bestToneMapPath());
+        const auto task = [&](int chunk) {
+            const size_t begin = (size_t)chunk * CHUNK;
+            const size_t end = std::min(pixels, begin + CHUNK);
+            switch (path) {
+#ifdef TONE_MAP_AVX2
+                case TONEMAP_AVX2:
+                    mapAVX2(counts, begin, end, scale, lut, out);
+                    break;
+#endif
+#ifdef __SSE2__
+                case TONEMAP_SSE2:
+                    mapSSE2(counts, begin, end, scale, lut, out);
+                    break;
+#endif
+                default:
+                    mapScalar(counts, begin, end, scale, lut, out);
+                    break;
+            }
+        };
+        const int chunks = (int)((pixels + CHUNK - 1) / CHUNK);
+        if (pool && chunks > 1) {
+            pool->parallelFor(chunks, task);
+        } else {
+            for (int chunk = 0; chunk < chunks; chunk++) {
+                task(chunk);
+            }
+        }
+    }
+}
+
+const char *toneMapPathName(ToneMapPath path) {
+    switch (path) {
+        case TONEMAP_SSE2: return "sse2";
+        case TONEMAP_AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+ToneMapPath bestToneMapPath() {
+#ifdef TONE_MAP_AVX2
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+        return TONEMAP_AVX2;
+    }
+#endif
+#ifdef __SSE2__
+    return TONEMAP_SSE2;
+#else
+    return TONEMAP_SCALAR;
+#endif
+}
+
+ToneMapper::ToneMapper(const ToneMapSettings &settings) : lut8(LUT_SIZE), lut16(LUT_SIZE) {
+    const float inverseGamma = 1.0f / std::max(settings.gamma, 0.01f);
+    for (int i = 0; i < LUT_SIZE; i++) {
+        const float v = i / LAST;
+        const float alpha = std::pow(v, inverseGamma);
+        float ramp[3], c[3];
+        paletteColour(settings.palette, v, ramp);
+        for (int k = 0; k < 3; k++) {
+            // Vibrancy blends the gamma of the density alone with the gamma of each channel.
+            const float perChannel = std::pow(std::max(ramp[k] * v, 0.0f), inverseGamma);
+            c[k] = settings.brightness * (settings.vibrancy * ramp[k] * alpha + (1.0f - settings.vibrancy) * perChannel);
+        }
+        // The Reinhard curve and luminance lift of chaos.fs, over the background as in density.fs.
+        const float luminance = 0.2126f * c[0] + 0.7152f * c[1] + 0.0722f * c[2];
+        const float coverage = std::min(alpha * 4.0f, 1.0f);
+        uint32_t pixel8 = 0xffu << 24;
+        uint64_t pixel16 = (uint64_t)0xffff << 48;
+        for (int k = 0; k < 3; k++) {
+            const float tone = c[k] / (c[k] + 1.0f) * (1.0f + luminance) * 1.2f;
+            const float out = std::min(std::max(settings.background[k] + (tone - settings.background[k]) * coverage,
+                                                0.0f), 1.0f);
+            pixel8 |= (uint32_t)std::lround(out * 255.0f) << (8 * k);
+            pixel16 |= (uint64_t)std::lround(out * 65535.0f) << (16 * k);
+        }
+        lut8[i] = pixel8;
+        lut16[i] = pixel16;
+    }
+}
+
+void ToneMapper::toRGBA8(const uint32_t *counts, size_t pixels, uint32_t peak, uint8_t *rgba,
+                         WorkerPool *pool, ToneMapPath path) const {
+    mapAll(counts, pixels, peak, lut8.data(), rgba, pool, path);
+}
+
+void ToneMapper::toRGBA16(const uint32_t *counts, size_t pixels, uint32_t peak, uint16_t *rgba,
+                          WorkerPool *pool, ToneMapPath path) const {
+    mapAll(counts, pixels, peak, lut16.data(), rgba, pool, path);
+}
@@ -0,0 +1,305 @@
+#include "video_stream.hpp"
+
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __unix__
+#include <unistd.h>
+#endif
+
+namespace {
+    // BT.601 limited range in 8.8 fixed point: Y from one pixel, U and V from the sum of a 2x2 block.
+    constexpr int Y_R = 66, Y_G = 129, Y_B = 25;
+    constexpr int U_R = -38, U_G = -74, U_B = 112;
+    constexpr int V_R = 112, V_G = -94, V_B = -18;
+
+    inline uint8_t lumaOf(const uint8_t *p) {
+        return (uint8_t)(16 + ((Y_R * p[0] + Y_G * p[1] + Y_B * p[2] + 128) >> 8));
+    }
+
+    /** U and V of the block whose channel sums are r, g, b. */
+    inline void chromaOf(int r, int g, int b, uint8_t &u, uint8_t &v) {
+        u = (uint8_t)(128 + ((U_R * r + U_G * g + U_B * b + 512) >> 10));
+        v = (uint8_t)(128 + ((V_R * r + V_G * g + V_B * b + 512) >> 10));
+    }
+
+#ifdef __SSE2__
+    /** Sums the 32-bit pairs of two _mm_madd_epi16 results: one value per pixel, a's then b's. */
+    inline __m128i addPairs(__m128i a, __m128i b) {
+        const __m128 fa = _mm_castsi128_ps(a), fb = _mm_castsi128_ps(b);
+        return _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0))),
+                             _mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1))));
+    }
+
+    /** Y of four pixels, as 32-bit lanes. */
+    inline __m128i luma4(__m128i pixels) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i weights = _mm_setr_epi16(Y_R, Y_G, Y_B, 0, Y_R, Y_G, Y_B, 0);
+        const __m128i sum = addPairs(_mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), weights),
+                                     _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), weights));
+        return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8), _mm_set1_epi32(16));
+    }
+
+    /** The 16-bit channel sums of two 2x2 blocks, from two pixels of each of two rows. */
+    inline __m128i blockSums(__m128i top, __m128i bottom) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+        const __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+        return _mm_unpacklo_epi64(_mm_add_epi16(lo, _mm_srli_si128(lo, 8)), _mm_add_epi16(hi, _mm_srli_si128(hi, 8)));
+    }
+
+    /** U or V of four blocks, packed into the low four bytes. */
+    inline int chroma4(__m128i blocks01, __m128i blocks23, __m128i weights) {
+        const __m128i sum = addPairs(_mm_madd_epi16(blocks01, weights), _mm_madd_epi16(blocks23, weights));
+        const __m128i c = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(512)), 10),
+                                        _mm_set1_epi32(128));
+        const __m128i packed = _mm_packs_epi32(c, c);
+        return _mm_cvtsi128_si32(_mm_packus_epi16(packed, packed));
+    }
+#endif
+
+    /** Y of a row. */
+    void lumaRow(const uint8_t *in, int width, uint8_t *y) {
+        int x = 0;
+#ifdef __SSE2__
+        for (; x + 8 <= width; x += 8) {
+            const __m128i first = luma4(_mm_loadu_si128((const __m128i *)(in + x * 4)));
+            const __m128i second = luma4(_mm_loadu_si128((const __m128i *)(in + x * 4 + 16)));
+            const __m128i packed = _mm_packs_epi32(first, second);
+            _mm_storel_epi64((__m128i *)(y + x), _mm_packus_epi16(packed, packed));
+        }
+#endif
+        for (; x < width; x++) {
+            y[x] = lumaOf(in + x * 4);
+        }
+    }
+
+    /** U and V of a row of blocks, from two rows of pixels; `bottom` is `top` on an odd last row. */
+    void chromaRow(const uint8_t *top, const uint8_t *bottom, int width, uint8_t *u, uint8_t *v) {
+        int x = 0;
+#ifdef __SSE2__
+        const __m128i uWeights = _mm_setr_epi16(U_R, U_G, U_B, 0, U_R, U_G, U_B, 0);
+        const __m128i vWeights = _mm_setr_epi16(V_R, V_G, V_B, 0, V_R, V_G, V_B, 0);
+        for (; 2 * x + 8 <= width; x += 4) {
+            const uint8_t *t = top + x * 8, *b = bottom + x * 8;
+            const __m128i blocks01 = blockSums(_mm_loadu_si128((const __m128i *)t),
+                                               _mm_loadu_si128((const __m128i *)b));
+            const __m128i blocks23 = blockSums(_mm_loadu_si128((const __m128i *)(t + 16)),
+                                               _mm_loadu_si128((const __m128i *)(b + 16)));
+            const int us = chroma4(blocks01, blocks23, uWeights), vs = chroma4(blocks01, blocks23, vWeights);
+            memcpy(u + x, &us, 4);
+            memcpy(v + x, &vs, 4);
+        }
+#endif
+        for (; 2 * x < width; x++) {
+            const int left = 2 * x * 4, right = std::min(2 * x + 1, width - 1) * 4;
+            chromaOf(top[left] + top[right] + bottom[left] + bottom[right],
+                     top[left + 1] + top[right + 1] + bottom[left + 1] + bottom[right + 1],
+                     top[left + 2] + top[right + 2] + bottom[left + 2] + bottom[right + 2], u[x], v[x]);
+        }
+    }
+}
+
+const char *videoFormatName(VideoFormat format) {
+    return format == VIDEO_RGBA ? "rgba" : "y4m";
+}
+
+bool parseVideoFormat(const char *name, VideoFormat &format) {
+    for (VideoFormat candidate : {VIDEO_Y4M, VIDEO_RGBA}) {
+        if (strcmp(name, videoFormatName(candidate)) == 0) {
+            format = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *backpressureName(Backpressure policy) {
+    return policy == BACKPRESSURE_BLOCK ? "block" : "drop";
+}
+
+bool parseBackpressure(const char *name, Backpressure &policy) {
+    for (Backpressure candidate : {BACKPRESSURE_DROP, BACKPRESSURE_BLOCK}) {
+        if (strcmp(name, backpressureName(candidate)) == 0) {
+            policy = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void rgbaToI420(const uint8_t *rgba, int width, int height, bool bottomUp, uint8_t *y, uint8_t *u, uint8_t *v) {
+    const size_t stride = (size_t)width * 4;
+    const int chromaWidth = (width + 1) / 2;
+    auto row = [&](int i) {
+        return rgba + (size_t)(bottomUp ? height - 1 - i : i) * stride;
+    };
+    for (int i = 0; i < height; i++) {
+        lumaRow(row(i), width, y + (size_t)i * width);
+    }
+    for (int i = 0; i < (height + 1) / 2; i++) {
+        chromaRow(row(2 * i), row(std::min(2 * i + 1, height - 1)), width,
+                  u + (size_t)i * chromaWidth, v + (size_t)i * chromaWidth);
+    }
+}
+
+VideoStream::VideoStream(const char *path, VideoFormat format, Backpressure policy, int fps, int slots)
+        : path(path), format(format), policy(policy), fps(std::max(fps, 1)), frames((size_t)std::max(slots, 1)) {
+    for (int i = (int)frames.size(); i-- > 0;) {
+        idle.push_back(i);
+    }
+#ifdef SIGPIPE
+    // A reader that quits fails the next write instead of killing the program.
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    if (strcmp(path, "-") == 0) {
+#ifdef __unix__
+        const int stream = dup(STDOUT_FILENO);
+        fflush(stdout);
+        if (stream >= 0 && dup2(STDERR_FILENO, STDOUT_FILENO) >= 0) {
+            output = fdopen(stream, "wb");
+        }
+#else
+        output = stdout;
+#endif
+        broken = output == nullptr;
+    }
+    writer = std::thread(&VideoStream::writerLoop, this);
+}
+
+VideoStream::~VideoStream() {
+    close();
+}
+
+bool VideoStream::push(const uint8_t *rgba, int width, int height) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (this->width == 0) {
+        this->width = width;
+        this->height = height;
+    }
+    if (policy == BACKPRESSURE_BLOCK) {
+        freed.wait(lock, [this] { return !idle.empty() || broken || closing; });
+    }
+    if (idle.empty() || broken || closing || width != this->width || height != this->height) {
+        framesDropped++;
+        return false;
+    }
+    const int slot = idle.back();
+    idle.pop_back();
+    lock.unlock();
+
+    // The slot is ours until queued: the copy runs outside the lock.
+    Frame &frame = frames[slot];
+    frame.rgba.assign(rgba, rgba + (size_t)width * height * 4);
+    frame.width = width;
+    frame.height = height;
+
+    lock.lock();
+    queued.push_back(slot);
+    wake.notify_one();
+    return true;
+}
+
+void VideoStream::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    wake.notify_one();
+    freed.notify_all();
+    if (writer.joinable()) {
+        writer.join();
+    }
+    if (output) {
+        fclose(output);
+        output = nullptr;
+    }
+}
+
+long VideoStream::written() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return framesWritten;
+}
+
+long VideoStream::dropped() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return framesDropped;
+}
+
+bool VideoStream::failed() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return broken;
+}
+
+void VideoStream::writerLoop() {
+    if (!output && !broken) {
+        FILE *file = fopen(path, "wb");
+        std::lock_guard<std::mutex> lock(mutex);
+        output = file;
+        broken = file == nullptr;
+        if (broken) {
+            fprintf(stderr, "Unable to open the video stream '%s'\n", path);
+            freed.notify_all();
+        }
+    }
+    bool headerWritten = format != VIDEO_Y4M;
+    for (;;) {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this] { return !queued.empty() || closing; });
+        if (queued.empty()) {
+            return;
+        }
+        const int slot = queued.front();
+        queued.pop_front();
+        const bool skip = broken;
+        lock.unlock();
+
+        bool written = false;
+        if (!skip) {
+            const Frame &frame = frames[slot];
+            if (!headerWritten) {
+                headerWritten = fprintf(output, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",
+                                        frame.width, frame.height, fps) > 0;
+            }
+            written = headerWritten && writeFrame(frame);
+        }
+
+        lock.lock();
+        if (written) {
+            framesWritten++;
+        } else {
+            framesDropped++;
+            if (!broken && !skip) {
+                fprintf(stderr, "The video stream '%s' cannot be written, the rest is dropped\n", path);
+            }
+            broken = true;
+        }
+        idle.push_back(slot);
+        freed.notify_one();
+    }
+}
+
+bool VideoStream::writeFrame(const Frame &frame) {
+    const size_t stride = (size_t)frame.width * 4;
+    if (format == VIDEO_RGBA) {
+        // Top row first, as the readers of raw video expect.
+        for (int i = frame.height; i-- > 0;) {
+            if (fwrite(frame.rgba.data() + (size_t)i * stride, 1, stride, output) != stride) {
+                return false;
+            }
+        }
+        return fflush(output) == 0;
+    }
+    const size_t luma = (size_t)frame.width * frame.height;
+    const size_t chroma = (size_t)((frame.width + 1) / 2) * ((frame.height + 1) / 2);
+    planes.resize(luma + 2 * chroma);
+    rgbaToI420(frame.rgba.data(), frame.width, frame.height, true,
+               planes.data(), planes.data() + luma, planes.data() + luma + chroma);
+    return fputs("FRAME\n", output) >= 0
+           && fwrite(planes.data(), 1, planes.size(), output) == planes.size()
+           && fflush(output) == 0;
+}
@@ -0,0 +1,52 @@
+#include "view_framing.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    /** The values at the `tail` and 1 - `tail` quantiles, by two selections. */
+    void percentiles(std::vector<double> &values, double tail, double &low, double &high) {
+        const size_t last = values.size() - 1;
+        const size_t lowIndex = (size_t)(tail * last);
+        const size_t highIndex = last - lowIndex;
+        std::nth_element(values.begin(), values.begin() + lowIndex, values.end());
+        low = values[lowIndex];
+        // The high quantile lies past the low one, no need to look left of it again.
+        std::nth_element(values.begin() + lowIndex, values.begin() + highIndex, values.end());
+        high = values[highIndex];
+    }
+}
+
+FrameBounds percentileBounds(std::vector<double> &xs, std::vector<double> &ys, double tail) {
+    FrameBounds bounds = {-1.0, -1.0, 1.0, 1.0};
+    if (xs.empty() || ys.empty()) {
+        return bounds;
+    }
+    percentiles(xs, tail, bounds.minX, bounds.maxX);
+    percentiles(ys, tail, bounds.minY, bounds.maxY);
+    return bounds;
+}
+
+ViewFit fitBounds(const FrameBounds &bounds, double aspect, double margin) {
+    // A degenerate cloud (a fixed point, a line) still gets a finite scale.
+    constexpr double MIN_EXTENT = 1.0e-9;
+    const double width = std::max(bounds.maxX - bounds.minX, MIN_EXTENT);
+    const double height = std::max(bounds.maxY - bounds.minY, MIN_EXTENT);
+    // Equal pixels per unit on both axes: scaleY = scaleX * aspect.
+    const double scaleX = (1.0 - margin) * std::min(2.0 / width, 2.0 / (height * aspect));
+    ViewFit fit;
+    fit.scaleX = scaleX;
+    fit.scaleY = scaleX * aspect;
+    fit.offsetX = -(bounds.minX + bounds.maxX) * 0.5 * fit.scaleX;
+    fit.offsetY = -(bounds.minY + bounds.maxY) * 0.5 * fit.scaleY;
+    return fit;
+}
+
+bool fitDiffers(const ViewFit &current, const ViewFit &next, double tolerance) {
+    // The screen centre in attractor space, measured in clip units of the current fit.
+    const double shiftX = (next.offsetX / next.scaleX - current.offsetX / current.scaleX) * current.scaleX;
+    const double shiftY = (next.offsetY / next.scaleY - current.offsetY / current.scaleY) * current.scaleY;
+    const double zoom = next.scaleX / current.scaleX;
+    return std::fabs(shiftX) > 2.0 * tolerance || std::fabs(shiftY) > 2.0 * tolerance
+           || std::fabs(std::log(zoom)) > tolerance;
+}
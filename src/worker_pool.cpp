@@ -0,0 +1,102 @@
+#include "worker_pool.hpp"
+#include "numa_topology.hpp"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(unsigned threads, bool pinned) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 1; i < threads; i++) {
+        workers.emplace_back(&WorkerPool::workerLoop, this, i, pinned);
+    }
+}
+
+int WorkerPool::nodeOf(unsigned worker) const {
+    return static_cast<int>(worker % static_cast<unsigned>(NumaTopology::get().nodes()));
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quitting = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+/**
+ * Takes tasks until none are left.
+ */
+void WorkerPool::drain(unsigned index) {
+    if (staticSchedule) {
+        for (int i = static_cast<int>(index); i < taskCount; i += static_cast<int>(size())) {
+            (*task)(i);
+        }
+        return;
+    }
+    for (int i = nextTask++; i < taskCount; i = nextTask++) {
+        (*task)(i);
+    }
+}
+
+void WorkerPool::workerLoop(unsigned index, bool pinned) {
+    if (pinned) {
+        NumaTopology::get().pinCurrentThread(nodeOf(index));
+    }
+    unsigned long seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return quitting || generation != seen; });
+            if (quitting) {
+                return;
+            }
+            seen = generation;
+        }
+        drain(index);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finishedWorkers++;
+        }
+        done.notify_one();
+    }
+}
+
+void WorkerPool::parallelFor(int count, const std::function<void(int)> &fn) {
+    run(count, fn, false);
+}
+
+void WorkerPool::parallelForStatic(int count, const std::function<void(int)> &fn) {
+    run(count, fn, true);
+}
+
+void WorkerPool::run(int count, const std::function<void(int)> &fn, bool statically) {
+    if (count <= 0) {
+        return;
+    }
+    if (count == 1 || workers.empty()) {
+        for (int i = 0; i < count; i++) {
+            fn(i);
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = &fn;
+        taskCount = count;
+        nextTask = 0;
+        staticSchedule = statically;
+        finishedWorkers = 0;
+        generation++;
+    }
+    wake.notify_all();
+    drain(0);
+
+    // Every worker takes part in every generation, so none can be left holding this task.
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return finishedWorkers == workers.size(); });
+    task = nullptr;
+}